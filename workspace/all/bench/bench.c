@@ -0,0 +1,1247 @@
+// micro-benchmarks, one group per run. scale (the default) is every
+// scaler_t from scaler.h plus scaleAA and the XRGB8888 to RGB565
+// conversions over common core resolutions, and the rewind deltas
+// reusing its columns (src_w is the state size in bytes, dst_w the
+// delta size and mpix_per_s is MB/s of state). rom compares loading a
+// rom by mmap against reading it, in a child process each so their
+// peak rss doesn't mix. zip times unzipping a rom for a core that
+// takes data, straight to memory against the old round trip through
+// /tmp, and inflate times extraction alone on one thread against the
+// three thread pipeline. save is a histogram of frame times in a
+// frame loop that saves states, on the frame thread or through the
+// writer, state times saving and loading a state raw against the
+// compressed container, resample is each audio resampler's frames
+// per second at common core rates, ff is the fast forward speed
+// each ff audio mode leaves a core, runahead is what saving and
+// loading the state costs run ahead per frame and pace is how late
+// minarch's frame pacer wakes up at common core rates. every group
+// prints one line per run as csv (default) or json (-j) so results
+// can be diffed between releases
+//
+// usage: bench.elf [-j] [-t ms] [-s WxH] [-d dir] [-g group] [filter]
+//	-j	json instead of csv
+//	-t	minimum time per run, default 200ms
+//	-s	screen the aa runs fit to, default 1024x768
+//	-d	where the rom, zip, inflate, save and state runs write
+//		their files, default the current directory. use the sd card
+//	-g	scale, rom, zip, inflate, save, state, resample, ff, runahead
+//		or pace
+//	filter	only run scalers, resamplers, sources or rates whose name contains this
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <zlib.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#endif
+
+#include "pixel.h"
+#include "scaler.h"
+#include "delta.h"
+#include "rom.h"
+#include "zip.h"
+#include "writer.h"
+#include "state.h"
+#include "audio.h"
+#include "runahead.h"
+
+///////////////////////////////
+
+typedef struct Kernel {
+	char* name;
+	scaler_t scale;
+	int src_bpp;
+	int dst_bpp;
+	int xmul;
+	int ymul;
+} Kernel;
+
+#define KERNEL(name,src_bpp,dst_bpp,xmul,ymul) { #name, name, src_bpp, dst_bpp, xmul, ymul }
+#define CONVERT(name,dither) \
+	static void name##_##dither(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) { \
+		name(src, dst, sw, sh, sp, dp, dither); \
+	}
+CONVERT(convert_32to16,0)
+CONVERT(convert_32to16,1)
+CONVERT(convert_c32to16,0)
+CONVERT(convert_c32to16,1)
+#define KERNELS(suffix,src_bpp,dst_bpp) \
+	KERNEL(scale1x1_##suffix,src_bpp,dst_bpp,1,1), KERNEL(scale1x2_##suffix,src_bpp,dst_bpp,1,2), \
+	KERNEL(scale1x3_##suffix,src_bpp,dst_bpp,1,3), KERNEL(scale1x4_##suffix,src_bpp,dst_bpp,1,4), \
+	KERNEL(scale2x1_##suffix,src_bpp,dst_bpp,2,1), KERNEL(scale2x2_##suffix,src_bpp,dst_bpp,2,2), \
+	KERNEL(scale2x3_##suffix,src_bpp,dst_bpp,2,3), KERNEL(scale2x4_##suffix,src_bpp,dst_bpp,2,4), \
+	KERNEL(scale3x1_##suffix,src_bpp,dst_bpp,3,1), KERNEL(scale3x2_##suffix,src_bpp,dst_bpp,3,2), \
+	KERNEL(scale3x3_##suffix,src_bpp,dst_bpp,3,3), KERNEL(scale3x4_##suffix,src_bpp,dst_bpp,3,4), \
+	KERNEL(scale4x1_##suffix,src_bpp,dst_bpp,4,1), KERNEL(scale4x2_##suffix,src_bpp,dst_bpp,4,2), \
+	KERNEL(scale4x3_##suffix,src_bpp,dst_bpp,4,3), KERNEL(scale4x4_##suffix,src_bpp,dst_bpp,4,4), \
+	KERNEL(scale5x1_##suffix,src_bpp,dst_bpp,5,1), KERNEL(scale5x2_##suffix,src_bpp,dst_bpp,5,2), \
+	KERNEL(scale5x3_##suffix,src_bpp,dst_bpp,5,3), KERNEL(scale5x4_##suffix,src_bpp,dst_bpp,5,4), \
+	KERNEL(scale5x5_##suffix,src_bpp,dst_bpp,5,5), \
+	KERNEL(scale6x1_##suffix,src_bpp,dst_bpp,6,1), KERNEL(scale6x2_##suffix,src_bpp,dst_bpp,6,2), \
+	KERNEL(scale6x3_##suffix,src_bpp,dst_bpp,6,3), KERNEL(scale6x4_##suffix,src_bpp,dst_bpp,6,4), \
+	KERNEL(scale6x5_##suffix,src_bpp,dst_bpp,6,5), KERNEL(scale6x6_##suffix,src_bpp,dst_bpp,6,6)
+
+static Kernel kernels[] = {
+	KERNELS(c16,2,2),
+	KERNELS(c32,4,4),
+	KERNELS(c32to16,4,2),
+#ifdef HAS_NEON
+	KERNELS(n16,2,2),
+	KERNELS(n32,4,4),
+#endif
+#ifdef __SSE2__
+	KERNELS(s16,2,2),
+	KERNELS(s32,4,4),
+#endif
+	KERNEL(convert_32to16_0,4,2,1,1), // _1 is dithered
+	KERNEL(convert_32to16_1,4,2,1,1),
+	KERNEL(convert_c32to16_0,4,2,1,1),
+	KERNEL(convert_c32to16_1,4,2,1,1),
+	KERNEL(scale1x_c16to32,2,4,1,1),
+	KERNEL(scale2x_c16to32,2,4,2,2),
+	KERNEL(scale1x_line,2,2,1,1),
+	KERNEL(scale2x_line,2,2,2,2),
+	KERNEL(scale3x_line,2,2,3,3),
+	KERNEL(scale4x_line,2,2,4,4),
+	KERNEL(scale2x_grid,2,2,2,2),
+	KERNEL(scale3x_grid,2,2,3,3),
+};
+
+static struct Source {
+	char* name;
+	int w;
+	int h;
+} sources[] = {
+	{"gb",   160,144},
+	{"gba",  240,160},
+	{"snes", 256,224},
+	{"ps1",  320,240},
+	{"ps1hi",640,480},
+};
+
+// typical serialize_size() of the cores we ship, and how much of it
+// changes between rewind snapshots
+static struct Source states[] = {
+	{"gb",      65536,1},
+	{"gba",    409600,1},
+	{"snes",  1048576,1},
+	{"ps1",   4718592,1},
+};
+#define STATE_CHANGED 50 // one byte in this many
+
+#define MAX_DST 4096 // skip runs whose output would be bigger than this on either side
+#define SCREEN_WIDTH 1024 // tg3040
+#define SCREEN_HEIGHT 768
+
+///////////////////////////////
+
+static struct Bench_Context {
+	int json;
+	int min_ms;
+	char* filter;
+	char* dir;
+	char* columns; // of the group being run, csv
+	int screen_w;
+	int screen_h;
+	int runs;
+	int perf_fd; // -1 when perf_event_open isn't available
+} bench;
+
+static uint64_t getNanoseconds(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void Perf_init(void) {
+	bench.perf_fd = -1;
+#ifdef __linux__
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.size = sizeof(attr);
+	attr.config = PERF_COUNT_HW_CACHE_MISSES;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	bench.perf_fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+}
+static void Perf_start(void) {
+#ifdef __linux__
+	if (bench.perf_fd<0) return;
+	ioctl(bench.perf_fd, PERF_EVENT_IOC_RESET, 0);
+	ioctl(bench.perf_fd, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+}
+static int64_t Perf_stop(void) {
+	uint64_t count = 0;
+#ifdef __linux__
+	if (bench.perf_fd<0) return -1;
+	ioctl(bench.perf_fd, PERF_EVENT_IOC_DISABLE, 0);
+	if (read(bench.perf_fd, &count, sizeof(count))!=sizeof(count)) return -1;
+	return count;
+#else
+	return -1;
+#endif
+}
+
+///////////////////////////////
+
+static void* allocPixels(size_t size) {
+	void* pixels = NULL;
+	if (posix_memalign(&pixels, 64, size)) return NULL;
+	return pixels;
+}
+static void fillPixels(void* pixels, size_t size) {
+	// noise so no scaler gets to take its equal-neighbour shortcuts
+	uint32_t seed = 0x12345678;
+	uint8_t* bytes = pixels;
+	for (size_t i=0; i<size; i++) {
+		seed = seed * 1664525 + 1013904223;
+		bytes[i] = seed >> 24;
+	}
+}
+
+static void printHeader(char* columns) {
+	bench.columns = columns;
+	if (bench.json) puts("[");
+	else puts(columns);
+}
+// a csv row, empty fields are null in json and anything that
+// isn't a number is quoted
+static void printRow(char* format, ...) {
+	char row[1024];
+	va_list args;
+	va_start(args, format);
+	vsnprintf(row, sizeof(row), format, args);
+	va_end(args);
+	
+	if (!bench.json) puts(row);
+	else {
+		printf("%s\t{", bench.runs ? ",\n" : "");
+		char* column = bench.columns;
+		char* value = row;
+		while (*column) {
+			int column_len = strcspn(column, ",");
+			int value_len = strcspn(value, ",");
+			char field[256];
+			snprintf(field, sizeof(field), "%.*s", value_len, value);
+			char* end;
+			strtod(field, &end);
+			printf("%s\"%.*s\":", column==bench.columns ? "" : ",", column_len, column);
+			if (!value_len) printf("null");
+			else if (*end) printf("\"%s\"", field);
+			else printf("%s", field);
+			column += column_len + (column[column_len]==',');
+			value += value_len + (value[value_len]==',');
+		}
+		printf("}");
+	}
+	bench.runs += 1;
+	fflush(stdout);
+}
+static void printFooter(void) {
+	if (bench.json) puts("\n]");
+}
+static void printRun(char* name, struct Source* source, int dst_w, int dst_h, int frames, double ns, double mpix, double misses) {
+	char misses_text[32] = "";
+	if (misses>=0) sprintf(misses_text, "%.0f", misses);
+	printRow("%s,%s,%i,%i,%i,%i,%i,%.0f,%.2f,%s", name, source->name, source->w, source->h, dst_w, dst_h, frames, ns, mpix, misses_text);
+}
+
+// the aa scaler is set up per source/destination pair so get it inside the run
+static void run(char* name, scaler_t scale, struct Source* source, int src_bpp, int dst_w, int dst_h, int dst_bpp) {
+	if (bench.filter && !strstr(name, bench.filter) && !strstr(source->name, bench.filter)) return;
+	if (dst_w>MAX_DST || dst_h>MAX_DST) return;
+
+	int src_p = source->w * src_bpp;
+	int dst_p = dst_w * dst_bpp;
+	size_t src_size = src_p * source->h;
+	size_t dst_size = (size_t)dst_p * dst_h;
+	void* src = allocPixels(src_size);
+	void* dst = allocPixels(dst_size);
+	if (!src || !dst) {
+		fprintf(stderr, "bench: out of memory for %s %ix%i\n", name, dst_w, dst_h);
+		free(src);
+		free(dst);
+		return;
+	}
+	fillPixels(src, src_size);
+	memset(dst, 0, dst_size);
+
+	if (!scale) scale = scaleAA_get(source->w, source->h, dst_w, dst_h, SCALE_AA_AUTO);
+	if (!scale) {
+		fprintf(stderr, "bench: couldn't set up %s %ix%i\n", name, dst_w, dst_h);
+		free(src);
+		free(dst);
+		return;
+	}
+
+	// warm the caches and branch predictors
+	for (int i=0; i<3; i++) scale(src, dst, source->w, source->h, src_p, dst_w, dst_h, dst_p);
+
+	uint64_t min_ns = (uint64_t)bench.min_ms * 1000000;
+	uint64_t elapsed = 0;
+	int frames = 0;
+	Perf_start();
+	uint64_t start = getNanoseconds();
+	while (frames<10 || elapsed<min_ns) {
+		scale(src, dst, source->w, source->h, src_p, dst_w, dst_h, dst_p);
+		frames += 1;
+		elapsed = getNanoseconds() - start;
+	}
+	int64_t misses = Perf_stop();
+
+	double ns = (double)elapsed / frames;
+	double mpix = (double)dst_w * dst_h / ns * 1000.0; // pixels per ns to Mpix per s
+	printRun(name, source, dst_w, dst_h, frames, ns, mpix, misses<0 ? -1 : (double)misses / frames);
+
+	free(src);
+	free(dst);
+}
+
+// what rewind costs per snapshot, encoding when pushing and
+// applying when stepping back
+static void runDelta(struct Source* state) {
+	size_t size = state->w;
+	uint8_t* prev = allocPixels(size);
+	uint8_t* next = allocPixels(size);
+	uint8_t* delta = allocPixels(DELTA_MAX_SIZE(size));
+	if (!prev || !next || !delta) {
+		fprintf(stderr, "bench: out of memory for %s delta\n", state->name);
+		free(prev);
+		free(next);
+		free(delta);
+		return;
+	}
+	fillPixels(prev, size);
+	memcpy(next, prev, size);
+	uint32_t seed = 0x87654321;
+	for (size_t i=0; i<size/STATE_CHANGED; i++) {
+		seed = seed * 1664525 + 1013904223;
+		next[(seed >> 4) % size] += 1;
+	}
+	size_t delta_size = Delta_encode(prev, next, size, delta);
+
+	for (int apply=0; apply<2; apply++) {
+		char* name = apply ? "Delta_apply" : "Delta_encode";
+		if (bench.filter && !strstr(name, bench.filter) && !strstr(state->name, bench.filter)) continue;
+
+		uint64_t min_ns = (uint64_t)bench.min_ms * 1000000;
+		uint64_t elapsed = 0;
+		int frames = 0;
+		Perf_start();
+		uint64_t start = getNanoseconds();
+		while (frames<10 || elapsed<min_ns) {
+			if (apply) Delta_apply(prev, delta, delta_size); // flips prev between the two states
+			else Delta_encode(prev, next, size, delta);
+			frames += 1;
+			elapsed = getNanoseconds() - start;
+		}
+		int64_t misses = Perf_stop();
+
+		double ns = (double)elapsed / frames;
+		printRun(name, state, delta_size, 1, frames, ns, size / ns * 1000.0, misses<0 ? -1 : (double)misses / frames);
+	}
+
+	free(prev);
+	free(next);
+	free(delta);
+}
+
+static void benchScale(void) {
+	int source_count = sizeof(sources) / sizeof(sources[0]);
+	int kernel_count = sizeof(kernels) / sizeof(kernels[0]);
+
+	printHeader("scaler,source,src_w,src_h,dst_w,dst_h,frames,ns_per_frame,mpix_per_s,cache_misses_per_frame");
+	for (int s=0; s<source_count; s++) {
+		struct Source* source = &sources[s];
+		for (int k=0; k<kernel_count; k++) {
+			Kernel* kernel = &kernels[k];
+			run(kernel->name, kernel->scale, source, kernel->src_bpp, source->w * kernel->xmul, source->h * kernel->ymul, kernel->dst_bpp);
+		}
+
+		// aspect fit to the screen, the case the aa scaler exists for
+		int dst_h = bench.screen_h;
+		int dst_w = source->w * bench.screen_h / source->h;
+		if (dst_w>bench.screen_w) {
+			dst_w = bench.screen_w;
+			dst_h = source->h * bench.screen_w / source->w;
+		}
+		dst_w &= ~1;
+		run("scaleAA", NULL, source, 2, dst_w, dst_h, 2); // rgb565 only
+	}
+	int state_count = sizeof(states) / sizeof(states[0]);
+	for (int s=0; s<state_count; s++) runDelta(&states[s]);
+	printFooter();
+
+	scaleAA_free();
+}
+
+///////////////////////////////
+
+// rom sizes, most of what we ship fits in the smallest, n64 and
+// the biggest md/gba sets don't
+static struct Source roms[] = {
+	{"4MB",   4,0},
+	{"16MB", 16,0},
+	{"64MB", 64,0},
+};
+
+// a file of noise in bench.dir, NULL on failure. caller frees the path
+#define CHUNK_SIZE (1024 * 1024)
+#define MAX_PATH 512
+static char* makeFile(char* name, size_t size) {
+	char* path = malloc(strlen(bench.dir) + strlen(name) + 2);
+	uint8_t* chunk = allocPixels(CHUNK_SIZE);
+	if (!path || !chunk) {
+		free(path);
+		free(chunk);
+		return NULL;
+	}
+	sprintf(path, "%s/%s", bench.dir, name);
+	fillPixels(chunk, CHUNK_SIZE);
+	
+	FILE* file = fopen(path, "wb");
+	int ok = file!=NULL;
+	for (size_t done=0; ok && done<size; done+=CHUNK_SIZE) {
+		chunk[0] = done / CHUNK_SIZE; // no two chunks alike
+		size_t count = size-done<CHUNK_SIZE ? size-done : CHUNK_SIZE;
+		ok = fwrite(chunk, 1, count, file)==count;
+	}
+	if (file) {
+		ok = !fflush(file) && !fsync(fileno(file)) && ok;
+		fclose(file);
+	}
+	free(chunk);
+	if (!ok) {
+		fprintf(stderr, "bench: couldn't write %s\n", path);
+		unlink(path);
+		free(path);
+		return NULL;
+	}
+	return path;
+}
+// so every run starts from the sd card, not the page cache
+static void dropCache(char* path) {
+	int fd = open(path, O_RDONLY);
+	if (fd<0) return;
+	posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+	close(fd);
+}
+static long getStatusKB(char* key) { // from /proc/self/status, -1 if missing
+	FILE* file = fopen("/proc/self/status", "r");
+	if (!file) return -1;
+	char line[256];
+	long kb = -1;
+	size_t len = strlen(key);
+	while (fgets(line, sizeof(line), file)) {
+		if (!strncmp(line, key, len) && line[len]==':') {
+			kb = strtol(line+len+1, NULL, 10);
+			break;
+		}
+	}
+	fclose(file);
+	return kb;
+}
+
+typedef struct RomRun {
+	double load_ms; // until the core could be handed the data
+	double pass_ms; // the core's first full pass over it, eg. a checksum
+	long peak_kb;
+	long anon_kb; // private copies
+	long file_kb; // pages shared with the page cache
+	uint64_t sum;
+} RomRun;
+
+static void loadRom(char* path, int mapped, RomRun* result) {
+	void* data = NULL;
+	size_t size = 0;
+	uint64_t then = getNanoseconds();
+	if (mapped ? ROM_map(path, &data, &size) : ROM_read(path, &data, &size)) return;
+	result->load_ms = (getNanoseconds() - then) / 1000000.0;
+	
+	then = getNanoseconds();
+	uint64_t sum = 0;
+	for (size_t i=0; i+8<=size; i+=8) sum += *(uint64_t*)((uint8_t*)data + i);
+	result->pass_ms = (getNanoseconds() - then) / 1000000.0;
+	result->sum = sum;
+	
+	result->peak_kb = getStatusKB("VmHWM");
+	result->anon_kb = getStatusKB("RssAnon");
+	result->file_kb = getStatusKB("RssFile");
+	if (mapped) munmap(data, size);
+	else free(data);
+}
+static void benchRom(void) {
+	printHeader("method,size,load_ms,first_pass_ms,total_ms,peak_rss_kb,rss_anon_kb,rss_file_kb");
+	int rom_count = sizeof(roms) / sizeof(roms[0]);
+	for (int r=0; r<rom_count; r++) {
+		char* path = NULL;
+		for (int mapped=1; mapped>=0; mapped--) {
+			char* method = mapped ? "ROM_map" : "ROM_read";
+			if (bench.filter && !strstr(method, bench.filter) && !strstr(roms[r].name, bench.filter)) continue;
+			if (!path && !(path=makeFile("bench.rom", (size_t)roms[r].w * 1024 * 1024))) break;
+			dropCache(path);
+			
+			// each load in its own process so peak rss is just that load
+			int fds[2];
+			if (pipe(fds)) break;
+			RomRun result = {-1};
+			pid_t pid = fork();
+			if (pid==0) {
+				close(fds[0]);
+				loadRom(path, mapped, &result);
+				_exit(write(fds[1], &result, sizeof(result))==sizeof(result) ? 0 : 1);
+			}
+			close(fds[1]);
+			if (pid<0 || read(fds[0], &result, sizeof(result))!=sizeof(result) || result.load_ms<0) {
+				fprintf(stderr, "bench: couldn't load %s with %s\n", path, method);
+			}
+			else printRow("%s,%s,%.2f,%.2f,%.2f,%li,%li,%li", method, roms[r].name, result.load_ms, result.pass_ms, result.load_ms+result.pass_ms, result.peak_kb, result.anon_kb, result.file_kb);
+			close(fds[0]);
+			if (pid>0) waitpid(pid, NULL, 0);
+		}
+		if (path) {
+			unlink(path);
+			free(path);
+		}
+	}
+	printFooter();
+}
+
+///////////////////////////////
+
+// a zip of one deflated member, rom-like data that deflates to about
+// 70%. NULL on failure, caller frees the path
+static void fillRom(uint8_t* data, size_t size, uint32_t seed) {
+	uint32_t noise = seed;
+	for (size_t i=0; i<size; i++) {
+		if (!(i & 255)) seed = seed * 1664525 + 1013904223;
+		noise = noise * 1664525 + 1013904223;
+		switch (seed >> 30) { // a mix of code/graphics (noise), padding and tables
+			case 0:
+			case 1: data[i] = noise >> 24; break;
+			case 2: data[i] = 0xFF; break;
+			default: data[i] = (noise >> 24) & 0x0F; break;
+		}
+	}
+}
+static void putLE16(uint8_t* out, uint16_t value) {
+	out[0] = value;
+	out[1] = value >> 8;
+}
+static void putLE32(uint8_t* out, uint32_t value) {
+	putLE16(out, value);
+	putLE16(out+2, value >> 16);
+}
+static char* makeZip(char* name, char* member, size_t size) {
+	char* path = malloc(strlen(bench.dir) + strlen(name) + 2);
+	uint8_t* in = allocPixels(CHUNK_SIZE);
+	uint8_t* out = allocPixels(CHUNK_SIZE);
+	FILE* file = NULL;
+	int ok = path && in && out;
+	if (ok) {
+		sprintf(path, "%s/%s", bench.dir, name);
+		ok = (file=fopen(path, "wb"))!=NULL;
+	}
+	
+	size_t name_len = strlen(member);
+	uint8_t header[46];
+	memset(header, 0, sizeof(header));
+	if (ok) ok = fwrite(header, 1, 30, file)==30 && fwrite(member, 1, name_len, file)==name_len; // filled in below
+	
+	z_stream stream;
+	memset(&stream, 0, sizeof(stream));
+	if (ok) ok = deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY)==Z_OK;
+	uint32_t crc = crc32(0, NULL, 0);
+	for (size_t done=0; ok && done<size; ) {
+		size_t count = size-done<CHUNK_SIZE ? size-done : CHUNK_SIZE;
+		fillRom(in, count, done / CHUNK_SIZE);
+		crc = crc32(crc, in, count);
+		done += count;
+		stream.next_in = in;
+		stream.avail_in = count;
+		int flush = done==size ? Z_FINISH : Z_NO_FLUSH;
+		do {
+			stream.next_out = out;
+			stream.avail_out = CHUNK_SIZE;
+			if (deflate(&stream, flush)==Z_STREAM_ERROR) ok = 0;
+			size_t have = CHUNK_SIZE - stream.avail_out;
+			if (ok && fwrite(out, 1, have, file)!=have) ok = 0;
+		} while (ok && stream.avail_out==0);
+	}
+	uint32_t compressed = stream.total_out;
+	deflateEnd(&stream);
+	
+	// local header, then the central directory and its end record
+	uint32_t central = 30 + name_len + compressed;
+	putLE32(header+0, 0x04034b50);
+	putLE16(header+4, 20); // version needed
+	putLE16(header+8, 8); // deflate
+	putLE32(header+14, crc);
+	putLE32(header+18, compressed);
+	putLE32(header+22, size);
+	putLE16(header+26, name_len);
+	if (ok) ok = !fseek(file, 0, SEEK_SET) && fwrite(header, 1, 30, file)==30 && !fseek(file, central, SEEK_SET);
+	memmove(header+6, header+4, 24); // same fields, two bytes later
+	putLE32(header+0, 0x02014b50);
+	putLE16(header+4, 20); // version made by
+	memset(header+30, 0, 16); // no extra, comment, disk or attributes, local header at 0
+	if (ok) ok = fwrite(header, 1, 46, file)==46 && fwrite(member, 1, name_len, file)==name_len;
+	uint8_t end[22];
+	memset(end, 0, sizeof(end));
+	putLE32(end+0, 0x06054b50);
+	putLE16(end+8, 1);
+	putLE16(end+10, 1);
+	putLE32(end+12, 46 + name_len);
+	putLE32(end+16, central);
+	if (ok) ok = fwrite(end, 1, 22, file)==22;
+	
+	if (file) {
+		ok = !fflush(file) && !fsync(fileno(file)) && ok;
+		fclose(file);
+	}
+	free(in);
+	free(out);
+	if (!ok) {
+		if (path) {
+			fprintf(stderr, "bench: couldn't write %s\n", path);
+			unlink(path);
+		}
+		free(path);
+		return NULL;
+	}
+	return path;
+}
+
+// unzipping a rom for a core that takes data, straight into memory
+// against the old round trip through a file in /tmp. returns ms, -1 on failure
+static double unzipRom(char* path, int to_memory) {
+	uint64_t then = getNanoseconds();
+	ZIP_Archive* zip = ZIP_open(path);
+	ZIP_Member* member = zip ? ZIP_findExtension(zip, "gba") : NULL;
+	void* data = NULL;
+	size_t size = 0;
+	int failed = !member;
+	if (!failed && to_memory) {
+		data = malloc(member->size);
+		failed = !data || ZIP_extractToMemory(zip, member, data);
+	}
+	else if (!failed) {
+		char tmp_template[] = "/tmp/bench-XXXXXX";
+		char* tmp_dirname = mkdtemp(tmp_template);
+		char tmp_path[64];
+		FILE* dst = NULL;
+		failed = !tmp_dirname;
+		if (!failed) {
+			sprintf(tmp_path, "%s/bench.gba", tmp_dirname);
+			failed = (dst=fopen(tmp_path, "w"))==NULL;
+		}
+		if (!failed) {
+			failed = ZIP_extractToFile(zip, member, dst);
+			failed = fclose(dst) || failed;
+			failed = failed || ROM_read(tmp_path, &data, &size);
+		}
+		if (tmp_dirname) {
+			unlink(tmp_path);
+			rmdir(tmp_dirname);
+		}
+	}
+	if (zip) ZIP_close(zip);
+	double ms = (getNanoseconds() - then) / 1000000.0;
+	free(data);
+	return failed ? -1 : ms;
+}
+#define ZIP_RUNS 3 // best of
+static void benchZip(void) {
+	printHeader("method,size,compressed_kb,launch_ms,mb_per_s");
+	int rom_count = sizeof(roms) / sizeof(roms[0]);
+	for (int r=0; r<rom_count; r++) {
+		char* path = NULL;
+		size_t size = (size_t)roms[r].w * 1024 * 1024;
+		for (int to_memory=1; to_memory>=0; to_memory--) {
+			char* method = to_memory ? "ZIP_extractToMemory" : "ZIP_extractToFile+ROM_read";
+			if (bench.filter && !strstr(method, bench.filter) && !strstr(roms[r].name, bench.filter)) continue;
+			if (!path && !(path=makeZip("bench.zip", "bench.gba", size))) break;
+			
+			double best = -1;
+			for (int i=0; i<ZIP_RUNS; i++) {
+				dropCache(path);
+				double ms = unzipRom(path, to_memory);
+				if (ms<0) {
+					fprintf(stderr, "bench: couldn't unzip %s with %s\n", path, method);
+					best = -1;
+					break;
+				}
+				if (best<0 || ms<best) best = ms;
+			}
+			struct stat st;
+			if (best>=0 && !stat(path, &st)) printRow("%s,%s,%lli,%.2f,%.1f", method, roms[r].name, (long long)st.st_size / 1024, best, size / best / 1000.0);
+		}
+		if (path) {
+			unlink(path);
+			free(path);
+		}
+	}
+	printFooter();
+}
+
+// extraction on its own, inflating on the calling thread against
+// the reader/inflater/writer pipeline, returns ms, -1 on failure
+static double extractRom(char* path, int to_memory) {
+	ZIP_Archive* zip = ZIP_open(path);
+	ZIP_Member* member = zip ? ZIP_findExtension(zip, "gba") : NULL;
+	void* data = member && to_memory ? malloc(member->size) : NULL;
+	char dst_path[MAX_PATH];
+	snprintf(dst_path, sizeof(dst_path), "%s/bench.gba", bench.dir);
+	FILE* dst = member && !to_memory ? fopen(dst_path, "w") : NULL;
+	
+	double ms = -1;
+	if (data || dst) {
+		uint64_t then = getNanoseconds();
+		int failed = to_memory ? ZIP_extractToMemory(zip, member, data) : ZIP_extractToFile(zip, member, dst);
+		if (dst) failed = fflush(dst) || fsync(fileno(dst)) || failed;
+		if (!failed) ms = (getNanoseconds() - then) / 1000000.0;
+	}
+	if (dst) {
+		fclose(dst);
+		unlink(dst_path);
+	}
+	free(data);
+	if (zip) ZIP_close(zip);
+	return ms;
+}
+static void benchInflate(void) {
+	printHeader("method,threads,size,compressed_kb,ms,mb_per_s");
+	int rom_count = sizeof(roms) / sizeof(roms[0]);
+	for (int r=0; r<rom_count; r++) {
+		char* path = NULL;
+		size_t size = (size_t)roms[r].w * 1024 * 1024;
+		for (int to_memory=1; to_memory>=0; to_memory--) {
+			char* method = to_memory ? "ZIP_extractToMemory" : "ZIP_extractToFile";
+			if (bench.filter && !strstr(method, bench.filter) && !strstr(roms[r].name, bench.filter)) continue;
+			if (!path && !(path=makeZip("bench.zip", "bench.gba", size))) break;
+			
+			for (int pipelined=0; pipelined<2; pipelined++) {
+				ZIP_setPipelineMin(pipelined ? 1 : UINT64_MAX);
+				double best = -1;
+				for (int i=0; i<ZIP_RUNS; i++) {
+					dropCache(path);
+					double ms = extractRom(path, to_memory);
+					if (ms<0) {
+						fprintf(stderr, "bench: couldn't extract %s with %s\n", path, method);
+						best = -1;
+						break;
+					}
+					if (best<0 || ms<best) best = ms;
+				}
+				struct stat st;
+				if (best>=0 && !stat(path, &st)) printRow("%s,%i,%s,%lli,%.2f,%.1f", method, pipelined ? 3 : 1, roms[r].name, (long long)st.st_size / 1024, best, size / best / 1000.0);
+			}
+		}
+		if (path) {
+			unlink(path);
+			free(path);
+		}
+	}
+	ZIP_setPipelineMin(0);
+	printFooter();
+}
+
+///////////////////////////////
+
+// a 60fps frame loop (scaling a ps1 frame and sleeping to the next
+// deadline) saving a state every second, writing it on the frame
+// thread like State_write used to against handing it to the writer.
+// a frame is the work plus the save call, the sleep doesn't count
+#define SAVE_FPS 60
+#define SAVE_FRAMES (SAVE_FPS * 6)
+#define SAVE_STATE_SIZE (4 * 1024 * 1024) // a ps1 state
+static double save_buckets[] = {1,2,4,8,1000.0/SAVE_FPS}; // ms, anything over the last is over budget
+#define SAVE_BUCKETS (sizeof(save_buckets) / sizeof(save_buckets[0]))
+
+static int compareDoubles(const void* a, const void* b) {
+	double x = *(double*)a;
+	double y = *(double*)b;
+	return x<y ? -1 : x>y;
+}
+static void benchSave(void) {
+	printHeader("method,state_kb,frames,saves,p50_ms,p99_ms,max_ms,lt_1ms,lt_2ms,lt_4ms,lt_8ms,lt_budget,over_budget");
+	
+	struct Source* source = &sources[3]; // ps1
+	int src_p = source->w * 2;
+	int dst_p = source->w * 2 * 2;
+	void* src = allocPixels(src_p * source->h);
+	void* dst = allocPixels(dst_p * source->h * 2);
+	uint8_t* state = allocPixels(SAVE_STATE_SIZE);
+	double* times = malloc(SAVE_FRAMES * sizeof(double));
+	char path[MAX_PATH];
+	snprintf(path, sizeof(path), "%s/bench.st0", bench.dir);
+	if (!src || !dst || !state || !times) {
+		fprintf(stderr, "bench: out of memory for save\n");
+		goto error;
+	}
+	fillPixels(src, src_p * source->h);
+	fillPixels(state, SAVE_STATE_SIZE);
+	
+	for (int threaded=0; threaded<2; threaded++) {
+		char* method = threaded ? "Writer_submit" : "Writer_putFile";
+		if (bench.filter && !strstr(method, bench.filter)) continue;
+		
+		int saves = 0;
+		int failed = 0;
+		struct timespec deadline;
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+		for (int frame=0; frame<SAVE_FRAMES; frame++) {
+			uint64_t then = getNanoseconds();
+			scaler_c16(2, 2, src, dst, source->w, source->h, src_p, source->w*2, source->h*2, dst_p);
+			if (frame % SAVE_FPS==SAVE_FPS/2) {
+				state[frame % SAVE_STATE_SIZE] += 1; // as if the core had moved on
+				if (threaded) {
+					WriterJob* job = Writer_acquire(SAVE_STATE_SIZE);
+					if (job) memcpy(job->data, state, SAVE_STATE_SIZE); // what core.serialize() costs at least
+					if (job) Writer_submit(job, path);
+					failed = failed || !job;
+				}
+				else failed = failed || Writer_putFile(path, state, SAVE_STATE_SIZE);
+				saves += 1;
+			}
+			times[frame] = (getNanoseconds() - then) / 1000000.0;
+			
+			deadline.tv_nsec += 1000000000 / SAVE_FPS;
+			if (deadline.tv_nsec>=1000000000) {
+				deadline.tv_sec += 1;
+				deadline.tv_nsec -= 1000000000;
+			}
+			clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL);
+		}
+		Writer_flush();
+		if (failed) {
+			fprintf(stderr, "bench: couldn't write %s\n", path);
+			continue;
+		}
+		
+		int counts[SAVE_BUCKETS+1] = {0};
+		for (int frame=0; frame<SAVE_FRAMES; frame++) {
+			int b = 0;
+			while (b<SAVE_BUCKETS && times[frame]>=save_buckets[b]) b++;
+			counts[b] += 1;
+		}
+		qsort(times, SAVE_FRAMES, sizeof(double), compareDoubles);
+		printRow("%s,%i,%i,%i,%.2f,%.2f,%.2f,%i,%i,%i,%i,%i,%i", method, SAVE_STATE_SIZE / 1024, SAVE_FRAMES, saves,
+			times[SAVE_FRAMES/2], times[SAVE_FRAMES*99/100], times[SAVE_FRAMES-1],
+			counts[0], counts[1], counts[2], counts[3], counts[4], counts[5]);
+	}
+	unlink(path);
+	Writer_quit();
+error:
+	free(src);
+	free(dst);
+	free(state);
+	free(times);
+	printFooter();
+}
+
+///////////////////////////////
+
+// saving and loading a state raw against the compressed container,
+// write is serialize to synced file (encoding included) and read is
+// cold file to unserialize-ready buffer (decoding included). states
+// are mostly runs and small values with some noise, like ram is
+static void fillState(uint8_t* data, size_t size, uint32_t seed) {
+	uint32_t noise = seed;
+	for (size_t i=0; i<size; i++) {
+		if (!(i & 63)) seed = seed * 1664525 + 1013904223;
+		noise = noise * 1664525 + 1013904223;
+		switch (seed >> 30) {
+			case 0: data[i] = noise >> 24; break;
+			case 1: data[i] = (noise >> 24) & 0x07; break;
+			default: data[i] = 0; break;
+		}
+	}
+}
+static double writeState(char* path, uint8_t* state, size_t size, uint8_t* encoded, size_t* file_size) { // returns ms, -1 on failure
+	uint64_t then = getNanoseconds();
+	void* data = state;
+	*file_size = size;
+	if (encoded) {
+		data = encoded;
+		*file_size = STATE_encode(state, size, "bench", encoded);
+		if (!*file_size) return -1;
+	}
+	if (Writer_putFile(path, data, *file_size)) return -1;
+	return (getNanoseconds() - then) / 1000000.0;
+}
+static double readState(char* path, uint8_t* state, size_t size, uint8_t* encoded) { // returns ms, -1 on failure
+	dropCache(path);
+	uint64_t then = getNanoseconds();
+	FILE* file = fopen(path, "r");
+	if (!file) return -1;
+	int failed;
+	if (encoded) {
+		StateHeader header;
+		size_t count = fread(encoded, 1, STATE_encodeBound(size), file);
+		failed = STATE_readHeader(encoded, count, &header) || header.size!=size || STATE_decode(&header, encoded + sizeof(StateHeader), state);
+	}
+	else failed = fread(state, 1, size, file)!=size;
+	fclose(file);
+	return failed ? -1 : (getNanoseconds() - then) / 1000000.0;
+}
+static void benchState(void) {
+	printHeader("method,source,state_kb,file_kb,ratio,write_ms,read_ms");
+	char path[MAX_PATH];
+	snprintf(path, sizeof(path), "%s/bench.st0", bench.dir);
+	int state_count = sizeof(states) / sizeof(states[0]);
+	for (int s=0; s<state_count; s++) {
+		size_t size = states[s].w;
+		uint8_t* state = allocPixels(size);
+		uint8_t* encoded = allocPixels(STATE_encodeBound(size));
+		if (!state || !encoded) {
+			fprintf(stderr, "bench: out of memory for %s state\n", states[s].name);
+			free(state);
+			free(encoded);
+			continue;
+		}
+		for (int compressed=0; compressed<2; compressed++) {
+			char* method = compressed ? "STATE_encode" : "raw";
+			if (bench.filter && !strstr(method, bench.filter) && !strstr(states[s].name, bench.filter)) continue;
+			
+			double write_ms = -1;
+			double read_ms = -1;
+			size_t file_size = 0;
+			for (int i=0; i<ZIP_RUNS; i++) {
+				fillState(state, size, 1234);
+				double ms = writeState(path, state, size, compressed ? encoded : NULL, &file_size);
+				if (ms>=0 && (write_ms<0 || ms<write_ms)) write_ms = ms;
+				ms = ms<0 ? -1 : readState(path, state, size, compressed ? encoded : NULL);
+				if (ms>=0 && (read_ms<0 || ms<read_ms)) read_ms = ms;
+				if (ms<0) break;
+			}
+			if (write_ms<0 || read_ms<0) fprintf(stderr, "bench: couldn't save and load %s\n", path);
+			else printRow("%s,%s,%zu,%zu,%.3f,%.2f,%.2f", method, states[s].name, size / 1024, file_size / 1024, (double)file_size / size, write_ms, read_ms);
+		}
+		free(state);
+		free(encoded);
+	}
+	unlink(path);
+	printFooter();
+}
+
+///////////////////////////////
+
+// each resampler converting a core's batches of audio to the device
+// rate, with the step off by a little as rate control keeps it. the
+// input is noise so nothing gets to be cheap. x_realtime is how many
+// times faster than playback it runs, the inverse of its share of a cpu
+#define RESAMPLE_BATCH 1024 // frames in per call, a couple of video frames' worth
+static struct Rates {
+	char* name;
+	int in;
+	int out;
+} rates[] = {
+	{"snes",   32040, 48000},
+	{"gba",    32768, 48000},
+	{"ps1",    44100, 48000},
+	{"unity",  48000, 48000},
+};
+static char* quality_names[RESAMPLE_COUNT] = {"linear","cubic","sinc"};
+static void benchResample(void) {
+	printHeader("resampler,source,rate_in,rate_out,used,frames,ns_per_frame,mframes_per_s,x_realtime");
+	static AudioResampler resampler; // too big for the stack
+	SND_Frame in[RESAMPLE_BATCH];
+	SND_Frame out[RESAMPLE_BATCH * 2];
+	fillPixels(in, sizeof(in));
+	int rate_count = sizeof(rates) / sizeof(rates[0]);
+	for (int r=0; r<rate_count; r++) {
+		for (int q=0; q<RESAMPLE_COUNT; q++) {
+			if (bench.filter && !strstr(quality_names[q], bench.filter) && !strstr(rates[r].name, bench.filter)) continue;
+			AudioResampler_init(&resampler, q, rates[r].in, rates[r].out);
+			resampler.step *= 1.001;
+			
+			uint64_t frames = 0;
+			uint64_t start = getNanoseconds();
+			uint64_t elapsed;
+			do {
+				for (int i=0; i<16; i++) {
+					int consumed;
+					int taken = 0;
+					while (taken<RESAMPLE_BATCH) {
+						frames += AudioResampler_run(&resampler, in+taken, RESAMPLE_BATCH-taken, out, RESAMPLE_BATCH * 2, &consumed);
+						taken += consumed;
+					}
+				}
+				elapsed = getNanoseconds() - start;
+			} while (elapsed<bench.min_ms*1000000ULL);
+			
+			double ns = (double)elapsed / frames;
+			printRow("%s,%s,%i,%i,%s,%llu,%.1f,%.2f,%.0f", quality_names[q], rates[r].name, rates[r].in, rates[r].out, quality_names[resampler.quality], (unsigned long long)frames, ns, 1000.0 / ns, 1e9 / ns / rates[r].out);
+		}
+	}
+	printFooter();
+}
+
+///////////////////////////////
+
+// fast forward with a stand-in core that spins for core_us per frame
+// and makes a snes frame's worth of audio, while the device drains
+// the ring in real time. ff_x is the speed reached, so the off rows
+// are what the core alone allows and the others what each ff audio
+// mode costs on top. ff_speed is where the stream's estimate of that
+// speed ended up (capped at AUDIO_FF_MAX_SPEED)
+#define FF_SECONDS 3 // long enough for ff_speed to settle
+#define FF_RATE_IN 32040
+#define FF_RATE_OUT 48000
+#define FF_CORE_FPS 60.0988
+#define FF_RING 6144 // frames, SND_DEFAULT_LATENCY
+static int ff_core_us[] = {1000,2000,4000};
+static char* ff_mode_names[FF_AUDIO_COUNT] = {"off","decimate","tempo"};
+static void benchFastForward(void) {
+	printHeader("mode,core_us,frames,audio_us_per_frame,ff_x,ff_speed");
+	static AudioStream stream; // too big for the stack
+	AudioRing_init(&stream.ring);
+	free(AudioRing_swap(&stream.ring, calloc(FF_RING, sizeof(SND_Frame)), FF_RING));
+	stream.frame_target = FF_RING / 2;
+	
+	SND_Frame in[FF_RATE_IN / 60 + 1];
+	SND_Frame drained[1024];
+	fillPixels(in, sizeof(in));
+	int core_count = sizeof(ff_core_us) / sizeof(ff_core_us[0]);
+	for (int c=0; c<core_count; c++) {
+		for (int mode=0; mode<FF_AUDIO_COUNT; mode++) {
+			if (bench.filter && !strstr(ff_mode_names[mode], bench.filter)) continue;
+			AudioResampler_init(&stream.resampler, RESAMPLE_SINC, FF_RATE_IN, FF_RATE_OUT);
+			stream.rate.skew = 0;
+			stream.fast_forward = 0;
+			stream.ff_speed = 2.0; // as SND_init()
+			while (AudioRing_read(&stream.ring, drained, 1024));
+			AudioRing_hadUnderrun(&stream.ring);
+			
+			double in_frames = 0;
+			uint64_t frames = 0;
+			uint64_t audio_ns = 0;
+			uint64_t device_frames = 0;
+			uint64_t start = getNanoseconds();
+			uint64_t now = start;
+			uint64_t min_ns = bench.min_ms*1000000ULL;
+			if (min_ns<FF_SECONDS*1000000000ULL) min_ns = FF_SECONDS*1000000000ULL;
+			while (now-start<min_ns) {
+				uint64_t until = getNanoseconds() + ff_core_us[c] * 1000ULL;
+				while (getNanoseconds()<until); // the core
+				
+				in_frames += FF_RATE_IN / FF_CORE_FPS;
+				int count = in_frames;
+				in_frames -= count;
+				uint64_t then = getNanoseconds();
+				AudioStream_writeFast(&stream, in, count, mode);
+				now = getNanoseconds();
+				audio_ns += now - then;
+				frames += 1;
+				
+				// the device
+				uint64_t due = (now - start) * FF_RATE_OUT / 1000000000ULL;
+				while (device_frames<due) {
+					int want = due-device_frames>1024 ? 1024 : due-device_frames;
+					AudioRing_read(&stream.ring, drained, want);
+					device_frames += want;
+				}
+			}
+			double seconds = (now - start) / 1e9;
+			char speed_text[32] = ""; // the stream isn't used when off
+			if (mode!=FF_AUDIO_OFF) sprintf(speed_text, "%.2f", stream.ff_speed);
+			printRow("%s,%i,%llu,%.1f,%.2f,%s", ff_mode_names[mode], ff_core_us[c], (unsigned long long)frames, audio_ns / 1000.0 / frames, frames / seconds / FF_CORE_FPS, speed_text);
+		}
+	}
+	AudioRing_quit(&stream.ring);
+	printFooter();
+}
+
+///////////////////////////////
+
+// what run ahead adds to a frame on top of the frames it runs, the
+// number minarch's hud shows less those frames. the stand-in core's
+// serialize and unserialize are a memcpy of a typical state and its
+// run() only dirties it, so a real core adds frames_ahead of its own
+// frame time to us_per_frame
+static struct {
+	uint8_t* core; // the instances' state
+	uint8_t* second;
+	size_t size;
+} ahead;
+
+static void aheadRun(void) { ahead.core[getNanoseconds() % ahead.size] += 1; }
+static void aheadRunSecond(void) { ahead.second[getNanoseconds() % ahead.size] += 1; }
+static size_t aheadSize(void) { return ahead.size; }
+static bool aheadSerialize(void* data, size_t size) {
+	memcpy(data, ahead.core, size);
+	return true;
+}
+static bool aheadUnserialize(const void* data, size_t size) {
+	memcpy(ahead.core, data, size);
+	return true;
+}
+static bool aheadUnserializeSecond(const void* data, size_t size) {
+	memcpy(ahead.second, data, size);
+	return true;
+}
+static void aheadSkip(int video, int audio, int poll) {}
+
+static void benchRunAhead(void) {
+	printHeader("instances,state,state_kb,frames_ahead,frames,us_per_frame");
+	static const RunAheadCore primary = {aheadRun, aheadSize, aheadSerialize, aheadUnserialize};
+	static const RunAheadCore secondary = {aheadRunSecond, aheadSize, aheadSerialize, aheadUnserializeSecond};
+	int state_count = sizeof(states) / sizeof(states[0]);
+	for (int s=0; s<state_count; s++) {
+		if (bench.filter && !strstr(states[s].name, bench.filter)) continue;
+		ahead.size = states[s].w;
+		ahead.core = allocPixels(ahead.size);
+		ahead.second = allocPixels(ahead.size);
+		if (!ahead.core || !ahead.second) {
+			fprintf(stderr, "bench: out of memory for runahead\n");
+			free(ahead.core);
+			free(ahead.second);
+			break;
+		}
+		fillState(ahead.core, ahead.size, s);
+		for (int instances=1; instances<=2; instances++) {
+			for (int frames=1; frames<=3; frames++) {
+				RunAhead state = {.skip=aheadSkip};
+				uint64_t count = 0;
+				uint64_t start = getNanoseconds();
+				uint64_t elapsed = 0;
+				while (elapsed<bench.min_ms*1000000ULL) {
+					RunAhead_step(&state, &primary, instances==2 ? &secondary : NULL, frames, 0);
+					count += 1;
+					elapsed = getNanoseconds() - start;
+				}
+				RunAhead_free(&state);
+				printRow("%i,%s,%i,%i,%llu,%.1f", instances, states[s].name, states[s].w / 1024, frames, (unsigned long long)count, elapsed / 1000.0 / count);
+			}
+		}
+		free(ahead.core);
+		free(ahead.second);
+	}
+	printFooter();
+}
+
+///////////////////////////////
+
+// the frame pacer's sleep, an absolute deadline on CLOCK_MONOTONIC
+// one frame after the last as in Pacer_wait(), without the audio
+// nudge. late is how long after its deadline each wake up came,
+// which is jitter the display or audio has to absorb
+#define PACE_SECONDS 3
+static struct {
+	char* name;
+	double hz;
+} pace_rates[] = {
+	{"pal", 50.0},
+	{"gb", 59.7275},
+	{"ntsc", 60.0},
+	{"snes", 60.0988},
+	{"75hz", 75.0},
+};
+
+static void benchPace(void) {
+	printHeader("rate,hz,frames,p50_late_us,p99_late_us,max_late_us,over_1ms");
+	int rate_count = sizeof(pace_rates) / sizeof(pace_rates[0]);
+	for (int r=0; r<rate_count; r++) {
+		if (bench.filter && !strstr(pace_rates[r].name, bench.filter)) continue;
+		
+		uint64_t min_ns = bench.min_ms*1000000ULL;
+		if (min_ns<PACE_SECONDS*1000000000ULL) min_ns = PACE_SECONDS*1000000000ULL;
+		int frames = min_ns * pace_rates[r].hz / 1e9;
+		double* late = malloc(frames * sizeof(double));
+		if (!late) {
+			fprintf(stderr, "bench: out of memory for pace\n");
+			break;
+		}
+		
+		double frame_time = 1e9 / pace_rates[r].hz;
+		uint64_t deadline = getNanoseconds();
+		int over = 0;
+		for (int frame=0; frame<frames; frame++) {
+			deadline += frame_time;
+			struct timespec until = {
+				.tv_sec = deadline / 1000000000,
+				.tv_nsec = deadline % 1000000000,
+			};
+			while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL)==EINTR);
+			late[frame] = (double)(int64_t)(getNanoseconds() - deadline) / 1000.0;
+			over += late[frame]>=1000;
+		}
+		qsort(late, frames, sizeof(double), compareDoubles);
+		printRow("%s,%.4f,%i,%.1f,%.1f,%.1f,%i", pace_rates[r].name, pace_rates[r].hz, frames,
+			late[frames/2], late[frames*99/100], late[frames-1], over);
+		free(late);
+	}
+	printFooter();
+}
+
+///////////////////////////////
+
+static struct Group {
+	char* name;
+	void (*bench)(void);
+} groups[] = {
+	{"scale", benchScale},
+	{"rom", benchRom},
+	{"zip", benchZip},
+	{"inflate", benchInflate},
+	{"save", benchSave},
+	{"state", benchState},
+	{"resample", benchResample},
+	{"ff", benchFastForward},
+	{"runahead", benchRunAhead},
+	{"pace", benchPace},
+};
+
+int main(int argc, char* argv[]) {
+	bench.min_ms = 200;
+	bench.screen_w = SCREEN_WIDTH;
+	bench.screen_h = SCREEN_HEIGHT;
+	bench.dir = ".";
+	char* group = "scale";
+	for (int i=1; i<argc; i++) {
+		if (!strcmp(argv[i], "-j")) bench.json = 1;
+		else if (!strcmp(argv[i], "-t") && i+1<argc) bench.min_ms = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-s") && i+1<argc) {
+			if (sscanf(argv[++i], "%ix%i", &bench.screen_w, &bench.screen_h)!=2 || bench.screen_w<=0 || bench.screen_h<=0) {
+				fprintf(stderr, "bench: bad screen size %s\n", argv[i]);
+				return 1;
+			}
+		}
+		else if (!strcmp(argv[i], "-d") && i+1<argc) bench.dir = argv[++i];
+		else if (!strcmp(argv[i], "-g") && i+1<argc) group = argv[++i];
+		else bench.filter = argv[i];
+	}
+	Perf_init();
+	if (bench.perf_fd<0) fprintf(stderr, "bench: perf_event_open unavailable, no cache miss counts\n");
+
+	int group_count = sizeof(groups) / sizeof(groups[0]);
+	int g = 0;
+	while (g<group_count && strcmp(groups[g].name, group)) g++;
+	if (g==group_count) {
+		fprintf(stderr, "bench: unknown group %s\n", group);
+		return 1;
+	}
+	groups[g].bench();
+
+	if (bench.perf_fd>=0) close(bench.perf_fd);
+	return 0;
+}
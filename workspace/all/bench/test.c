@@ -0,0 +1,971 @@
+// scaler backend tests, every backend this build has against the C
+// scalers on random sizes, pitches and alignments. the whole dst buffer
+// is compared byte for byte, pitch padding and a guard band included,
+// so a backend that writes outside its rows fails too. convert_32to16
+// gets the same against convert_c32to16 plus every XRGB8888 color once,
+// the rewind deltas have to round trip within DELTA_MAX_SIZE, save
+// state containers have to round trip and refuse damage, the video
+// mailbox can't tear, reorder or lose its last frame under load, the
+// audio ring can't lose or reorder frames between two threads, the
+// resamplers have to keep a sine clean, rate control has to settle
+// against a device clock that's off, fast forward's wsola has to
+// keep a sine's pitch and run ahead has to leave the core where it
+// found it
+//
+// usage: test.elf [-n runs] [-s seed]
+//	-n	random cases per backend, default 2000
+//	-s	seed, default time based. failures print it so they can be rerun
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <math.h>
+#include <zlib.h>
+
+#include "pixel.h"
+#include "scaler.h"
+#include "delta.h"
+#include "mailbox.h"
+#include "state.h"
+#include "audio.h"
+#include "runahead.h"
+
+///////////////////////////////
+
+typedef void (*dispatch_t)(uint32_t xmul, uint32_t ymul, void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp);
+
+#define MAX_W 700 // wide enough for a couple of 256 pixel chunks in c32to16
+#define MAX_H 24
+#define MAX_PAD 9 // pixels of pitch padding
+#define GUARD 64 // bytes past the end of dst
+#define SRC_SIZE ((MAX_W + MAX_PAD + 1) * MAX_H * 4)
+#define DST_SIZE ((MAX_W * 6 + MAX_PAD) * MAX_H * 6 * 4 + GUARD)
+
+static struct Test_Context {
+	int runs;
+	uint32_t seed;
+	uint32_t first_seed; // what -s needs to rerun this
+	int failed;
+	uint8_t* src;
+	uint8_t* tmp; // c32to16 reference, converted src
+	uint8_t* a;
+	uint8_t* b;
+} test;
+
+static uint32_t rnd(uint32_t n) { // 0 to n-1
+	test.seed = test.seed * 1664525 + 1013904223;
+	return (test.seed >> 8) % n;
+}
+
+// what the dispatchers accept
+static const int max_ymul[7] = {0,4,4,4,4,5,6};
+
+typedef struct Case {
+	uint32_t xmul;
+	uint32_t ymul;
+	uint32_t sw;
+	uint32_t sh;
+	uint32_t sp; // 0 lets the scaler work it out
+	uint32_t dp;
+	uint32_t offset; // src pixels skipped, so rows don't always start aligned
+	size_t size; // bytes compared
+} Case;
+
+static void randomCase(Case* c, int src_bpp, int dst_bpp) {
+	c->xmul = 1 + rnd(6);
+	c->ymul = 1 + rnd(max_ymul[c->xmul]);
+	c->sw = 1 + rnd(rnd(4) ? 64 : MAX_W); // mostly narrow, where the tails are
+	c->sh = 1 + rnd(MAX_H);
+	c->offset = rnd(2);
+	int packed = !rnd(8);
+	c->sp = packed ? 0 : (c->sw + rnd(MAX_PAD)) * src_bpp;
+	c->dp = packed ? 0 : (c->sw * c->xmul + rnd(MAX_PAD)) * dst_bpp;
+	uint32_t dp = c->dp ? c->dp : c->sw * c->xmul * dst_bpp;
+	c->size = (size_t)dp * c->sh * c->ymul + GUARD;
+}
+
+static void fail(char* name, Case* c) {
+	size_t i = 0;
+	while (i<c->size && test.a[i]==test.b[i]) i++;
+	printf("FAIL %s %ix%i sw:%i sh:%i sp:%i dp:%i offset:%i first diff at byte %zu (-s %u)\n",
+		name, c->xmul, c->ymul, c->sw, c->sh, c->sp, c->dp, c->offset, i, test.first_seed);
+	test.failed += 1;
+}
+
+///////////////////////////////
+
+// a backend's dispatcher against the C one for the same bpp
+static void testBackend(char* name, dispatch_t scaler, dispatch_t reference, int bpp) {
+	int failed = test.failed;
+	for (int i=0; i<test.runs; i++) {
+		Case c;
+		randomCase(&c, bpp, bpp);
+		void* src = test.src + c.offset * bpp;
+		memset(test.a, 0xA5, c.size);
+		memset(test.b, 0xA5, c.size);
+		scaler(c.xmul, c.ymul, src, test.a, c.sw, c.sh, c.sp, c.sw*c.xmul, c.sh*c.ymul, c.dp);
+		reference(c.xmul, c.ymul, src, test.b, c.sw, c.sh, c.sp, c.sw*c.xmul, c.sh*c.ymul, c.dp);
+		if (memcmp(test.a, test.b, c.size)) fail(name, &c);
+	}
+	printf("%-8s %s\n", name, test.failed==failed ? "ok" : "FAILED");
+}
+
+// the fused scalers against convert_c32to16 then scaler_c16
+static void testConvertScaler(char* name, dispatch_t scaler) {
+	int failed = test.failed;
+	for (int i=0; i<test.runs; i++) {
+		Case c;
+		randomCase(&c, 4, 2);
+		void* src = test.src + c.offset * 4;
+		memset(test.a, 0xA5, c.size);
+		memset(test.b, 0xA5, c.size);
+		scaler(c.xmul, c.ymul, src, test.a, c.sw, c.sh, c.sp, c.sw*c.xmul, c.sh*c.ymul, c.dp);
+		convert_c32to16(src, test.tmp, c.sw, c.sh, c.sp ? c.sp : c.sw*4, c.sw*2, 0);
+		scaler_c16(c.xmul, c.ymul, test.tmp, test.b, c.sw, c.sh, c.sw*2, c.sw*c.xmul, c.sh*c.ymul, c.dp);
+		if (memcmp(test.a, test.b, c.size)) fail(name, &c);
+	}
+	printf("%-8s %s\n", name, test.failed==failed ? "ok" : "FAILED");
+}
+
+///////////////////////////////
+
+// random widths, so every vector tail length comes up, on random pitches
+// and alignments, with and without dither
+static void testConvert(void) {
+	int failed = test.failed;
+	for (int i=0; i<test.runs; i++) {
+		Case c = {1,1};
+		c.sw = 1 + rnd(rnd(4) ? 48 : MAX_W);
+		c.sh = 1 + rnd(MAX_H);
+		c.offset = rnd(4);
+		int packed = !rnd(8);
+		c.sp = packed ? 0 : (c.sw + rnd(MAX_PAD)) * 4;
+		c.dp = packed ? 0 : (c.sw + rnd(MAX_PAD)) * 2;
+		c.size = (size_t)(c.dp ? c.dp : c.sw * 2) * c.sh + GUARD;
+		int dither = rnd(2);
+		void* src = test.src + c.offset * 4;
+		uint32_t dst_offset = rnd(2) * 2; // odd pixel starts too
+		memset(test.a, 0xA5, c.size + dst_offset);
+		memset(test.b, 0xA5, c.size + dst_offset);
+		convert_32to16(src, test.a + dst_offset, c.sw, c.sh, c.sp, c.dp, dither);
+		convert_c32to16(src, test.b + dst_offset, c.sw, c.sh, c.sp, c.dp, dither);
+		c.size += dst_offset;
+		if (memcmp(test.a, test.b, c.size)) fail(dither ? "convert dither" : "convert", &c);
+	}
+	printf("%-8s %s\n", "convert", test.failed==failed ? "ok" : "FAILED");
+}
+
+// all 2^24 colors, a band that fits in src at a time with junk in the unused byte
+#define COLORS_W 1024
+#define COLORS_H 16
+static void testConvertColors(void) {
+	int failed = test.failed;
+	uint32_t* src = (uint32_t*)test.src;
+	for (int dither=0; dither<2; dither++) {
+		for (uint32_t color=0; color<(1<<24); color+=COLORS_W*COLORS_H) {
+			for (int i=0; i<COLORS_W*COLORS_H; i++) src[i] = (color + i) | (rnd(256) << 24);
+			convert_32to16(src, test.a, COLORS_W, COLORS_H, 0, 0, dither);
+			convert_c32to16(src, test.b, COLORS_W, COLORS_H, 0, 0, dither);
+			if (memcmp(test.a, test.b, COLORS_W * COLORS_H * 2)) {
+				Case c = {1,1,COLORS_W,COLORS_H};
+				c.size = COLORS_W * COLORS_H * 2;
+				fail(dither ? "colors dither" : "colors", &c);
+				break;
+			}
+		}
+	}
+	printf("%-8s %s\n", "colors", test.failed==failed ? "ok" : "FAILED");
+}
+
+///////////////////////////////
+
+// a state with some scattered changes, a few long ones, none, or all of it
+#define DELTA_MAX_STATE 65536
+static void testDelta(void) {
+	int failed = test.failed;
+	uint8_t* prev = malloc(DELTA_MAX_STATE);
+	uint8_t* next = malloc(DELTA_MAX_STATE);
+	uint8_t* out = malloc(DELTA_MAX_SIZE(DELTA_MAX_STATE) + GUARD);
+	uint8_t* state = malloc(DELTA_MAX_STATE);
+	for (int i=0; i<test.runs; i++) {
+		size_t size = 1 + rnd(rnd(4) ? 256 : DELTA_MAX_STATE);
+		for (size_t j=0; j<size; j++) prev[j] = rnd(256);
+		memcpy(next, prev, size);
+		int kind = rnd(4);
+		if (kind==3) for (size_t j=0; j<size; j++) next[j] ^= 1 + rnd(255); // worst case
+		else if (kind) {
+			int changes = 1 + rnd(kind==1 ? 64 : 4);
+			for (int c=0; c<changes; c++) {
+				size_t from = rnd(size);
+				size_t len = 1 + rnd(kind==1 ? 12 : size - from);
+				for (size_t j=from; j<size && j<from+len; j++) next[j] = rnd(256);
+			}
+		}
+		
+		memset(out, 0xA5, DELTA_MAX_SIZE(size) + GUARD);
+		size_t delta = Delta_encode(prev, next, size, out);
+		int ok = delta<=DELTA_MAX_SIZE(size);
+		for (size_t j=delta; ok && j<DELTA_MAX_SIZE(size) + GUARD; j++) ok = out[j]==0xA5;
+		
+		// both ways
+		memcpy(state, next, size);
+		Delta_apply(state, out, delta);
+		ok = ok && !memcmp(state, prev, size);
+		Delta_apply(state, out, delta);
+		ok = ok && !memcmp(state, next, size);
+		if (!ok) {
+			printf("FAIL delta size:%zu kind:%i delta:%zu (-s %u)\n", size, kind, delta, test.first_seed);
+			test.failed += 1;
+		}
+	}
+	free(prev);
+	free(next);
+	free(out);
+	free(state);
+	printf("%-8s %s\n", "delta", test.failed==failed ? "ok" : "FAILED");
+}
+
+///////////////////////////////
+
+// save state containers round trip, and a damaged header or payload
+// is refused instead of decoding into garbage
+#define STATE_MAX 65536
+static int stateDecodes(uint8_t* encoded, size_t size, uint8_t* state) { // like State_read, 0 if it decodes
+	StateHeader header;
+	if (STATE_readHeader(encoded, size, &header)) return -1;
+	if (sizeof(StateHeader) + header.compressed_size>size || header.size>STATE_MAX) return -1; // short file or bigger than the core's state
+	return STATE_decode(&header, encoded + sizeof(StateHeader), state);
+}
+static void testState(void) {
+	int failed = test.failed;
+	uint8_t* state = malloc(STATE_MAX);
+	uint8_t* decoded = malloc(STATE_MAX);
+	uint8_t* encoded = malloc(STATE_encodeBound(STATE_MAX));
+	uint8_t* damaged = malloc(STATE_encodeBound(STATE_MAX) + compressBound(STATE_MAX));
+	for (int i=0; i<test.runs; i++) {
+		size_t size = 1 + rnd(rnd(4) ? 1024 : STATE_MAX);
+		int entropy = 1 + rnd(256);
+		int runs = 1 << rnd(12); // from noise to long runs of one value
+		for (size_t j=0; j<size; j++) state[j] = rnd(runs) ? (j ? state[j-1] : 0) : rnd(entropy);
+		
+		size_t encoded_size = STATE_encode(state, size, "test", encoded);
+		StateHeader header;
+		char* why = NULL;
+		if (!encoded_size || encoded_size>STATE_encodeBound(size)) why = "encode";
+		else if (STATE_readHeader(encoded, encoded_size, &header) || header.size!=size || strcmp(header.core, "test")) why = "header";
+		else if (STATE_decode(&header, encoded + sizeof(StateHeader), decoded) || memcmp(decoded, state, size)) why = "round trip";
+		else if (STATE_readHeader(state, size, &header)!=1 && memcmp(state, STATE_MAGIC, 4)) why = "legacy";
+		else { // version 1 states are zlib
+			uLongf compressed_size = compressBound(size);
+			StateHeader* v1 = (StateHeader*)damaged;
+			memcpy(v1, encoded, sizeof(StateHeader));
+			v1->version = STATE_VERSION_ZLIB;
+			compress2(damaged + sizeof(StateHeader), &compressed_size, state, size, Z_BEST_SPEED);
+			v1->compressed_size = compressed_size;
+			if (stateDecodes(damaged, sizeof(StateHeader) + compressed_size, decoded) || memcmp(decoded, state, size)) why = "zlib";
+		}
+		
+		// every field of the header and a byte of the payload
+		for (int field=0; !why && field<6; field++) {
+			memcpy(damaged, encoded, encoded_size);
+			StateHeader* bad = (StateHeader*)damaged;
+			switch (field) {
+				case 0: bad->magic[rnd(4)] ^= 1 << rnd(8); break;
+				case 1: bad->version += 1 + rnd(255); break;
+				case 2: bad->size ^= 1u << rnd(32); break;
+				case 3: bad->compressed_size ^= 1u << rnd(32); break;
+				case 4: bad->checksum ^= 1u << rnd(32); break;
+				default: damaged[sizeof(StateHeader) + rnd(encoded_size - sizeof(StateHeader))] ^= 1 << rnd(8); break;
+			}
+			// some payload bits don't matter (padding, unused codes), those must still decode right
+			if (!stateDecodes(damaged, encoded_size, decoded) && (field<5 || memcmp(decoded, state, size))) why = "damaged";
+		}
+		if (why) {
+			printf("FAIL state %s size:%zu entropy:%i runs:%i (-s %u)\n", why, size, entropy, runs, test.first_seed);
+			test.failed += 1;
+		}
+	}
+	free(state);
+	free(decoded);
+	free(encoded);
+	free(damaged);
+	printf("%-8s %s\n", "state", test.failed==failed ? "ok" : "FAILED");
+}
+
+///////////////////////////////
+
+// a producer posting as fast as it can against a consumer that
+// sometimes stalls. each frame is its sequence number in every word
+// with a geometry derived from it, so a torn or mixed up frame shows
+#define MAILBOX_FRAMES 200000
+#define MAILBOX_MAX_W 48
+#define MAILBOX_MAX_H 12
+static uint64_t getMilliseconds(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+static void mailboxGeometry(uint32_t seq, unsigned* width, unsigned* height) {
+	*width = 1 + seq % MAILBOX_MAX_W;
+	*height = 1 + seq % MAILBOX_MAX_H;
+}
+static void* mailboxProducer(void* arg) {
+	uint32_t* pixels = malloc(MAILBOX_MAX_W * MAILBOX_MAX_H * 4);
+	for (uint32_t seq=1; seq<=MAILBOX_FRAMES; seq++) {
+		unsigned w,h;
+		mailboxGeometry(seq, &w, &h);
+		for (unsigned i=0; i<w*h; i++) pixels[i] = seq;
+		Mailbox_post(pixels, w, h, w * 4);
+	}
+	free(pixels);
+	return NULL;
+}
+static void testMailbox(void) {
+	int failed = test.failed;
+	
+	// nothing posted, a wake returns early and otherwise it times out
+	Mailbox_init(16 * 4); // smaller than most frames so the buffers grow on the producer
+	Mailbox_wake();
+	uint64_t then = getMilliseconds();
+	int woken = !Mailbox_wait() && getMilliseconds()-then<MAILBOX_TIMEOUT/2;
+	then = getMilliseconds();
+	int timed_out = !Mailbox_wait() && getMilliseconds()-then>=MAILBOX_TIMEOUT-1;
+	if (!woken || !timed_out || Mailbox_take()) {
+		printf("FAIL mailbox wake:%i timeout:%i with nothing posted\n", woken, timed_out);
+		test.failed += 1;
+	}
+	
+	pthread_t producer;
+	pthread_create(&producer, NULL, mailboxProducer, NULL);
+	uint32_t last = 0;
+	int frames = 0;
+	int bad = 0;
+	uint64_t since = getMilliseconds();
+	while (last<MAILBOX_FRAMES && !bad) {
+		MailboxFrame* frame = Mailbox_wait();
+		if (!frame) { // also woken by posts we already took
+			if (getMilliseconds()-since<MAILBOX_TIMEOUT*10) continue;
+			printf("FAIL mailbox stopped delivering after frame %u\n", last);
+			bad = 1;
+			break;
+		}
+		since = getMilliseconds();
+		uint32_t seq = *(uint32_t*)frame->pixels;
+		unsigned w,h;
+		mailboxGeometry(seq, &w, &h);
+		if (seq<=last || frame->width!=w || frame->height!=h || frame->pitch!=w*4) bad = 1;
+		for (unsigned i=0; !bad && i<w*h; i++) bad = ((uint32_t*)frame->pixels)[i]!=seq;
+		if (bad) printf("FAIL mailbox frame %u after %u is torn or out of order\n", seq, last);
+		last = seq;
+		frames += 1;
+		if (!rnd(64)) usleep(rnd(200)); // let the producer lap us
+	}
+	pthread_join(producer, NULL);
+	if (!bad && Mailbox_take()) {
+		printf("FAIL mailbox had a frame left after the last one\n");
+		bad = 1;
+	}
+	Mailbox_quit();
+	if (bad) test.failed += 1;
+	
+	printf("%-8s %s (%i of %i frames seen)\n", "mailbox", test.failed==failed ? "ok" : "FAILED", frames, MAILBOX_FRAMES);
+}
+
+///////////////////////////////
+
+// the audio ring between a producer writing uneven batches with
+// random stalls and a consumer reading a callback's worth on a fixed
+// period, like the audio thread. each frame is its sequence number so
+// a lost, repeated or reordered frame shows. the producer also resizes
+// the ring now and then while holding the lock the consumer reads
+// under, like SND_resizeBuffer() with SDL_LockAudio(). how late the
+// consumer wakes and how long a read takes are reported, not checked,
+// since they mostly measure the host's scheduler
+#define RING_FRAMES 200000
+#define RING_CALLBACK 64 // frames per read
+#define RING_PERIOD 200 // us between reads
+#define RING_MAX_READS (RING_FRAMES * 4 / RING_CALLBACK)
+static struct {
+	AudioRing ring;
+	pthread_mutex_t lock; // stands in for SDL_LockAudio()
+	uint32_t seed;
+	atomic_int done;
+	int dropped; // by resizes
+	int stalled;
+} ring;
+static uint32_t ringRnd(uint32_t n) { // the producer's own rnd()
+	ring.seed = ring.seed * 1664525 + 1013904223;
+	return (ring.seed >> 8) % n;
+}
+static uint64_t getMicroseconds(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+static void* ringProducer(void* arg) {
+	uint32_t seq = 0;
+	while (seq<RING_FRAMES && !ring.stalled) {
+		if (!ringRnd(64)) {
+			int frame_count = 256 + ringRnd(4096);
+			SND_Frame* buffer = calloc(frame_count, sizeof(SND_Frame));
+			pthread_mutex_lock(&ring.lock);
+			int queued = AudioRing_filled(&ring.ring);
+			if (queued>frame_count-1) ring.dropped += queued - (frame_count-1);
+			buffer = AudioRing_swap(&ring.ring, buffer, frame_count);
+			pthread_mutex_unlock(&ring.lock);
+			free(buffer);
+		}
+		
+		int batch = 1 + ringRnd(800);
+		while (batch>0 && seq<RING_FRAMES) {
+			if (!AudioRing_waitForSpace(&ring.ring, 100)) {
+				ring.stalled = 1;
+				break;
+			}
+			int count;
+			SND_Frame* out = AudioRing_writable(&ring.ring, &count);
+			if (count>batch) count = batch;
+			if (count>RING_FRAMES-seq) count = RING_FRAMES-seq;
+			for (int i=0; i<count; i++,seq++) out[i] = (SND_Frame){seq & 0xffff, seq >> 16};
+			AudioRing_commit(&ring.ring, count);
+			batch -= count;
+		}
+		if (!ringRnd(32)) usleep(ringRnd(2000)); // long enough to run dry
+	}
+	atomic_store(&ring.done, 1);
+	return NULL;
+}
+static int compareInts(const void* a, const void* b) {
+	return *(int*)a - *(int*)b;
+}
+static void testRing(void) {
+	int failed = test.failed;
+	
+	AudioRing_init(&ring.ring);
+	free(AudioRing_swap(&ring.ring, calloc(1024, sizeof(SND_Frame)), 1024));
+	pthread_mutex_init(&ring.lock, NULL);
+	ring.seed = rnd(UINT32_MAX);
+	atomic_store(&ring.done, 0);
+	ring.dropped = 0;
+	ring.stalled = 0;
+	
+	int* late = malloc(RING_MAX_READS * sizeof(int));
+	int reads = 0;
+	int slowest = 0; // us
+	int underruns = 0;
+	int frames = 0;
+	int64_t last = -1;
+	int bad = 0;
+	
+	pthread_t producer;
+	pthread_create(&producer, NULL, ringProducer, NULL);
+	SND_Frame out[RING_CALLBACK];
+	struct timespec deadline;
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	uint64_t next = getMicroseconds();
+	while (!bad && reads<RING_MAX_READS) {
+		deadline.tv_nsec += RING_PERIOD * 1000;
+		deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+		deadline.tv_nsec %= 1000000000L;
+		next += RING_PERIOD;
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL);
+		
+		uint64_t then = getMicroseconds();
+		late[reads++] = then>next ? then-next : 0;
+		
+		int done = atomic_load(&ring.done); // before reading so nothing is left behind after
+		pthread_mutex_lock(&ring.lock);
+		uint64_t start = getMicroseconds(); // not counting a resize holding the lock
+		int count = AudioRing_read(&ring.ring, out, RING_CALLBACK);
+		int took = getMicroseconds() - start;
+		pthread_mutex_unlock(&ring.lock);
+		if (took>slowest) slowest = took;
+		
+		if (count<RING_CALLBACK) underruns += 1;
+		for (int i=0; i<count && !bad; i++) {
+			int64_t seq = (uint16_t)out[i].left | (uint32_t)(uint16_t)out[i].right << 16;
+			bad = seq<=last;
+			if (bad) printf("FAIL ring frame %lli after %lli\n", (long long)seq, (long long)last);
+			last = seq;
+		}
+		frames += count;
+		if (done && !count) break;
+	}
+	pthread_join(producer, NULL);
+	
+	if (ring.stalled) {
+		printf("FAIL ring producer stalled after %i frames\n", frames);
+		bad = 1;
+	}
+	else if (!bad && frames+ring.dropped!=RING_FRAMES) {
+		printf("FAIL ring read %i frames and dropped %i of %i\n", frames, ring.dropped, RING_FRAMES);
+		bad = 1;
+	}
+	if (!bad && !AudioRing_hadUnderrun(&ring.ring)) {
+		printf("FAIL ring didn't flag its underruns\n");
+		bad = 1;
+	}
+	if (bad) test.failed += 1;
+	
+	qsort(late, reads, sizeof(int), compareInts);
+	printf("%-8s %s (%i frames, %i underruns, read max %ius, wake late p50 %ius p99 %ius max %ius)\n", "ring", test.failed==failed ? "ok" : "FAILED",
+		frames, underruns, slowest, late[reads/2], late[reads*99/100], late[reads-1]);
+	
+	free(late);
+	pthread_mutex_destroy(&ring.lock);
+	AudioRing_quit(&ring.ring);
+}
+
+///////////////////////////////
+
+// each resampler against the signal it's resampling: a sine has a
+// known value between its samples, so every output frame is compared
+// to the double precision sine at the input position it stands for.
+// input comes in random batch sizes like a core's. matching rates
+// have to use linear and come through bit for bit
+#define RESAMPLE_IN 16384 // frames
+#define RESAMPLE_AMPLITUDE 16000
+static const int resample_rates[][2] = {{32040,48000},{32768,48000},{44100,48000},{48000,44100}};
+#define RESAMPLE_RATES (sizeof(resample_rates) / sizeof(resample_rates[0]))
+static const int resample_hz[] = {1000,6000};
+#define RESAMPLE_HZ (sizeof(resample_hz) / sizeof(resample_hz[0]))
+static const double resample_min_snr[RESAMPLE_COUNT][RESAMPLE_HZ] = { // dB, a little under what they do now
+	[RESAMPLE_LINEAR] = {45,15},
+	[RESAMPLE_CUBIC]  = {75,27},
+	[RESAMPLE_SINC]   = {68,54},
+};
+static int resampleSine(AudioResampler* resampler, SND_Frame* in, int in_count, SND_Frame* out, int out_count) { // returns frames produced
+	int produced = 0;
+	int taken = 0;
+	while (taken<in_count && produced<out_count) {
+		int batch = 1 + rnd(1024);
+		if (batch>in_count-taken) batch = in_count-taken;
+		int consumed;
+		produced += AudioResampler_run(resampler, in+taken, batch, out+produced, out_count-produced, &consumed);
+		taken += consumed;
+	}
+	return produced;
+}
+static void testResample(void) {
+	int failed = test.failed;
+	static AudioResampler resampler; // too big for the stack
+	SND_Frame* in = malloc(RESAMPLE_IN * sizeof(SND_Frame));
+	int out_max = RESAMPLE_IN * 2;
+	SND_Frame* out = malloc(out_max * sizeof(SND_Frame));
+	double worst[RESAMPLE_COUNT][RESAMPLE_HZ];
+	for (int q=0; q<RESAMPLE_COUNT; q++) for (int h=0; h<RESAMPLE_HZ; h++) worst[q][h] = INFINITY;
+	
+	for (int r=0; r<RESAMPLE_RATES; r++) {
+		int rate_in = resample_rates[r][0];
+		int rate_out = resample_rates[r][1];
+		for (int h=0; h<RESAMPLE_HZ; h++) {
+			double w = 2 * M_PI * resample_hz[h] / rate_in;
+			for (int i=0; i<RESAMPLE_IN; i++) {
+				double sample = RESAMPLE_AMPLITUDE * sin(w * i);
+				in[i] = (SND_Frame){(int16_t)lrint(sample), (int16_t)lrint(-sample)};
+			}
+			for (int q=0; q<RESAMPLE_COUNT; q++) {
+				AudioResampler_init(&resampler, q, rate_in, rate_out);
+				int produced = resampleSine(&resampler, in, RESAMPLE_IN, out, out_max);
+				
+				// past the silence the window starts with
+				double signal = 0;
+				double noise = 0;
+				for (int k=AUDIO_TAPS; k<produced; k++) {
+					double sample = RESAMPLE_AMPLITUDE * sin(w * k * resampler.base_step);
+					signal += 2 * sample * sample;
+					noise += (out[k].left - sample) * (out[k].left - sample);
+					noise += (out[k].right + sample) * (out[k].right + sample);
+				}
+				double snr = 10 * log10(signal / noise);
+				if (snr<worst[q][h]) worst[q][h] = snr;
+				if (produced<RESAMPLE_IN*rate_out/rate_in - AUDIO_TAPS || snr<resample_min_snr[q][h]) {
+					printf("FAIL resample quality:%i %i to %iHz %iHz sine, %i frames out, snr %.1fdB (-s %u)\n", q, rate_in, rate_out, resample_hz[h], produced, snr, test.first_seed);
+					test.failed += 1;
+				}
+			}
+		}
+	}
+	
+	for (int q=0; q<RESAMPLE_COUNT; q++) {
+		for (int i=0; i<RESAMPLE_IN; i++) in[i] = (SND_Frame){rnd(65536), rnd(65536)};
+		AudioResampler_init(&resampler, q, 48000, 48000);
+		int produced = resampleSine(&resampler, in, RESAMPLE_IN, out, out_max);
+		int k = 0;
+		while (k<produced && out[k].left==in[k].left && out[k].right==in[k].right) k++;
+		if (resampler.quality!=RESAMPLE_LINEAR || produced<RESAMPLE_IN-AUDIO_TAPS || k<produced) {
+			printf("FAIL resample quality:%i at 48000Hz used %i and differs at frame %i of %i (-s %u)\n", q, resampler.quality, k, produced, test.first_seed);
+			test.failed += 1;
+		}
+	}
+	
+	free(in);
+	free(out);
+	printf("%-8s %s (snr at %i/%iHz linear %.0f/%.0fdB cubic %.0f/%.0fdB sinc %.0f/%.0fdB)\n", "resample", test.failed==failed ? "ok" : "FAILED",
+		resample_hz[0], resample_hz[1], worst[RESAMPLE_LINEAR][0], worst[RESAMPLE_LINEAR][1], worst[RESAMPLE_CUBIC][0], worst[RESAMPLE_CUBIC][1], worst[RESAMPLE_SINC][0], worst[RESAMPLE_SINC][1]);
+}
+
+///////////////////////////////
+
+// rate control against a simulated device whose clock is off by up
+// to RATE_MAX_SKEW either way, fed by a snes core (32040Hz at
+// 60.0988fps) paced to a 60Hz display so the core is off too. the
+// producer batches a video frame's worth, the device pulls SAMPLES
+// sized callbacks, and the ring starts empty like after SND_init().
+// it can never run dry or fill up, after RATE_SETTLE seconds the fill
+// averaged over each second has to hold within RATE_TOLERANCE of the
+// target and the integral term has to have found the combined skew
+#define RATE_SECONDS 300
+#define RATE_SETTLE 120
+#define RATE_TOLERANCE 0.05 // of the target fill
+#define RATE_MAX_SKEW 0.003
+#define RATE_IN 32040
+#define RATE_OUT 48000
+#define RATE_CORE_FPS 60.0988
+#define RATE_DISPLAY_HZ 60
+#define RATE_CALLBACK 512 // frames
+#define RATE_RING (64 * 2 * RATE_OUT / 1000) // SND_DEFAULT_LATENCY
+static void testRate(void) {
+	int failed = test.failed;
+	int settled = 0; // worst case, in seconds
+	double worst = 0; // fill error after settling, of the target
+	for (int run=0; run<5; run++) {
+		double skew = RATE_MAX_SKEW * (run - 2) / 2; // -max to max
+		AudioRate rate = {0};
+		double base_step = (double)RATE_IN / RATE_OUT;
+		int target = RATE_RING / 2;
+		
+		double in_frames = 0, out_frames = 0, device_frames = 0; // fractional carry
+		int fill = 0;
+		int underruns = 0;
+		int blocked = 0;
+		int settled_at = -1;
+		double error = 0;
+		double sum = 0;
+		for (int frame=0; frame<RATE_SECONDS*RATE_DISPLAY_HZ; frame++) {
+			double step = base_step * AudioRate_update(&rate, fill, target);
+			in_frames += (double)RATE_IN / RATE_CORE_FPS;
+			int in = in_frames;
+			in_frames -= in;
+			out_frames += in / step;
+			int out = out_frames;
+			out_frames -= out;
+			fill += out;
+			if (fill>RATE_RING-1) { // the producer would have waited
+				blocked += 1;
+				fill = RATE_RING-1;
+			}
+			
+			device_frames += RATE_OUT * (1 + skew) / RATE_DISPLAY_HZ;
+			while (device_frames>=RATE_CALLBACK) {
+				device_frames -= RATE_CALLBACK;
+				if (fill<RATE_CALLBACK) {
+					underruns += 1;
+					fill = 0;
+				}
+				else fill -= RATE_CALLBACK;
+			}
+			
+			sum += fill;
+			if ((frame+1)%RATE_DISPLAY_HZ==0) {
+				double off = fabs(sum / RATE_DISPLAY_HZ - target) / target;
+				if (off>RATE_TOLERANCE) settled_at = -1;
+				else if (settled_at<0) settled_at = (frame+1) / RATE_DISPLAY_HZ;
+				if (frame>=RATE_SETTLE*RATE_DISPLAY_HZ && off>error) error = off;
+				sum = 0;
+			}
+		}
+		
+		// what the step has to be scaled by to match the device
+		double needed = RATE_IN * RATE_DISPLAY_HZ / RATE_CORE_FPS / (base_step * RATE_OUT * (1 + skew));
+		double found = 1.0 - rate.skew;
+		if (settled_at<0 || settled_at>RATE_SETTLE || error>RATE_TOLERANCE || underruns || blocked || fabs(found - needed)>0.0005) {
+			printf("FAIL rate with the device %+.1f%% off settled at %is, fill %.1f%% off after, %i underruns, %i blocked, step x%.5f for x%.5f\n", skew*100, settled_at, error*100, underruns, blocked, found, needed);
+			test.failed += 1;
+		}
+		if (settled_at>settled) settled = settled_at;
+		if (error>worst) worst = error;
+	}
+	printf("%-8s %s (device +-%.1f%%, settled in %is, fill within %.1f%% after)\n", "rate", test.failed==failed ? "ok" : "FAILED", RATE_MAX_SKEW*100, settled, worst*100);
+}
+
+///////////////////////////////
+
+// wsola time-compressing a 440Hz sine has to give a 440Hz sine back,
+// only shorter: the frequency from its zero crossings, the length, the
+// level and the largest step between frames (a bad splice jumps) are
+// all checked against the input. right is half of left to catch the
+// channels getting mixed up (not inverted, the search is on mono)
+#define TEMPO_RATE 48000
+#define TEMPO_HZ 440
+#define TEMPO_IN (TEMPO_RATE * 4)
+#define TEMPO_AMPLITUDE 16000
+static void testTempo(void) {
+	int failed = test.failed;
+	static AudioTempo tempo; // too big for the stack
+	static const double speeds[] = {1.0, 1.5, 2.0, 3.0, 4.0};
+	SND_Frame* in = malloc(TEMPO_IN * sizeof(SND_Frame));
+	SND_Frame* out = malloc((TEMPO_IN + AUDIO_WSOLA_HOP) * sizeof(SND_Frame));
+	double w = 2 * M_PI * TEMPO_HZ / TEMPO_RATE;
+	for (int i=0; i<TEMPO_IN; i++) {
+		int16_t sample = lrint(TEMPO_AMPLITUDE * sin(w * i));
+		in[i] = (SND_Frame){sample, sample / 2};
+	}
+	double slope = TEMPO_AMPLITUDE * w; // steepest the sine gets
+	double max_step = slope * 1.25; // plus the search's two frame grid
+	double worst_hz = 0;
+	double worst_jump = 0;
+	
+	for (int s=0; s<sizeof(speeds)/sizeof(speeds[0]); s++) {
+		double speed = speeds[s];
+		AudioTempo_reset(&tempo);
+		int taken = 0;
+		int produced = 0;
+		while (taken<TEMPO_IN) {
+			int batch = 1 + rnd(1024);
+			if (batch>TEMPO_IN-taken) batch = TEMPO_IN-taken;
+			int fed = 0;
+			while (fed<batch) {
+				fed += AudioTempo_feed(&tempo, in+taken+fed, batch-fed);
+				while (AudioTempo_next(&tempo, speed, out+produced)) produced += AUDIO_WSOLA_HOP;
+			}
+			taken += batch;
+		}
+		
+		// past the fade in from silence
+		int from = AUDIO_WSOLA_HOP * 2;
+		int crossings = 0;
+		int first = -1, last = -1;
+		double energy = 0;
+		double jump = 0;
+		int mixed = 0;
+		for (int k=from; k<produced; k++) {
+			if (abs(out[k].left / 2 - out[k].right)>1) mixed = 1;
+			energy += (double)out[k].left * out[k].left;
+			double step = fabs((double)out[k].left - out[k-1].left);
+			if (step>jump) jump = step;
+			if (out[k-1].left<0 && out[k].left>=0) {
+				if (first<0) first = k;
+				last = k;
+				crossings += 1;
+			}
+		}
+		double hz = crossings>1 ? (crossings - 1) * (double)TEMPO_RATE / (last - first) : 0;
+		double level = sqrt(energy / (produced - from)) / (TEMPO_AMPLITUDE / M_SQRT2);
+		double length = (double)produced * speed / TEMPO_IN;
+		if (fabs(hz - TEMPO_HZ)>TEMPO_HZ*0.01 || fabs(length - 1)>0.02 || fabs(level - 1)>0.05 || jump>max_step || mixed) {
+			printf("FAIL tempo x%.1f %.1fHz, %.3f of the length, %.3f of the level, largest step %.0f of %.0f%s (-s %u)\n", speed, hz, length, level, jump, max_step, mixed ? ", channels mixed" : "", test.first_seed);
+			test.failed += 1;
+		}
+		if (fabs(hz - TEMPO_HZ)>worst_hz) worst_hz = fabs(hz - TEMPO_HZ);
+		if (jump/slope>worst_jump) worst_jump = jump/slope;
+	}
+	free(in);
+	free(out);
+	printf("%-8s %s (x1-4 of a %iHz sine, off by %.1fHz at most, largest step %.0f%% of the sine's)\n", "tempo", test.failed==failed ? "ok" : "FAILED", TEMPO_HZ, worst_hz, worst_jump*100);
+}
+
+///////////////////////////////
+
+// run ahead against a stand-in core whose frame depends on its whole
+// state and the input, with a serialize_size() that grows and shrinks.
+// after every step the main instance has to be where the same frames
+// without run ahead left it, the one frame shown has to be what
+// running ahead from there with the input held gives and only the
+// real frame may be heard. with two instances the main one must never
+// be rewound. serialize and unserialize fail now and then too
+#define AHEAD_RAM 4096
+#define AHEAD_FRAMES 40
+typedef struct AheadCore {
+	uint32_t frame;
+	uint32_t seed;
+	uint32_t used; // bytes of ram in use, what serialize_size() follows
+	uint8_t ram[AHEAD_RAM];
+	int unserialized; // calls, not part of the state
+} AheadCore;
+#define AHEAD_HEADER offsetof(AheadCore, ram)
+static struct {
+	AheadCore cores[2]; // main, second instance
+	uint16_t pad; // the input this frame
+	uint16_t polled; // what the core sees, frontend side like minarch's
+	int skip_video;
+	int skip_audio;
+	int skip_poll;
+	int shown; // frames seen since the last step
+	uint32_t shown_hash;
+	int heard; // frames heard since the last step
+	int fail_serialize;
+	int fail_unserialize; // on the second instance
+} ahead;
+
+static uint32_t aheadHash(AheadCore* core) {
+	return crc32(0, (uint8_t*)core, AHEAD_HEADER + core->used);
+}
+static void aheadRun(AheadCore* core) {
+	if (!ahead.skip_poll) ahead.polled = ahead.pad;
+	core->frame += 1;
+	for (int i=0; i<64; i++) {
+		core->seed = core->seed * 1664525 + 1013904223;
+		core->ram[(core->seed >> 8) % core->used] += ahead.polled ^ core->frame;
+	}
+	if (core->frame % 8==0) {
+		core->used = 64 + (core->seed >> 8) % (AHEAD_RAM - 64);
+		memset(core->ram + core->used, 0, AHEAD_RAM - core->used); // so the state is all in serialize()
+	}
+	if (!ahead.skip_video) {
+		ahead.shown += 1;
+		ahead.shown_hash = aheadHash(core);
+	}
+	if (!ahead.skip_audio) ahead.heard += 1;
+}
+static size_t aheadSize(AheadCore* core) {
+	return AHEAD_HEADER + core->used;
+}
+static bool aheadSerialize(AheadCore* core, void* data, size_t size) {
+	if (ahead.fail_serialize || size<aheadSize(core)) return false;
+	memcpy(data, core, aheadSize(core));
+	return true;
+}
+static bool aheadUnserialize(AheadCore* core, const void* data, size_t size) {
+	AheadCore* saved = (AheadCore*)data;
+	if (size<AHEAD_HEADER || size!=AHEAD_HEADER + saved->used) return false;
+	int unserialized = core->unserialized + 1;
+	memcpy(core, data, size);
+	memset(core->ram + core->used, 0, AHEAD_RAM - core->used);
+	core->unserialized = unserialized;
+	return true;
+}
+static void aheadRun0(void) { aheadRun(&ahead.cores[0]); }
+static void aheadRun1(void) { aheadRun(&ahead.cores[1]); }
+static size_t aheadSize0(void) { return aheadSize(&ahead.cores[0]); }
+static size_t aheadSize1(void) { return aheadSize(&ahead.cores[1]); }
+static bool aheadSerialize0(void* data, size_t size) { return aheadSerialize(&ahead.cores[0], data, size); }
+static bool aheadSerialize1(void* data, size_t size) { return aheadSerialize(&ahead.cores[1], data, size); }
+static bool aheadUnserialize0(const void* data, size_t size) { return aheadUnserialize(&ahead.cores[0], data, size); }
+static bool aheadUnserialize1(const void* data, size_t size) { return !ahead.fail_unserialize && aheadUnserialize(&ahead.cores[1], data, size); }
+static void aheadSkip(int video, int audio, int poll) {
+	ahead.skip_video = video;
+	ahead.skip_audio = audio;
+	ahead.skip_poll = poll;
+}
+static void aheadReset(AheadCore* core, uint32_t seed) {
+	memset(core, 0, sizeof(AheadCore));
+	core->seed = seed;
+	core->used = 64;
+}
+
+static void testRunAhead(void) {
+	int failed = test.failed;
+	static const RunAheadCore primary = {aheadRun0, aheadSize0, aheadSerialize0, aheadUnserialize0};
+	static const RunAheadCore secondary = {aheadRun1, aheadSize1, aheadSerialize1, aheadUnserialize1};
+	static AheadCore reference; // the same frames without run ahead
+	static AheadCore expected; // what should be shown
+	RunAhead state = {.skip=aheadSkip};
+	int steps = 0;
+	int failures = 0;
+	for (int i=0; i<test.runs/20; i++) {
+		int frames = 1 + rnd(4);
+		int instances = 1 + rnd(2);
+		uint32_t seed = rnd(0xffffff);
+		aheadReset(&reference, seed);
+		aheadReset(&ahead.cores[0], seed);
+		for (int frame=0; frame<AHEAD_FRAMES; frame++) {
+			ahead.pad = rnd(1<<16);
+			
+			aheadSkip(0, 0, 0);
+			aheadRun(&reference);
+			expected = reference;
+			aheadSkip(1, 1, 1);
+			for (int j=0; j<frames; j++) aheadRun(&expected);
+			uint32_t expected_hash = aheadHash(&expected);
+			
+			ahead.fail_serialize = !rnd(16);
+			ahead.fail_unserialize = instances==2 && !rnd(16);
+			ahead.shown = ahead.heard = 0;
+			ahead.cores[0].unserialized = 0;
+			aheadSkip(1, 0, 0); // the real frame, as RunAhead_run()
+			aheadRun(&ahead.cores[0]);
+			aheadSkip(0, 0, 0);
+			ahead.pad = rnd(1<<16); // too late, frames ahead hold what the real one polled
+			int status = RunAhead_step(&state, &primary, instances==2 ? &secondary : NULL, frames, 0);
+			
+			int want = ahead.fail_serialize ? RUNAHEAD_NO_STATE : ahead.fail_unserialize ? RUNAHEAD_NO_SECONDARY : RUNAHEAD_OK;
+			int rewound = status==RUNAHEAD_OK && instances==2 ? 0 : status==RUNAHEAD_NO_STATE ? 0 : 1;
+			char* why = NULL;
+			if (status!=want) why = "status";
+			else if (aheadHash(&ahead.cores[0])!=aheadHash(&reference) || memcmp(&ahead.cores[0], &reference, offsetof(AheadCore, unserialized))) why = "not restored";
+			else if (ahead.cores[0].unserialized!=rewound) why = "rewound";
+			else if (ahead.heard!=1) why = "heard";
+			else if (status!=RUNAHEAD_NO_STATE && (ahead.shown!=1 || ahead.shown_hash!=expected_hash)) why = "shown";
+			else if (status==RUNAHEAD_NO_STATE && ahead.shown) why = "shown";
+			else if (ahead.skip_video || ahead.skip_audio || ahead.skip_poll) why = "skip";
+			if (why) {
+				printf("FAIL runahead %s at frame %i, %i frames ahead, %i instances (-s %u)\n", why, frame, frames, instances, test.first_seed);
+				test.failed += 1;
+				break;
+			}
+			steps += 1;
+			failures += status!=RUNAHEAD_OK;
+		}
+	}
+	RunAhead_free(&state);
+	printf("%-8s %s (%i steps 1-4 frames ahead, %i with a failing core)\n", "runahead", test.failed==failed ? "ok" : "FAILED", steps, failures);
+}
+
+int main(int argc, char* argv[]) {
+	test.runs = 2000;
+	test.seed = time(NULL);
+	for (int i=1; i<argc; i++) {
+		if (!strcmp(argv[i], "-n") && i+1<argc) test.runs = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-s") && i+1<argc) test.seed = strtoul(argv[++i], NULL, 10);
+	}
+	test.first_seed = test.seed;
+	printf("seed %u, %i runs per backend\n", test.seed, test.runs);
+
+	test.src = malloc(SRC_SIZE);
+	test.tmp = malloc(SRC_SIZE);
+	test.a = malloc(DST_SIZE);
+	test.b = malloc(DST_SIZE);
+	if (!test.src || !test.tmp || !test.a || !test.b) {
+		fprintf(stderr, "test: out of memory\n");
+		return 1;
+	}
+	for (int i=0; i<SRC_SIZE; i++) test.src[i] = rnd(256);
+
+#ifdef HAS_NEON
+	testBackend("n16", scaler_n16, scaler_c16, 2);
+	testBackend("n32", scaler_n32, scaler_c32, 4);
+#endif
+#ifdef __SSE2__
+	testBackend("s16", scaler_s16, scaler_c16, 2);
+	testBackend("s32", scaler_s32, scaler_c32, 4);
+#endif
+	testBackend("16", scaler_16, scaler_c16, 2);
+	testBackend("32", scaler_32, scaler_c32, 4);
+	testConvertScaler("c32to16", scaler_c32to16);
+	testConvert();
+	testDelta();
+	testState();
+	testMailbox();
+	testRing();
+	testResample();
+	testRate();
+	testTempo();
+	testRunAhead();
+	testConvertColors(); // last, it overwrites src
+
+	free(test.src);
+	free(test.tmp);
+	free(test.a);
+	free(test.b);
+
+	if (test.failed) printf("%i failed\n", test.failed);
+	return test.failed ? 1 : 0;
+}
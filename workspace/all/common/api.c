@@ -11,6 +11,8 @@
 #include <errno.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
 
 #include <msettings.h>
 
@@ -222,6 +224,7 @@ void GFX_sync(void) {
 }
 
 FALLBACK_IMPLEMENTATION int PLAT_supportsOverscan(void) { return 0; }
+FALLBACK_IMPLEMENTATION double PLAT_getRefreshRate(void) { return 60.0; }
 
 int GFX_truncateText(TTF_Font* font, const char* in_name, char* out_name, int max_width, int padding) {
 	int text_width;
@@ -300,201 +303,11 @@ int GFX_wrapText(TTF_Font* font, char* str, int max_width, int max_lines) {
 
 ///////////////////////////////
 
-// scale_blend (and supporting logic) from picoarch
-
-struct blend_args {
-	int w_ratio_in;
-	int w_ratio_out;
-	uint16_t w_bp[2];
-	int h_ratio_in;
-	int h_ratio_out;
-	uint16_t h_bp[2];
-	uint16_t *blend_line;
-} blend_args;
-
-#if __ARM_ARCH >= 5
-static inline uint32_t average16(uint32_t c1, uint32_t c2) {
-	uint32_t ret, lowbits = 0x0821;
-	asm ("eor %0, %2, %3\r\n"
-	     "and %0, %0, %1\r\n"
-	     "add %0, %3, %0\r\n"
-	     "add %0, %0, %2\r\n"
-	     "lsr %0, %0, #1\r\n"
-	     : "=&r" (ret) : "r" (lowbits), "r" (c1), "r" (c2) : );
-	return ret;
-}
-static inline uint32_t average32(uint32_t c1, uint32_t c2) {
-	uint32_t ret, lowbits = 0x08210821;
-
-	asm ("eor %0, %3, %1\r\n"
-	     "and %0, %0, %2\r\n"
-	     "adds %0, %1, %0\r\n"
-	     "and %1, %1, #0\r\n"
-	     "movcs %1, #0x80000000\r\n"
-	     "adds %0, %0, %3\r\n"
-	     "rrx %0, %0\r\n"
-	     "orr %0, %0, %1\r\n"
-	     : "=&r" (ret), "+r" (c2) : "r" (lowbits), "r" (c1) : "cc" );
-
-	return ret;
-}
-
-#define AVERAGE16_NOCHK(c1, c2) (average16((c1), (c2)))
-#define AVERAGE32_NOCHK(c1, c2) (average32((c1), (c2)))
-
-#else
-
-static inline uint32_t average16(uint32_t c1, uint32_t c2) {
-	return (c1 + c2 + ((c1 ^ c2) & 0x0821))>>1;
-}
-static inline uint32_t average32(uint32_t c1, uint32_t c2) {
-	uint32_t sum = c1 + c2;
-	uint32_t ret = sum + ((c1 ^ c2) & 0x08210821);
-	uint32_t of = ((sum < c1) | (ret < sum)) << 31;
-
-	return (ret >> 1) | of;
-}
-
-#define AVERAGE16_NOCHK(c1, c2) (average16((c1), (c2)))
-#define AVERAGE32_NOCHK(c1, c2) (average32((c1), (c2)))
-
-#endif
-
-#define AVERAGE16(c1, c2) ((c1) == (c2) ? (c1) : AVERAGE16_NOCHK((c1), (c2)))
-#define AVERAGE16_1_3(c1, c2) ((c1) == (c2) ? (c1) : (AVERAGE16_NOCHK(AVERAGE16_NOCHK((c1), (c2)), (c2))))
-
-#define AVERAGE32(c1, c2) ((c1) == (c2) ? (c1) : AVERAGE32_NOCHK((c1), (c2)))
-#define AVERAGE32_1_3(c1, c2) ((c1) == (c2) ? (c1) : (AVERAGE32_NOCHK(AVERAGE32_NOCHK((c1), (c2)), (c2))))
-
-static inline int gcd(int a, int b) {
-	return b ? gcd(b, a % b) : a;
-}
-
-static void scaleAA(void* __restrict src, void* __restrict dst, uint32_t w, uint32_t h, uint32_t pitch, uint32_t dst_w, uint32_t dst_h, uint32_t dst_p) {
-	int dy = 0;
-	int lines = h;
-
-	int rat_w = blend_args.w_ratio_in;
-	int rat_dst_w = blend_args.w_ratio_out;
-	uint16_t *bw = blend_args.w_bp;
-
-	int rat_h = blend_args.h_ratio_in;
-	int rat_dst_h = blend_args.h_ratio_out;
-	uint16_t *bh = blend_args.h_bp;
-
-	while (lines--) {
-		while (dy < rat_dst_h) {
-			uint16_t *dst16 = (uint16_t *)dst;
-			uint16_t *pblend = (uint16_t *)blend_args.blend_line;
-			int col = w;
-			int dx = 0;
-
-			uint16_t *pnext = (uint16_t *)(src + pitch);
-			if (!lines)
-				pnext -= (pitch / sizeof(uint16_t));
-
-			if (dy > rat_dst_h - bh[0]) {
-				pblend = pnext;
-			} else if (dy <= bh[0]) {
-				/* Drops const, won't get touched later though */
-				pblend = (uint16_t *)src;
-			} else {
-				const uint32_t *src32 = (const uint32_t *)src;
-				const uint32_t *pnext32 = (const uint32_t *)pnext;
-				uint32_t *pblend32 = (uint32_t *)pblend;
-				int count = w / 2;
-
-				if (dy <= bh[1]) {
-					const uint32_t *tmp = pnext32;
-					pnext32 = src32;
-					src32 = tmp;
-				}
-
-				if (dy > rat_dst_h - bh[1] || dy <= bh[1]) {
-					while(count--) {
-						*pblend32++ = AVERAGE32_1_3(*src32, *pnext32);
-						src32++;
-						pnext32++;
-					}
-				} else {
-					while(count--) {
-						*pblend32++ = AVERAGE32(*src32, *pnext32);
-						src32++;
-						pnext32++;
-					}
-				}
-			}
-
-			while (col--) {
-				uint16_t a, b, out;
-
-				a = *pblend;
-				b = *(pblend+1);
-
-				while (dx < rat_dst_w) {
-					if (a == b) {
-						out = a;
-					} else if (dx > rat_dst_w - bw[0]) { // top quintile, bbbb
-						out = b;
-					} else if (dx <= bw[0]) { // last quintile, aaaa
-						out = a;
-					} else {
-						if (dx > rat_dst_w - bw[1]) { // 2nd quintile, abbb
-							a = AVERAGE16_NOCHK(a,b);
-						} else if (dx <= bw[1]) { // 4th quintile, aaab
-							b = AVERAGE16_NOCHK(a,b);
-						}
-
-						out = AVERAGE16_NOCHK(a, b); // also 3rd quintile, aabb
-					}
-					*dst16++ = out;
-					dx += rat_w;
-				}
-
-				dx -= rat_dst_w;
-				pblend++;
-			}
-
-			dy += rat_h;
-			dst += dst_p;
-		}
-
-		dy -= rat_dst_h;
-		src += pitch;
-	}
-}
-
 scaler_t GFX_getAAScaler(GFX_Renderer* renderer) {
-	int gcd_w, div_w, gcd_h, div_h;
-	blend_args.blend_line = calloc(renderer->src_w, sizeof(uint16_t));
-
-	gcd_w = gcd(renderer->src_w, renderer->dst_w);
-	blend_args.w_ratio_in = renderer->src_w / gcd_w;
-	blend_args.w_ratio_out = renderer->dst_w / gcd_w;
-	
-	double blend_denominator = (renderer->src_w>renderer->dst_w) ? 5 : 2.5; // TODO: these values are really only good for the nano...
-	// blend_denominator = 5.0; // better for trimui
-	// LOG_info("blend_denominator: %f (%i && %i)\n", blend_denominator, HAS_SKINNY_SCREEN, renderer->dst_w>renderer->src_w);
-	
-	div_w = round(blend_args.w_ratio_out / blend_denominator);
-	blend_args.w_bp[0] = div_w;
-	blend_args.w_bp[1] = blend_args.w_ratio_out >> 1;
-
-	gcd_h = gcd(renderer->src_h, renderer->dst_h);
-	blend_args.h_ratio_in = renderer->src_h / gcd_h;
-	blend_args.h_ratio_out = renderer->dst_h / gcd_h;
-
-	div_h = round(blend_args.h_ratio_out / blend_denominator);
-	blend_args.h_bp[0] = div_h;
-	blend_args.h_bp[1] = blend_args.h_ratio_out >> 1;
-	
-	return scaleAA;
+	return scaleAA_get(renderer->src_w, renderer->src_h, renderer->dst_w, renderer->dst_h, SCALE_AA_AUTO);
 }
 void GFX_freeAAScaler(void) {
-	if (blend_args.blend_line != NULL) {
-		free(blend_args.blend_line);
-		blend_args.blend_line = NULL;
-	}
+	scaleAA_free();
 }
 
 ///////////////////////////////
@@ -916,14 +729,21 @@ void GFX_blitText(TTF_Font* font, char* str, int leading, SDL_Color color, SDL_S
 // better
 
 #define MAX_SAMPLE_RATE 48000
-#define BATCH_SIZE 100
 #ifndef SAMPLES
 	#define SAMPLES 512 // default
 #endif
 
 #define ms SDL_GetTicks
 
-typedef int (*SND_Resampler)(const SND_Frame frame);
+// the buffer is an AudioStream, see audio.h. SND_batchSamples() and
+// SND_batchSamplesFast() resample into its ring on the core's thread
+// and SND_audioCallback() drains it
+
+#define SND_DEFAULT_LATENCY 64 // ms
+
+static int snd_resampler = RESAMPLE_SINC; // survives SND_init()
+static int snd_latency = SND_DEFAULT_LATENCY; // ditto
+static int snd_min_latency = 0; // requested by the core, ditto
 static struct SND_Context {
 	int initialized;
 	double frame_rate;
@@ -931,38 +751,24 @@ static struct SND_Context {
 	int sample_rate_in;
 	int sample_rate_out;
 	
-	int buffer_seconds;     // current_audio_buffer_size
-	SND_Frame* buffer;		// buf
-	size_t frame_count; 	// buf_len
-	
-	int frame_in;     // buf_w
-	int frame_out;    // buf_r
-	int frame_filled; // max_buf_w
-	
-	SND_Resampler resample;
+	int latency; // target in ms, the ring holds twice this
+	int quality; // RESAMPLE_* asked for, the resampler may use linear instead
+	AudioStream stream;
 } snd = {0};
 static void SND_audioCallback(void* userdata, uint8_t* stream, int len) { // plat_sound_callback
 	
 	// return (void)memset(stream,0,len); // TODO: tmp, silent
 	
-	if (snd.frame_count==0) return;
+	if (snd.stream.ring.frame_count==0) return;
 	
 	int16_t *out = (int16_t *)stream;
 	len /= (sizeof(int16_t) * 2);
 	
-	// if (snd.frame_out!=snd.frame_in) LOG_info("%8i consuming samples (%i frames)\n", ms(), len);
+	// if (AudioRing_filled(&snd.stream.ring)) LOG_info("%8i consuming samples (%i frames)\n", ms(), len);
 	
-	while (snd.frame_out!=snd.frame_in && len>0) {
-		*out++ = snd.buffer[snd.frame_out].left;
-		*out++ = snd.buffer[snd.frame_out].right;
-		
-		snd.frame_filled = snd.frame_out;
-		
-		snd.frame_out += 1;
-		len -= 1;
-		
-		if (snd.frame_out>=snd.frame_count) snd.frame_out = 0;
-	}
+	int count = AudioRing_read(&snd.stream.ring, (SND_Frame*)out, len);
+	out += count * 2;
+	len -= count;
 	
 	int zero = len>0 && len==SAMPLES;
 	if (zero) return (void)memset(out,0,len*(sizeof(int16_t) * 2));
@@ -975,89 +781,71 @@ static void SND_audioCallback(void* userdata, uint8_t* stream, int len) { // pla
 		len -= 1;
 	}
 }
-static void SND_resizeBuffer(void) { // plat_sound_resize_buffer
-	snd.frame_count = snd.buffer_seconds * snd.sample_rate_in / snd.frame_rate;
-	if (snd.frame_count==0) return;
-	
-	SDL_LockAudio();
-	
-	int buffer_bytes = snd.frame_count * sizeof(SND_Frame);
-	snd.buffer = realloc(snd.buffer, buffer_bytes);
-	
-	memset(snd.buffer, 0, buffer_bytes);
+static int SND_targetLatency(void) {
+	return snd_min_latency>snd_latency ? snd_min_latency : snd_latency;
+}
+static void SND_resizeBuffer(void) { // plat_sound_resize_buffer, producer side
+	int latency = SND_targetLatency();
+	int frame_count = latency * 2 * snd.sample_rate_out / 1000;
+	if (frame_count<SAMPLES*2) frame_count = SAMPLES*2; // always room for a whole callback
 	
-	snd.frame_in = 0;
-	snd.frame_out = 0;
-	snd.frame_filled = snd.frame_count - 1;
+	// allocate before locking so the audio thread never waits on it
+	SND_Frame* buffer = calloc(frame_count, sizeof(SND_Frame));
+	if (!buffer) return;
 	
+	SDL_LockAudio();
+	buffer = AudioRing_swap(&snd.stream.ring, buffer, frame_count);
+	snd.stream.frame_target = frame_count / 2;
+	snd.latency = latency;
 	SDL_UnlockAudio();
+	
+	free(buffer); // the old one
 }
-static int SND_resampleNone(SND_Frame frame) { // audio_resample_passthrough
-	snd.buffer[snd.frame_in++] = frame;
-	if (snd.frame_in >= snd.frame_count) snd.frame_in = 0;
-	return 1;
+static void SND_selectResampler(void) { // plat_sound_select_resampler
+	snd.quality = snd_resampler;
+	AudioResampler_init(&snd.stream.resampler, snd.quality, snd.sample_rate_in, snd.sample_rate_out);
+	snd.stream.rate.skew = 0;
 }
-static int SND_resampleNear(SND_Frame frame) { // audio_resample_nearest
-	static int diff = 0;
-	int consumed = 0;
-
-	if (diff < snd.sample_rate_out) {
-		snd.buffer[snd.frame_in++] = frame;
-		if (snd.frame_in >= snd.frame_count) snd.frame_in = 0;
-		diff += snd.sample_rate_in;
-	}
-
-	if (diff >= snd.sample_rate_out) {
-		consumed++;
-		diff -= snd.sample_rate_out;
-	}
-
-	return consumed;
+void SND_setResampler(int resampler) {
+	snd_resampler = resampler; // picked up by the next SND_batchSamples()
 }
-static void SND_selectResampler(void) { // plat_sound_select_resampler
-	if (snd.sample_rate_in==snd.sample_rate_out) {
-		snd.resample =  SND_resampleNone;
-	}
-	else {
-		snd.resample = SND_resampleNear;
-	}
+void SND_setLatency(int latency) {
+	snd_latency = latency; // ditto
+}
+void SND_setMinimumLatency(int latency) {
+	snd_min_latency = latency; // ditto
+}
+int SND_hadUnderrun(void) {
+	return AudioRing_hadUnderrun(&snd.stream.ring);
+}
+int SND_getFill(void) {
+	if (!snd.stream.ring.frame_count) return 0;
+	return AudioRing_filled(&snd.stream.ring) * 100 / snd.stream.ring.frame_count;
+}
+int SND_getLatency(void) {
+	if (!snd.sample_rate_out) return 0;
+	return AudioRing_filled(&snd.stream.ring) * 1000 / snd.sample_rate_out;
 }
 size_t SND_batchSamples(const SND_Frame* frames, size_t frame_count) { // plat_sound_write / plat_sound_write_resample
 	
 	// return frame_count; // TODO: tmp, silent
 	
-	if (snd.frame_count==0) return 0;
+	if (snd.stream.ring.frame_count==0) return 0;
 	
 	// LOG_info("%8i batching samples (%i frames)\n", ms(), frame_count);
 	
-	SDL_LockAudio();
-
-	int consumed = 0;
-	int consumed_frames = 0;
-	while (frame_count > 0) {
-		int tries = 0;
-		int amount = MIN(BATCH_SIZE, frame_count);
-		
-		while (tries < 10 && snd.frame_in==snd.frame_filled) {
-			tries++;
-			SDL_UnlockAudio();
-			SDL_Delay(1);
-			SDL_LockAudio();
-		}
-		// if (tries) LOG_info("%8i waited %ims for buffer to get low...\n", ms(), tries);
-
-		while (amount && snd.frame_in != snd.frame_filled) {
-			consumed_frames = snd.resample(*frames);
-			
-			frames += consumed_frames;
-			amount -= consumed_frames;
-			frame_count -= consumed_frames;
-			consumed += consumed_frames;
-		}
-	}
-	SDL_UnlockAudio();
+	if (snd.quality!=snd_resampler) SND_selectResampler(); // only ever changed on this thread
+	if (snd.latency!=SND_targetLatency()) SND_resizeBuffer();
 	
-	return consumed;
+	return AudioStream_write(&snd.stream, frames, frame_count);
+}
+size_t SND_batchSamplesFast(const SND_Frame* frames, size_t frame_count, int mode) {
+	if (snd.stream.ring.frame_count==0 || mode==FF_AUDIO_OFF) return frame_count;
+	
+	if (snd.quality!=snd_resampler) SND_selectResampler();
+	if (snd.latency!=SND_targetLatency()) SND_resizeBuffer();
+	
+	return AudioStream_writeFast(&snd.stream, frames, frame_count, mode);
 }
 
 void SND_init(double sample_rate, double frame_rate) { // plat_sound_init
@@ -1075,6 +863,8 @@ void SND_init(double sample_rate, double frame_rate) { // plat_sound_init
 	
 	memset(&snd, 0, sizeof(struct SND_Context));
 	snd.frame_rate = frame_rate;
+	snd.stream.ff_speed = 2.0; // a guess, corrected as soon as we fast forward
+	AudioRing_init(&snd.stream.ring);
 
 	SDL_AudioSpec spec_in;
 	SDL_AudioSpec spec_out;
@@ -1087,7 +877,6 @@ void SND_init(double sample_rate, double frame_rate) { // plat_sound_init
 	
 	if (SDL_OpenAudio(&spec_in, &spec_out)<0) LOG_info("SDL_OpenAudio error: %s\n", SDL_GetError());
 	
-	snd.buffer_seconds = 5;
 	snd.sample_rate_in  = sample_rate;
 	snd.sample_rate_out = spec_out.freq;
 	
@@ -1105,10 +894,8 @@ void SND_quit(void) { // plat_sound_finish
 	SDL_PauseAudio(1);
 	SDL_CloseAudio();
 	
-	if (snd.buffer) {
-		free(snd.buffer);
-		snd.buffer = NULL;
-	}
+	AudioRing_quit(&snd.stream.ring);
+	snd.initialized = 0;
 }
 
 ///////////////////////////////
@@ -3,6 +3,7 @@
 #include "sdl.h"
 #include "platform.h"
 #include "scaler.h"
+#include "audio.h"
 
 ///////////////////////////////
 
@@ -127,6 +128,7 @@ typedef struct GFX_Renderer {
 	int src_w;
 	int src_h;
 	int src_p;
+	int src_bpp; // FIXED_BPP, or 4 for XRGB8888 that the blit converts as it scales
 	
 	// TODO: I think this is overscaled
 	int dst_x;
@@ -156,6 +158,7 @@ int GFX_hdmiChanged(void);
 void GFX_startFrame(void);
 void GFX_flip(SDL_Surface* screen);
 #define GFX_supportsOverscan PLAT_supportsOverscan // (void)
+#define GFX_getRefreshRate PLAT_getRefreshRate // (void)
 void GFX_sync(void); // call this to maintain 60fps when not calling GFX_flip() this frame
 void GFX_quit(void);
 
@@ -174,7 +177,7 @@ int GFX_wrapText(TTF_Font* font, char* str, int max_width, int max_lines);
 #define GFX_getScaler PLAT_getScaler		// scaler_t:(GFX_Renderer* renderer)
 #define GFX_blitRenderer PLAT_blitRenderer	// void:(GFX_Renderer* renderer)
 
-scaler_t GFX_getAAScaler(GFX_Renderer* renderer);
+scaler_t GFX_getAAScaler(GFX_Renderer* renderer); // returns NULL on failure
 void GFX_freeAAScaler(void);
 
 // NOTE: all dimensions should be pre-scaled
@@ -195,13 +198,15 @@ void GFX_blitText(TTF_Font* font, char* str, int leading, SDL_Color color, SDL_S
 
 ///////////////////////////////
 
-typedef struct SND_Frame {
-	int16_t left;
-	int16_t right;
-} SND_Frame;
-
 void SND_init(double sample_rate, double frame_rate);
 size_t SND_batchSamples(const SND_Frame* frames, size_t frame_count);
+size_t SND_batchSamplesFast(const SND_Frame* frames, size_t frame_count, int mode); // FF_AUDIO_*, never blocks
+void SND_setResampler(int resampler); // RESAMPLE_*
+void SND_setLatency(int latency); // target in ms, rate control holds the buffer around it
+void SND_setMinimumLatency(int latency); // ms, requested by the core, 0 to clear
+int SND_getFill(void); // percent of the buffer waiting to play
+int SND_getLatency(void); // ms of audio waiting to play
+int SND_hadUnderrun(void); // since the last call
 void SND_quit(void);
 
 ///////////////////////////////
@@ -308,6 +313,7 @@ scaler_t PLAT_getScaler(GFX_Renderer* renderer);
 void PLAT_blitRenderer(GFX_Renderer* renderer);
 void PLAT_flip(SDL_Surface* screen, int sync);
 int PLAT_supportsOverscan(void);
+double PLAT_getRefreshRate(void); // hz
 
 SDL_Surface* PLAT_initOverlay(void);
 void PLAT_quitOverlay(void);
@@ -0,0 +1,435 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "audio.h"
+
+///////////////////////////////
+
+#define AUDIO_MIN(a,b) ((a)<(b)?(a):(b))
+
+void AudioRing_init(AudioRing* ring) {
+	memset(ring, 0, sizeof(AudioRing));
+	pthread_mutex_init(&ring->mx, NULL);
+	pthread_cond_init(&ring->cv, NULL);
+}
+void AudioRing_quit(AudioRing* ring) {
+	free(ring->buffer);
+	ring->buffer = NULL;
+	ring->frame_count = 0;
+	pthread_cond_destroy(&ring->cv);
+	pthread_mutex_destroy(&ring->mx);
+}
+SND_Frame* AudioRing_swap(AudioRing* ring, SND_Frame* buffer, int frame_count) {
+	// carry over whatever is still queued (dropping the oldest if it
+	// no longer fits) so changing latency mid game doesn't skip
+	int queued = 0;
+	if (ring->buffer) {
+		int frame_out = atomic_load(&ring->frame_out);
+		queued = (ring->frame_write - frame_out + ring->frame_count) % ring->frame_count;
+		if (queued>frame_count-1) {
+			frame_out = (frame_out + queued - (frame_count-1)) % ring->frame_count;
+			queued = frame_count-1;
+		}
+		for (int i=0; i<queued; ) {
+			int count = AUDIO_MIN(queued - i, ring->frame_count - frame_out);
+			memcpy(&buffer[i], &ring->buffer[frame_out], count * sizeof(SND_Frame));
+			i += count;
+			frame_out = (frame_out + count) % ring->frame_count;
+		}
+	}
+	
+	SND_Frame* old_buffer = ring->buffer;
+	ring->buffer = buffer;
+	ring->frame_count = frame_count;
+	
+	atomic_store(&ring->frame_in, queued);
+	atomic_store(&ring->frame_out, 0);
+	ring->frame_write = queued;
+	
+	return old_buffer;
+}
+int AudioRing_free(AudioRing* ring) {
+	if (!ring->frame_count) return 0;
+	int frame_out = atomic_load(&ring->frame_out);
+	return (frame_out - ring->frame_write - 1 + ring->frame_count) % ring->frame_count;
+}
+int AudioRing_filled(AudioRing* ring) {
+	if (!ring->frame_count) return 0;
+	int frame_in = atomic_load(&ring->frame_in);
+	int frame_out = atomic_load(&ring->frame_out);
+	return (frame_in - frame_out + ring->frame_count) % ring->frame_count;
+}
+int AudioRing_waitForSpace(AudioRing* ring, int timeout) {
+	if (AudioRing_free(ring)) return 1;
+	
+	struct timespec deadline;
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_nsec += timeout * 1000000L;
+	deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+	deadline.tv_nsec %= 1000000000L;
+	
+	pthread_mutex_lock(&ring->mx);
+	atomic_store(&ring->waiting, 1);
+	int free_frames;
+	while (!(free_frames=AudioRing_free(ring))) {
+		if (pthread_cond_timedwait(&ring->cv, &ring->mx, &deadline)==ETIMEDOUT) {
+			free_frames = AudioRing_free(ring);
+			break;
+		}
+	}
+	atomic_store(&ring->waiting, 0);
+	pthread_mutex_unlock(&ring->mx);
+	
+	return free_frames>0;
+}
+SND_Frame* AudioRing_writable(AudioRing* ring, int* count) {
+	*count = AUDIO_MIN(AudioRing_free(ring), ring->frame_count - ring->frame_write);
+	return &ring->buffer[ring->frame_write];
+}
+void AudioRing_commit(AudioRing* ring, int count) {
+	ring->frame_write += count;
+	if (ring->frame_write>=ring->frame_count) ring->frame_write = 0;
+	atomic_store_explicit(&ring->frame_in, ring->frame_write, memory_order_release);
+}
+int AudioRing_read(AudioRing* ring, SND_Frame* out, int count) {
+	if (!ring->frame_count) return 0;
+	
+	int frame_in = atomic_load_explicit(&ring->frame_in, memory_order_acquire);
+	int frame_out = atomic_load_explicit(&ring->frame_out, memory_order_relaxed);
+	
+	int read = 0;
+	while (frame_out!=frame_in && read<count) {
+		int run = AUDIO_MIN(count - read, (frame_in>frame_out ? frame_in : ring->frame_count) - frame_out);
+		memcpy(&out[read], &ring->buffer[frame_out], run * sizeof(SND_Frame));
+		read += run;
+	
+		frame_out += run;
+		if (frame_out>=ring->frame_count) frame_out = 0;
+	}
+	
+	atomic_store(&ring->frame_out, frame_out);
+	if (atomic_load(&ring->waiting)) {
+		pthread_mutex_lock(&ring->mx);
+		pthread_cond_signal(&ring->cv);
+		pthread_mutex_unlock(&ring->mx);
+	}
+	
+	if (read<count) atomic_store(&ring->underrun, 1);
+	return read;
+}
+int AudioRing_hadUnderrun(AudioRing* ring) {
+	return atomic_exchange(&ring->underrun, 0);
+}
+
+///////////////////////////////
+
+static inline int16_t Audio_clamp(float sample) {
+	int value = (int)(sample + (sample<0 ? -0.5f : 0.5f));
+	if (value>INT16_MAX) return INT16_MAX;
+	if (value<INT16_MIN) return INT16_MIN;
+	return value;
+}
+static inline float Audio_dot(const float* restrict samples, const float* restrict taps) {
+#if defined(__ARM_NEON)
+	float32x4_t sum = vmulq_f32(vld1q_f32(samples), vld1q_f32(taps));
+	for (int i=4; i<AUDIO_TAPS; i+=4) sum = vmlaq_f32(sum, vld1q_f32(samples+i), vld1q_f32(taps+i));
+#if defined(__aarch64__)
+	return vaddvq_f32(sum);
+#else
+	float32x2_t half = vadd_f32(vget_low_f32(sum), vget_high_f32(sum));
+	return vget_lane_f32(vpadd_f32(half,half), 0);
+#endif
+#elif defined(__SSE2__)
+	__m128 sum = _mm_mul_ps(_mm_loadu_ps(samples), _mm_loadu_ps(taps));
+	for (int i=4; i<AUDIO_TAPS; i+=4) sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(samples+i), _mm_loadu_ps(taps+i)));
+	sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+	sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+	return _mm_cvtss_f32(sum);
+#else
+	float sum = 0;
+	for (int i=0; i<AUDIO_TAPS; i++) sum += samples[i] * taps[i];
+	return sum;
+#endif
+}
+
+static inline __attribute__((always_inline)) int AudioResampler_runWith(AudioResampler* resampler, int quality, const SND_Frame* in, int in_count, SND_Frame* out, int out_count, int* consumed) {
+	int produced = 0;
+	*consumed = 0;
+	while (produced<out_count) {
+		// top up the window
+		int count = AUDIO_MIN(in_count - *consumed, AUDIO_WINDOW - resampler->window_count);
+		for (int i=0; i<count; i++) {
+			resampler->window_l[resampler->window_count+i] = in[*consumed+i].left;
+			resampler->window_r[resampler->window_count+i] = in[*consumed+i].right;
+		}
+		resampler->window_count += count;
+		*consumed += count;
+		
+		int start = produced;
+		double position = resampler->position;
+		double step = resampler->step;
+		while (produced<out_count) {
+			int i = (int)position;
+			if (i + AUDIO_TAPS/2 >= resampler->window_count) break; // need more input
+			float frac = position - i;
+			float* l = resampler->window_l;
+			float* r = resampler->window_r;
+			float left,right;
+			switch (quality) {
+				case RESAMPLE_LINEAR:
+					left  = l[i] + (l[i+1] - l[i]) * frac;
+					right = r[i] + (r[i+1] - r[i]) * frac;
+					break;
+				case RESAMPLE_CUBIC: { // catmull-rom
+					float f2 = frac * frac;
+					float f3 = f2 * frac;
+					float a = -0.5f*f3 +       f2 - 0.5f*frac;
+					float b =  1.5f*f3 - 2.5f*f2 + 1.0f;
+					float c = -1.5f*f3 + 2.0f*f2 + 0.5f*frac;
+					float d =  0.5f*f3 - 0.5f*f2;
+					left  = a*l[i-1] + b*l[i] + c*l[i+1] + d*l[i+2];
+					right = a*r[i-1] + b*r[i] + c*r[i+1] + d*r[i+2];
+					break;
+				}
+				default: { // RESAMPLE_SINC
+					float* taps = resampler->sinc[(int)(frac * AUDIO_PHASES + 0.5f)];
+					int from = i - (AUDIO_TAPS/2 - 1);
+					left  = Audio_dot(l+from, taps);
+					right = Audio_dot(r+from, taps);
+					break;
+				}
+			}
+			out[produced].left = Audio_clamp(left);
+			out[produced].right = Audio_clamp(right);
+			produced += 1;
+			position += step;
+		}
+		resampler->position = position;
+		
+		// drop input we'll never look at again
+		int discard = AUDIO_MIN((int)resampler->position - (AUDIO_TAPS/2 - 1), resampler->window_count);
+		if (discard>0) {
+			resampler->window_count -= discard;
+			memmove(resampler->window_l, resampler->window_l+discard, resampler->window_count * sizeof(float));
+			memmove(resampler->window_r, resampler->window_r+discard, resampler->window_count * sizeof(float));
+			resampler->position -= discard;
+		}
+		
+		if (produced==start && *consumed==in_count) break; // out of input
+	}
+	return produced;
+}
+static int AudioResampler_linear(AudioResampler* resampler, const SND_Frame* in, int in_count, SND_Frame* out, int out_count, int* consumed) {
+	return AudioResampler_runWith(resampler, RESAMPLE_LINEAR, in, in_count, out, out_count, consumed);
+}
+static int AudioResampler_cubic(AudioResampler* resampler, const SND_Frame* in, int in_count, SND_Frame* out, int out_count, int* consumed) {
+	return AudioResampler_runWith(resampler, RESAMPLE_CUBIC, in, in_count, out, out_count, consumed);
+}
+static int AudioResampler_sinc(AudioResampler* resampler, const SND_Frame* in, int in_count, SND_Frame* out, int out_count, int* consumed) {
+	return AudioResampler_runWith(resampler, RESAMPLE_SINC, in, in_count, out, out_count, consumed);
+}
+
+static void AudioResampler_initSinc(AudioResampler* resampler, int sample_rate_in, int sample_rate_out) {
+	// blackman windowed sinc, cutoff lowered when downsampling to avoid aliasing
+	double cutoff = 0.91 * (sample_rate_out<sample_rate_in ? (double)sample_rate_out / sample_rate_in : 1.0);
+	for (int phase=0; phase<=AUDIO_PHASES; phase++) {
+		double frac = (double)phase / AUDIO_PHASES;
+		double sum = 0;
+		for (int i=0; i<AUDIO_TAPS; i++) {
+			double x = i - (AUDIO_TAPS/2 - 1) - frac; // distance from the output position
+			double t = (x / (AUDIO_TAPS/2)) * 0.5 + 0.5; // 0-1 across the window
+			double window = 0.42 - 0.5 * cos(2 * M_PI * t) + 0.08 * cos(4 * M_PI * t);
+			double sinc = x==0 ? 1.0 : sin(M_PI * cutoff * x) / (M_PI * cutoff * x);
+			resampler->sinc[phase][i] = cutoff * sinc * window;
+			sum += resampler->sinc[phase][i];
+		}
+		for (int i=0; i<AUDIO_TAPS; i++) resampler->sinc[phase][i] /= sum; // unity gain
+	}
+}
+void AudioResampler_init(AudioResampler* resampler, int quality, int sample_rate_in, int sample_rate_out) {
+	if (sample_rate_in==sample_rate_out) quality = RESAMPLE_LINEAR;
+	resampler->quality = quality;
+	switch (quality) {
+		case RESAMPLE_LINEAR: resampler->kernel = AudioResampler_linear; break;
+		case RESAMPLE_CUBIC:  resampler->kernel = AudioResampler_cubic; break;
+		default:              resampler->kernel = AudioResampler_sinc; break;
+	}
+	if (resampler->kernel==AudioResampler_sinc) AudioResampler_initSinc(resampler, sample_rate_in, sample_rate_out);
+	
+	// prime the window with silence so the kernels never read before it
+	resampler->window_count = AUDIO_TAPS/2 - 1;
+	memset(resampler->window_l, 0, sizeof(resampler->window_l));
+	memset(resampler->window_r, 0, sizeof(resampler->window_r));
+	resampler->position = AUDIO_TAPS/2 - 1;
+	resampler->base_step = (double)sample_rate_in / sample_rate_out;
+	resampler->step = resampler->base_step;
+}
+int AudioResampler_run(AudioResampler* resampler, const SND_Frame* in, int in_count, SND_Frame* out, int out_count, int* consumed) {
+	return resampler->kernel(resampler, in, in_count, out, out_count, consumed);
+}
+
+///////////////////////////////
+
+double AudioRate_update(AudioRate* rate, int filled, int target) {
+	// -1 when full, 1 when empty
+	double direction = (double)(target - filled) / target;
+	if (direction>1) direction = 1;
+	if (direction<-1) direction = -1;
+	
+	rate->skew += AUDIO_RATE_CONTROL_GAIN * direction;
+	if (rate->skew>AUDIO_RATE_CONTROL_DELTA) rate->skew = AUDIO_RATE_CONTROL_DELTA;
+	if (rate->skew<-AUDIO_RATE_CONTROL_DELTA) rate->skew = -AUDIO_RATE_CONTROL_DELTA;
+	
+	return 1.0 - AUDIO_RATE_CONTROL_DELTA * direction - rate->skew;
+}
+
+///////////////////////////////
+
+void AudioTempo_reset(AudioTempo* tempo) {
+	// start from silence so the first chunk fades in
+	tempo->count = AUDIO_WSOLA_SEEK;
+	memset(tempo->l, 0, AUDIO_WSOLA_SEEK * sizeof(float));
+	memset(tempo->r, 0, AUDIO_WSOLA_SEEK * sizeof(float));
+	tempo->skip = 0;
+	tempo->position = AUDIO_WSOLA_SEEK;
+	memset(tempo->tail_l, 0, sizeof(tempo->tail_l));
+	memset(tempo->tail_r, 0, sizeof(tempo->tail_r));
+	for (int i=0; i<AUDIO_WSOLA_HOP; i++) {
+		tempo->fade[i] = 0.5f - 0.5f * cosf(M_PI * (i + 0.5f) / AUDIO_WSOLA_HOP);
+	}
+}
+int AudioTempo_feed(AudioTempo* tempo, const SND_Frame* frames, int frame_count) {
+	int skip = AUDIO_MIN(tempo->skip, frame_count);
+	tempo->skip -= skip;
+	
+	int count = AUDIO_MIN(frame_count - skip, AUDIO_WSOLA_BUFFER - tempo->count);
+	for (int i=0; i<count; i++) {
+		tempo->l[tempo->count+i] = frames[skip+i].left;
+		tempo->r[tempo->count+i] = frames[skip+i].right;
+	}
+	tempo->count += count;
+	return skip + count;
+}
+int AudioTempo_next(AudioTempo* tempo, double speed, SND_Frame* out) {
+	int nominal = tempo->position;
+	if (nominal + AUDIO_WSOLA_SEEK + AUDIO_WSOLA_HOP*2 > tempo->count) return 0;
+	
+	float* l = tempo->l;
+	float* r = tempo->r;
+	
+	// normalized cross-correlation of mono (every other frame is plenty)
+	int best = nominal;
+	float best_score = -INFINITY;
+	for (int from=nominal-AUDIO_WSOLA_SEEK; from<=nominal+AUDIO_WSOLA_SEEK; from+=2) {
+		float correlation = 0;
+		float energy = 1;
+		for (int i=0; i<AUDIO_WSOLA_HOP; i+=2) {
+			float sample = l[from+i] + r[from+i];
+			correlation += sample * (tempo->tail_l[i] + tempo->tail_r[i]);
+			energy += sample * sample;
+		}
+		float score = correlation / sqrtf(energy);
+		if (score>best_score) {
+			best_score = score;
+			best = from;
+		}
+	}
+	
+	for (int i=0; i<AUDIO_WSOLA_HOP; i++) {
+		float fade = tempo->fade[i];
+		out[i].left  = Audio_clamp(tempo->tail_l[i] + (l[best+i] - tempo->tail_l[i]) * fade);
+		out[i].right = Audio_clamp(tempo->tail_r[i] + (r[best+i] - tempo->tail_r[i]) * fade);
+	}
+	memcpy(tempo->tail_l, &l[best+AUDIO_WSOLA_HOP], sizeof(tempo->tail_l));
+	memcpy(tempo->tail_r, &r[best+AUDIO_WSOLA_HOP], sizeof(tempo->tail_r));
+	
+	// advance by speed hops of input per hop of output, dropping what's behind the next search
+	tempo->position += speed * AUDIO_WSOLA_HOP;
+	int discard = (int)tempo->position - AUDIO_WSOLA_SEEK;
+	if (discard>=tempo->count) {
+		tempo->skip += discard - tempo->count;
+		tempo->count = 0;
+	}
+	else {
+		tempo->count -= discard;
+		memmove(l, l+discard, tempo->count * sizeof(float));
+		memmove(r, r+discard, tempo->count * sizeof(float));
+	}
+	tempo->position -= discard;
+	return 1;
+}
+
+///////////////////////////////
+
+static size_t AudioStream_resample(AudioStream* stream, const SND_Frame* frames, size_t frame_count, int wait) {
+	AudioRing* ring = &stream->ring;
+	int consumed = 0;
+	while (frame_count > 0) {
+		if (wait ? !AudioRing_waitForSpace(ring, AUDIO_STALL_TIMEOUT) : !AudioRing_free(ring)) {
+			consumed += frame_count; // dropped
+			break;
+		}
+		
+		// resample straight into the free run at the write position
+		int count;
+		SND_Frame* out = AudioRing_writable(ring, &count);
+		int consumed_frames = 0;
+		int produced_frames = AudioResampler_run(&stream->resampler, frames, frame_count, out, count, &consumed_frames);
+		AudioRing_commit(ring, produced_frames);
+		
+		frames += consumed_frames;
+		frame_count -= consumed_frames;
+		consumed += consumed_frames;
+	}
+	
+	return consumed;
+}
+size_t AudioStream_write(AudioStream* stream, const SND_Frame* frames, size_t frame_count) {
+	stream->fast_forward = 0;
+	AudioResampler* resampler = &stream->resampler;
+	resampler->step = resampler->base_step * AudioRate_update(&stream->rate, AudioRing_filled(&stream->ring), stream->frame_target);
+	return AudioStream_resample(stream, frames, frame_count, 1);
+}
+size_t AudioStream_writeFast(AudioStream* stream, const SND_Frame* frames, size_t frame_count, int mode) {
+	if (mode==FF_AUDIO_OFF) return frame_count;
+	size_t batch_count = frame_count;
+	
+	if (!stream->fast_forward) {
+		stream->fast_forward = 1;
+		AudioTempo_reset(&stream->tempo);
+	}
+	
+	// filling up means the core is running faster than we're assuming
+	double direction = (double)(AudioRing_filled(&stream->ring) - stream->frame_target) / stream->frame_target;
+	stream->ff_speed *= 1.0 + AUDIO_FF_GAIN * direction;
+	if (stream->ff_speed<1.0) stream->ff_speed = 1.0;
+	if (stream->ff_speed>AUDIO_FF_MAX_SPEED) stream->ff_speed = AUDIO_FF_MAX_SPEED;
+	double ff_step = stream->ff_speed * (1.0 + AUDIO_FF_DAMPING * direction);
+	if (ff_step<1.0) ff_step = 1.0;
+	
+	AudioResampler* resampler = &stream->resampler;
+	if (mode==FF_AUDIO_DECIMATE) {
+		resampler->step = resampler->base_step * ff_step;
+		AudioStream_resample(stream, frames, frame_count, 0);
+		return batch_count;
+	}
+	
+	resampler->step = resampler->base_step;
+	SND_Frame chunk[AUDIO_WSOLA_HOP];
+	while (frame_count>0) {
+		int count = AudioTempo_feed(&stream->tempo, frames, frame_count);
+		frames += count;
+		frame_count -= count;
+		while (AudioTempo_next(&stream->tempo, ff_step, chunk)) AudioStream_resample(stream, chunk, AUDIO_WSOLA_HOP, 0);
+	}
+	return batch_count;
+}
@@ -0,0 +1,161 @@
+#ifndef AUDIO_H
+#define AUDIO_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+//
+//	the audio path between the core and the device, kept free of SDL
+//	so it can be tested and benchmarked on the host. api.c owns the
+//	device and calls into this from SND_batchSamples() and its callback
+//
+//	the ring is single-producer (the core thread) single-consumer (the
+//	audio callback). each side only writes its own index and publishes
+//	it with release semantics so neither needs a lock. the producer
+//	sleeps on a condition variable when the ring is full and the
+//	consumer only touches the mutex to wake it
+//
+//	resamplers work on whole batches, converting to float into a
+//	window of recent input frames (left and right kept apart so the
+//	sinc filter can run vectorized) and interpolating at a fractional
+//	position that advances by step input frames per output frame.
+//	every kernel reads AUDIO_TAPS/2-1 frames behind and AUDIO_TAPS/2
+//	ahead of that position. when the rates match the step only strays
+//	from 1 by rate control's fraction of a percent, which sinc can't
+//	improve on, so linear is used whatever was asked for. with no
+//	correction at all that passes the input through bit for bit
+//
+//	dynamic rate control (as in retroarch): the ring holds twice the
+//	target latency and every batch nudges the step by up to
+//	AUDIO_RATE_CONTROL_DELTA to pull the fill back towards half full,
+//	so latency holds steady instead of drifting into the blocking
+//	wait. unlike retroarch a slow integral term soaks up the steady
+//	clock skew between core and device, otherwise the fill would
+//	settle off target by skew/delta
+//
+//	fast forward never waits on the consumer. the same fill error
+//	instead drives ff_speed, the number of input frames per real time
+//	frame, which converges on however fast the core is actually
+//	running. decimate just resamples with the step scaled by it
+//	(cheap, pitched up and a little aliased), tempo first
+//	time-compresses by it with wsola (overlap-adding the hop-sized
+//	chunk of input near each nominal position that best continues the
+//	last one) so pitch holds
+//
+//	an AudioStream puts all of that together, api.c only adds the
+//	device and picks the latency
+//
+
+typedef struct SND_Frame {
+	int16_t left;
+	int16_t right;
+} SND_Frame;
+
+enum {
+	RESAMPLE_LINEAR,
+	RESAMPLE_CUBIC,
+	RESAMPLE_SINC, // default
+	RESAMPLE_COUNT,
+};
+
+enum {
+	FF_AUDIO_OFF,
+	FF_AUDIO_DECIMATE, // default
+	FF_AUDIO_TEMPO,
+	FF_AUDIO_COUNT,
+};
+
+#define AUDIO_TAPS 16 // sinc filter length
+#define AUDIO_PHASES 256 // sinc filter table resolution
+#define AUDIO_WINDOW (AUDIO_TAPS + 512) // frames
+
+#define AUDIO_RATE_CONTROL_DELTA 0.005 // max step adjustment
+#define AUDIO_RATE_CONTROL_GAIN 0.00001 // integral gain per batch
+
+#define AUDIO_FF_GAIN 0.005 // ff_speed adjustment per batch
+#define AUDIO_FF_DAMPING 0.5 // immediate speed adjustment, without it ff_speed just oscillates
+#define AUDIO_FF_MAX_SPEED 16.0
+#define AUDIO_WSOLA_HOP 256 // frames, half the window
+#define AUDIO_WSOLA_SEEK 128 // frames either side of the nominal position to search
+#define AUDIO_WSOLA_BUFFER 2048 // frames of input held for searching
+
+#define AUDIO_STALL_TIMEOUT 100 // ms to wait for space before dropping samples
+
+typedef struct AudioRing {
+	SND_Frame* buffer;
+	int frame_count;
+	
+	atomic_int frame_in;  // published by the producer
+	atomic_int frame_out; // published by the consumer
+	int frame_write;      // producer's unpublished write position
+	
+	atomic_int waiting; // producer is blocked on a full ring
+	atomic_int underrun; // consumer ran dry since the last AudioRing_hadUnderrun()
+	pthread_mutex_t mx;
+	pthread_cond_t cv;
+} AudioRing;
+
+void AudioRing_init(AudioRing* ring); // empty until the first AudioRing_swap()
+void AudioRing_quit(AudioRing* ring);
+SND_Frame* AudioRing_swap(AudioRing* ring, SND_Frame* buffer, int frame_count); // consumer must be stopped, keeps what's queued and returns the old buffer to free
+int AudioRing_free(AudioRing* ring); // producer
+int AudioRing_filled(AudioRing* ring); // either side
+int AudioRing_waitForSpace(AudioRing* ring, int timeout); // producer, ms, returns 0 if the consumer has stalled
+SND_Frame* AudioRing_writable(AudioRing* ring, int* count); // producer, the free run at the write position
+void AudioRing_commit(AudioRing* ring, int count); // producer, publishes count frames written to AudioRing_writable()
+int AudioRing_read(AudioRing* ring, SND_Frame* out, int count); // consumer, returns frames read, short is an underrun
+int AudioRing_hadUnderrun(AudioRing* ring); // since the last call
+
+typedef struct AudioResampler {
+	int (*kernel)(struct AudioResampler* resampler, const SND_Frame* in, int in_count, SND_Frame* out, int out_count, int* consumed);
+	int quality; // RESAMPLE_* of kernel
+	double base_step; // input frames per output frame
+	double step; // base_step adjusted by rate control or fast forward
+	double position; // of the next output frame in window
+	int window_count; // frames in window
+	float window_l[AUDIO_WINDOW];
+	float window_r[AUDIO_WINDOW];
+	float sinc[AUDIO_PHASES+1][AUDIO_TAPS];
+} AudioResampler;
+
+void AudioResampler_init(AudioResampler* resampler, int quality, int sample_rate_in, int sample_rate_out); // RESAMPLE_*, also resets it
+int AudioResampler_run(AudioResampler* resampler, const SND_Frame* in, int in_count, SND_Frame* out, int out_count, int* consumed); // returns frames produced
+
+typedef struct AudioRate {
+	double skew; // integral term, 0 to start over
+} AudioRate;
+
+double AudioRate_update(AudioRate* rate, int filled, int target); // once per batch, returns what to scale base_step by
+
+typedef struct AudioTempo {
+	float l[AUDIO_WSOLA_BUFFER];
+	float r[AUDIO_WSOLA_BUFFER];
+	int count; // frames in l/r
+	int skip; // input frames to drop before appending more
+	double position; // nominal start of the next chunk in l/r
+	float tail_l[AUDIO_WSOLA_HOP]; // second half of the last chunk, to fade out
+	float tail_r[AUDIO_WSOLA_HOP];
+	float fade[AUDIO_WSOLA_HOP]; // fade in weights
+} AudioTempo;
+
+void AudioTempo_reset(AudioTempo* tempo);
+int AudioTempo_feed(AudioTempo* tempo, const SND_Frame* frames, int frame_count); // returns frames taken
+int AudioTempo_next(AudioTempo* tempo, double speed, SND_Frame* out); // fills out with AUDIO_WSOLA_HOP frames, returns 0 if it needs more input
+
+typedef struct AudioStream {
+	AudioRing ring;
+	int frame_target; // fill rate control aims for, half the ring
+	AudioResampler resampler;
+	AudioRate rate;
+	
+	int fast_forward; // last batch came through AudioStream_writeFast()
+	double ff_speed; // input frames per real time frame while fast forwarding
+	AudioTempo tempo;
+} AudioStream;
+
+size_t AudioStream_write(AudioStream* stream, const SND_Frame* frames, size_t frame_count); // blocks up to AUDIO_STALL_TIMEOUT while the ring is full
+size_t AudioStream_writeFast(AudioStream* stream, const SND_Frame* frames, size_t frame_count, int mode); // FF_AUDIO_*, never blocks
+
+#endif
@@ -0,0 +1,59 @@
+#include <string.h>
+
+#include "delta.h"
+
+///////////////////////////////
+
+size_t Delta_encode(uint8_t* restrict prev, uint8_t* restrict next, size_t size, uint8_t* restrict out) {
+	// a run of (uint32 skip, uint32 len, len xor'd bytes)
+	// literals only end on 8 matching bytes so every run after
+	// the first eats at least 8+len input bytes for 8+len output
+	// bytes and the worst case is size+8
+	uint8_t* start = out;
+	size_t i = 0;
+	while (i<size) {
+		size_t from = i;
+		while (i+8<=size) {
+			uint64_t a,b;
+			memcpy(&a, prev+i, 8);
+			memcpy(&b, next+i, 8);
+			if (a!=b) break;
+			i += 8;
+		}
+		while (i<size && prev[i]==next[i]) i += 1;
+		if (i>=size) break; // nothing changed after this
+		uint32_t skip = i - from;
+		
+		from = i;
+		int same = 0;
+		while (i<size) {
+			if (prev[i]!=next[i]) same = 0;
+			else if (++same==8) {
+				i -= 7;
+				break;
+			}
+			i += 1;
+		}
+		uint32_t len = i - from;
+		
+		memcpy(out+0, &skip, 4);
+		memcpy(out+4, &len, 4);
+		out += 8;
+		for (uint32_t j=0; j<len; j++) out[j] = prev[from+j] ^ next[from+j];
+		out += len;
+	}
+	return out - start;
+}
+void Delta_apply(uint8_t* restrict state, uint8_t* restrict delta, size_t size) {
+	uint8_t* end = delta + size;
+	while (delta<end) {
+		uint32_t skip,len;
+		memcpy(&skip, delta+0, 4);
+		memcpy(&len, delta+4, 4);
+		delta += 8;
+		state += skip;
+		for (uint32_t j=0; j<len; j++) state[j] ^= delta[j];
+		state += len;
+		delta += len;
+	}
+}
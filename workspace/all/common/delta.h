@@ -0,0 +1,18 @@
+#ifndef DELTA_H
+#define DELTA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+//
+//	xor/rle deltas between two same-sized buffers, for rewind.
+//	a delta is a list of (uint32 skip, uint32 len, len xor'd bytes)
+//	runs, applying it to either buffer gives the other one
+//
+
+#define DELTA_MAX_SIZE(size) ((size) + 8) // worst case Delta_encode() output
+
+size_t Delta_encode(uint8_t* restrict prev, uint8_t* restrict next, size_t size, uint8_t* restrict out); // returns bytes written to out
+void Delta_apply(uint8_t* restrict state, uint8_t* restrict delta, size_t size); // size of the delta, not the state
+
+#endif
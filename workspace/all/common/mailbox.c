@@ -0,0 +1,84 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+
+#include "mailbox.h"
+
+///////////////////////////////
+
+#define MAILBOX_BUFFERS 3
+#define MAILBOX_FRESH 0x4 // flag in ready, set until the consumer takes it
+#define MAILBOX_INDEX 0x3
+
+static struct Mailbox_Context {
+	int initialized;
+	MailboxFrame frames[MAILBOX_BUFFERS];
+	atomic_int ready; // index of the spare buffer | MAILBOX_FRESH
+	int writing; // only touched by the producer
+	int reading; // only touched by the consumer
+	sem_t posted;
+} mailbox = {0};
+
+void Mailbox_init(size_t capacity) {
+	if (!mailbox.initialized) {
+		for (int i=0; i<MAILBOX_BUFFERS; i++) {
+			mailbox.frames[i].pixels = capacity ? calloc(1, capacity) : NULL;
+			mailbox.frames[i].capacity = mailbox.frames[i].pixels ? capacity : 0;
+		}
+		sem_init(&mailbox.posted, 0, 0);
+		mailbox.initialized = 1;
+	}
+	for (int i=0; i<MAILBOX_BUFFERS; i++) mailbox.frames[i].width = 0; // nothing to show yet
+	mailbox.writing = 0;
+	mailbox.reading = 1;
+	atomic_store(&mailbox.ready, 2);
+	while (sem_trywait(&mailbox.posted)==0);
+}
+void Mailbox_quit(void) {
+	if (!mailbox.initialized) return;
+	for (int i=0; i<MAILBOX_BUFFERS; i++) free(mailbox.frames[i].pixels);
+	sem_destroy(&mailbox.posted);
+	memset(&mailbox, 0, sizeof(mailbox));
+}
+void Mailbox_post(const void* data, unsigned width, unsigned height, size_t pitch) {
+	MailboxFrame* frame = &mailbox.frames[mailbox.writing];
+	size_t size = height * pitch;
+	if (size>frame->capacity) {
+		// core lied about its max geometry, this buffer is ours so it's safe to grow
+		void* pixels = realloc(frame->pixels, size);
+		if (!pixels) return;
+		frame->pixels = pixels;
+		frame->capacity = size;
+	}
+	memcpy(frame->pixels, data, size);
+	frame->width = width;
+	frame->height = height;
+	frame->pitch = pitch;
+	
+	int previous = atomic_exchange_explicit(&mailbox.ready, mailbox.writing | MAILBOX_FRESH, memory_order_acq_rel);
+	mailbox.writing = previous & MAILBOX_INDEX;
+	if (!(previous & MAILBOX_FRESH)) sem_post(&mailbox.posted); // otherwise the consumer hasn't woken for the last one yet
+}
+MailboxFrame* Mailbox_take(void) {
+	if (!(atomic_load_explicit(&mailbox.ready, memory_order_acquire) & MAILBOX_FRESH)) return NULL;
+	int latest = atomic_exchange_explicit(&mailbox.ready, mailbox.reading, memory_order_acq_rel);
+	mailbox.reading = latest & MAILBOX_INDEX;
+	return &mailbox.frames[mailbox.reading];
+}
+MailboxFrame* Mailbox_wait(void) {
+	MailboxFrame* frame = Mailbox_take();
+	if (frame) return frame;
+	
+	struct timespec deadline;
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_nsec += MAILBOX_TIMEOUT * 1000000L;
+	deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+	deadline.tv_nsec %= 1000000000L;
+	if (sem_timedwait(&mailbox.posted, &deadline)) return NULL;
+	return Mailbox_take(); // NULL if woken by Mailbox_wake() or a post we already took
+}
+void Mailbox_wake(void) {
+	sem_post(&mailbox.posted);
+}
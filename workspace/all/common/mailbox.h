@@ -0,0 +1,33 @@
+#ifndef MAILBOX_H
+#define MAILBOX_H
+
+#include <stddef.h>
+
+//
+//	hands video frames from a producer thread (the core) to a consumer
+//	thread (main) through a triple buffer. the producer owns one buffer
+//	(writing), the consumer another (reading) and the third sits in
+//	ready. each side swaps its buffer with ready in a single atomic
+//	exchange, so neither waits on the other and the consumer always
+//	gets the latest complete frame. the semaphore only wakes the
+//	consumer, it isn't needed to hand anything over
+//
+
+#define MAILBOX_TIMEOUT 100 // ms, so the main thread still notices quit or the menu
+
+typedef struct MailboxFrame {
+	void* pixels;
+	size_t capacity; // bytes
+	unsigned width;
+	unsigned height;
+	size_t pitch;
+} MailboxFrame;
+
+void Mailbox_init(size_t capacity); // before starting the producer, bytes per buffer so we (almost) never allocate on it
+void Mailbox_quit(void);
+void Mailbox_post(const void* data, unsigned width, unsigned height, size_t pitch); // producer
+MailboxFrame* Mailbox_take(void); // consumer, returns NULL if there's no new frame
+MailboxFrame* Mailbox_wait(void); // consumer, returns NULL after MAILBOX_TIMEOUT
+void Mailbox_wake(void); // returns a waiting Mailbox_wait() early
+
+#endif
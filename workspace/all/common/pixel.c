@@ -0,0 +1,154 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "pixel.h"
+
+///////////////////////////////
+
+// 4x4 bayer matrix, 0-15. shifted right by 1 for 5-bit channels and
+// by 2 for the 6-bit green so the dither never exceeds the step lost
+// to truncation
+static const uint8_t bayer[4][4] = {
+	{ 0, 8, 2,10},
+	{12, 4,14, 6},
+	{ 3,11, 1, 9},
+	{15, 7,13, 5},
+};
+
+static inline uint32_t addSaturate(uint32_t c, uint32_t d) {
+	c += d;
+	return c>255 ? 255 : c;
+}
+
+static void convertRow_c(const uint32_t* __restrict s, uint16_t* __restrict d, uint32_t x, uint32_t sw, uint32_t y, int dither) {
+	if (dither) {
+		const uint8_t* row = bayer[y & 3];
+		for (; x<sw; x++) {
+			uint32_t pix = s[x];
+			uint32_t t = row[x & 3];
+			uint32_t r = addSaturate((pix >> 16) & 0xFF, t >> 1);
+			uint32_t g = addSaturate((pix >>  8) & 0xFF, t >> 2);
+			uint32_t b = addSaturate((pix      ) & 0xFF, t >> 1);
+			d[x] = ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3);
+		}
+	}
+	else {
+		for (; x<sw; x++) {
+			uint32_t pix = s[x];
+			d[x] = ((pix & 0xF80000) >> 8) | ((pix & 0xFC00) >> 5) | ((pix & 0xF8) >> 3);
+		}
+	}
+}
+
+void convert_c32to16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dp, int dither) {
+	if (!sw||!sh) return;
+	if (!sp) sp = sw * sizeof(uint32_t);
+	if (!dp) dp = sw * sizeof(uint16_t);
+	for (uint32_t y=0; y<sh; y++, src=(uint8_t*)src+sp, dst=(uint8_t*)dst+dp) {
+		convertRow_c(src, dst, 0, sw, y, dither);
+	}
+}
+
+///////////////////////////////
+
+#if defined(__ARM_NEON)
+
+// 16 pixels per iteration, vld4 splits them into b,g,r,x planes
+// then the shift-right-and-insert ops pack 565 in place
+void convert_32to16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dp, int dither) {
+	if (!sw||!sh) return;
+	if (!sp) sp = sw * sizeof(uint32_t);
+	if (!dp) dp = sw * sizeof(uint16_t);
+	uint32_t vw = sw & ~15;
+	for (uint32_t y=0; y<sh; y++, src=(uint8_t*)src+sp, dst=(uint8_t*)dst+dp) {
+		const uint8_t* s = src;
+		uint16_t* d = dst;
+
+		uint8x16_t d5 = vdupq_n_u8(0);
+		uint8x16_t d6 = vdupq_n_u8(0);
+		if (dither) {
+			uint8_t t5[16], t6[16];
+			for (int i=0; i<16; i++) {
+				t5[i] = bayer[y & 3][i & 3] >> 1;
+				t6[i] = bayer[y & 3][i & 3] >> 2;
+			}
+			d5 = vld1q_u8(t5);
+			d6 = vld1q_u8(t6);
+		}
+
+		for (uint32_t x=0; x<vw; x+=16) {
+			uint8x16x4_t pix = vld4q_u8(s + x * 4);
+			uint8x16_t b = vqaddq_u8(pix.val[0], d5);
+			uint8x16_t g = vqaddq_u8(pix.val[1], d6);
+			uint8x16_t r = vqaddq_u8(pix.val[2], d5);
+
+			uint16x8_t lo = vshll_n_u8(vget_low_u8(r), 8);
+			lo = vsriq_n_u16(lo, vshll_n_u8(vget_low_u8(g), 8), 5);
+			lo = vsriq_n_u16(lo, vshll_n_u8(vget_low_u8(b), 8), 11);
+			uint16x8_t hi = vshll_n_u8(vget_high_u8(r), 8);
+			hi = vsriq_n_u16(hi, vshll_n_u8(vget_high_u8(g), 8), 5);
+			hi = vsriq_n_u16(hi, vshll_n_u8(vget_high_u8(b), 8), 11);
+
+			vst1q_u16(d + x, lo);
+			vst1q_u16(d + x + 8, hi);
+		}
+		convertRow_c(src, dst, vw, sw, y, dither);
+	}
+}
+
+#elif defined(__SSE2__)
+
+// 8 pixels per iteration, each 32-bit lane is packed to 565 in place
+// then sign extended so packs_epi32 narrows it without saturating
+static inline __m128i convert4(__m128i pix) {
+	__m128i r = _mm_and_si128(_mm_srli_epi32(pix, 8), _mm_set1_epi32(0xF800));
+	__m128i g = _mm_and_si128(_mm_srli_epi32(pix, 5), _mm_set1_epi32(0x07E0));
+	__m128i b = _mm_and_si128(_mm_srli_epi32(pix, 3), _mm_set1_epi32(0x001F));
+	__m128i out = _mm_or_si128(r, _mm_or_si128(g, b));
+	return _mm_srai_epi32(_mm_slli_epi32(out, 16), 16);
+}
+void convert_32to16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dp, int dither) {
+	if (!sw||!sh) return;
+	if (!sp) sp = sw * sizeof(uint32_t);
+	if (!dp) dp = sw * sizeof(uint16_t);
+	uint32_t vw = sw & ~7;
+	for (uint32_t y=0; y<sh; y++, src=(uint8_t*)src+sp, dst=(uint8_t*)dst+dp) {
+		const uint8_t* s = src;
+		uint16_t* d = dst;
+
+		__m128i t = _mm_setzero_si128();
+		if (dither) { // b,g,r,x for 4 pixels
+			uint8_t tb[16];
+			for (int i=0; i<4; i++) {
+				uint8_t v = bayer[y & 3][i];
+				tb[i*4+0] = v >> 1;
+				tb[i*4+1] = v >> 2;
+				tb[i*4+2] = v >> 1;
+				tb[i*4+3] = 0;
+			}
+			t = _mm_loadu_si128((const __m128i*)tb);
+		}
+
+		for (uint32_t x=0; x<vw; x+=8) {
+			__m128i p0 = _mm_adds_epu8(_mm_loadu_si128((const __m128i*)(s + x * 4)), t);
+			__m128i p1 = _mm_adds_epu8(_mm_loadu_si128((const __m128i*)(s + x * 4 + 16)), t);
+			_mm_storeu_si128((__m128i*)(d + x), _mm_packs_epi32(convert4(p0), convert4(p1)));
+		}
+		convertRow_c(src, dst, vw, sw, y, dither);
+	}
+}
+
+#else
+
+void convert_32to16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dp, int dither) {
+	convert_c32to16(src, dst, sw, sh, sp, dp, dither);
+}
+
+#endif
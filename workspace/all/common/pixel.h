@@ -0,0 +1,26 @@
+#ifndef __PIXEL_H__
+#define __PIXEL_H__
+#include <stdint.h>
+
+//
+//	pixel format conversion
+//	args/	src :	src offset		address of top left corner
+//		dst :	dst offset		address	of top left corner
+//		sw  :	src width		pixels
+//		sh  :	src height		pixels
+//		sp  :	src pitch (stride)	bytes	if 0, (src width * 4) is used
+//		dp  :	dst pitch (stride)	bytes	if 0, (src width * 2) is used
+//		dither:	1 adds a 4x4 ordered dither before truncating, 0 truncates
+//
+//	the NEON (16 pixels) and SSE2 (8 pixels) paths produce the same
+//	output as the C path, leftover pixels at the end of a row go
+//	through the C path
+//
+
+//	XRGB8888 to RGB565, fastest available
+void convert_32to16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dp, int dither);
+
+//	C reference
+void convert_c32to16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dp, int dither);
+
+#endif
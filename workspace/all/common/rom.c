@@ -0,0 +1,66 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "rom.h"
+
+///////////////////////////////
+
+int ROM_map(char* path, void** data, size_t* size) {
+	int fd = open(path, O_RDONLY);
+	if (fd<0) return -1;
+	
+	struct stat st;
+	if (fstat(fd, &st) || !S_ISREG(st.st_mode) || !st.st_size) {
+		close(fd);
+		return -1;
+	}
+	
+	// writable+private so a core that patches its rom in place gets
+	// copy-on-write pages instead of a segfault. no MAP_POPULATE, on
+	// a writable private mapping it write faults (copies) every page,
+	// readahead gets the file into the page cache instead and pages
+	// map in shared until something writes to them
+	void* mapped = mmap(NULL, st.st_size, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (mapped==MAP_FAILED) return -1;
+	
+	madvise(mapped, st.st_size, MADV_SEQUENTIAL);
+	madvise(mapped, st.st_size, MADV_WILLNEED);
+	
+	*data = mapped;
+	*size = st.st_size;
+	return 0;
+}
+int ROM_read(char* path, void** data, size_t* size) {
+	FILE *file = fopen(path, "r");
+	if (file==NULL) return -1;
+
+	fseek(file, 0, SEEK_END);
+	long file_size = ftell(file);
+	if (file_size<=0) {
+		fclose(file);
+		return -1;
+	}
+
+	rewind(file);
+	void* buffer = malloc(file_size);
+	if (buffer==NULL) {
+		fclose(file);
+		return -1;
+	}
+
+	if (fread(buffer, 1, file_size, file)!=file_size) {
+		free(buffer);
+		fclose(file);
+		return -1;
+	}
+
+	fclose(file);
+	*data = buffer;
+	*size = file_size;
+	return 0;
+}
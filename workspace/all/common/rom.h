@@ -0,0 +1,16 @@
+#ifndef ROM_H
+#define ROM_H
+
+#include <stddef.h>
+
+//
+//	loads a rom for cores that take data instead of a path. mapping
+//	avoids reading the whole file up front and a second copy of it
+//	next to the page cache, reading is the fallback for filesystems
+//	that can't mmap
+//
+
+int ROM_map(char* path, void** data, size_t* size); // returns 0 on success, release with munmap()
+int ROM_read(char* path, void** data, size_t* size); // returns 0 on success, release with free()
+
+#endif
@@ -0,0 +1,44 @@
+#include <stdlib.h>
+
+#include "runahead.h"
+
+///////////////////////////////
+
+static int RunAhead_save(RunAhead* ahead, const RunAheadCore* core, size_t size) {
+	if (size>ahead->state_size) {
+		void* state = realloc(ahead->state, size);
+		if (!state) return 0;
+		ahead->state = state;
+		ahead->state_size = size;
+	}
+	return size && core->serialize(ahead->state, size);
+}
+
+int RunAhead_step(RunAhead* ahead, const RunAheadCore* primary, const RunAheadCore* secondary, int frames, int skip_video) {
+	size_t size = primary->serialize_size();
+	if (!RunAhead_save(ahead, primary, size)) return RUNAHEAD_NO_STATE;
+	
+	int status = RUNAHEAD_OK;
+	const RunAheadCore* instance = secondary ? secondary : primary;
+	if (secondary && !secondary->unserialize(ahead->state, size)) {
+		status = RUNAHEAD_NO_SECONDARY;
+		instance = primary;
+	}
+	
+	for (int i=1; i<frames; i++) {
+		ahead->skip(1, 1, 1);
+		instance->run();
+	}
+	ahead->skip(skip_video, 1, 1);
+	instance->run(); // seen but not heard
+	ahead->skip(skip_video, 0, 0);
+	
+	if (instance==primary) primary->unserialize(ahead->state, size);
+	return status;
+}
+
+void RunAhead_free(RunAhead* ahead) {
+	free(ahead->state);
+	ahead->state = NULL;
+	ahead->state_size = 0;
+}
@@ -0,0 +1,43 @@
+#ifndef RUNAHEAD_H
+#define RUNAHEAD_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+//
+//	run ahead hides the game's own input lag by running the frames
+//	after this one in advance and only showing the last of them.
+//	the frontend runs the real frame (heard but not seen) itself, then
+//	RunAhead_step() saves its state and runs frames-1 more unseen and
+//	unheard and one more seen but not heard, with the input held.
+//	with one instance the state is loaded back into it afterwards.
+//	with a second instance the state is copied into that instead and
+//	it runs ahead on its own, the main instance is never rewound
+//
+//	kept free of libretro.h and SDL so it can be tested and
+//	benchmarked on the host against a stand-in core
+//
+
+typedef struct RunAheadCore { // the core functions run ahead needs
+	void (*run)(void);
+	size_t (*serialize_size)(void);
+	bool (*serialize)(void *data, size_t size);
+	bool (*unserialize)(const void *data, size_t size);
+} RunAheadCore;
+
+typedef struct RunAhead {
+	void* state; // preallocated, grows with serialize_size()
+	size_t state_size;
+	void (*skip)(int video, int audio, int poll); // what the next run() shouldn't do
+} RunAhead;
+
+enum {
+	RUNAHEAD_OK,
+	RUNAHEAD_NO_STATE, // primary can't serialize, nothing ran ahead
+	RUNAHEAD_NO_SECONDARY, // secondary can't unserialize, ran ahead on primary instead
+};
+
+int RunAhead_step(RunAhead* ahead, const RunAheadCore* primary, const RunAheadCore* secondary, int frames, int skip_video); // after the real frame, secondary NULL for one instance, returns RUNAHEAD_*
+void RunAhead_free(RunAhead* ahead);
+
+#endif
@@ -1,11 +1,22 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <math.h>
 
-#include "platform.h" // for HAS_NEON
+#include "pixel.h"
+#include "scaler.h"
+
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#endif
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 //
-//	arm NEON / C integer scalers for ARMv7 devices
+//	arm NEON / x86 SSE2 / C integer scalers, the C scalers are the
+//	reference the others have to match pixel for pixel
 //	args/	src :	src offset		address of top left corner
 //		dst :	dst offset		address	of top left corner
 //		sw  :	src width		pixels
@@ -421,6 +432,104 @@ void scale6x5_c32(void* __restrict src, void* __restrict dst, uint32_t sw, uint3
 void scale6x6_c32(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
 	scale6x_c32(src, dst, sw, sh, sp, dw, dh, dp, 6); }
 
+//
+//	C 32bpp (XRGB8888) to 16bpp (RGB565) scalers, convert while scaling so
+//	a 32-bit core's frame is read once with no intermediate 16bpp buffer.
+//	each source row is converted once (NEON/SSE2 via convert_32to16, in
+//	small chunks when widening) then the finished dst row is memcpy'd
+//
+static inline void scalex_c32to16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dp, uint32_t xmul, uint32_t ymul) {
+	if (!sw||!sh||!ymul||!xmul||xmul>6) return;
+	uint32_t dwl = sw*sizeof(uint16_t)*xmul;
+	if (!sp) { sp = sw*sizeof(uint32_t); } if (!dp) { dp = dwl; }
+	if (dwl>dp) dwl = dp;
+	for (; sh>0; sh--, src=(uint8_t*)src+sp) {
+		if (xmul==1) convert_32to16(src, dst, sw, 1, sp, dp, 0);
+		else {
+			// a 512 byte chunk at a time so the 16bpp copy stays in L1, then widen it with the 16bpp scaler
+			void (* const widen[6])(void* __restrict, void* __restrict, uint32_t, uint32_t, uint32_t, uint32_t, uint32_t, uint32_t, uint32_t) = {
+				&scale1x_c16, &scale2x_c16, &scale3x_c16, &scale4x_c16, &scale5x_c16, &scale6x_c16
+			};
+			uint32_t tmp[128]; // 256 pixels, 32-bit aligned for the 16bpp scalers
+			uint16_t* __restrict d = (uint16_t*)dst;
+			for (uint32_t x=0; x<sw; x+=256, d+=256*xmul) {
+				uint32_t n = (sw-x)<256 ? (sw-x) : 256;
+				convert_32to16((uint32_t*)src + x, tmp, n, 1, 0, 0, 0);
+				widen[xmul-1](tmp, d, n, 1, 0, 0, 0, 0, 1);
+			}
+		}
+		void* __restrict row = dst; dst = (uint8_t*)dst+dp;
+		for (uint32_t i=ymul; i>1; i--, dst=(uint8_t*)dst+dp) memcpy(dst, row, dwl);
+	}
+}
+void scale1x_c32to16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp, uint32_t ymul) {
+	scalex_c32to16(src, dst, sw, sh, sp, dp, 1, ymul); }
+void scale2x_c32to16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp, uint32_t ymul) {
+	scalex_c32to16(src, dst, sw, sh, sp, dp, 2, ymul); }
+void scale3x_c32to16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp, uint32_t ymul) {
+	scalex_c32to16(src, dst, sw, sh, sp, dp, 3, ymul); }
+void scale4x_c32to16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp, uint32_t ymul) {
+	scalex_c32to16(src, dst, sw, sh, sp, dp, 4, ymul); }
+void scale5x_c32to16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp, uint32_t ymul) {
+	scalex_c32to16(src, dst, sw, sh, sp, dp, 5, ymul); }
+void scale6x_c32to16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp, uint32_t ymul) {
+	scalex_c32to16(src, dst, sw, sh, sp, dp, 6, ymul); }
+
+void scale1x1_c32to16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale1x_c32to16(src, dst, sw, sh, sp, dw, dh, dp, 1); }
+void scale1x2_c32to16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale1x_c32to16(src, dst, sw, sh, sp, dw, dh, dp, 2); }
+void scale1x3_c32to16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale1x_c32to16(src, dst, sw, sh, sp, dw, dh, dp, 3); }
+void scale1x4_c32to16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale1x_c32to16(src, dst, sw, sh, sp, dw, dh, dp, 4); }
+void scale2x1_c32to16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale2x_c32to16(src, dst, sw, sh, sp, dw, dh, dp, 1); }
+void scale2x2_c32to16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale2x_c32to16(src, dst, sw, sh, sp, dw, dh, dp, 2); }
+void scale2x3_c32to16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale2x_c32to16(src, dst, sw, sh, sp, dw, dh, dp, 3); }
+void scale2x4_c32to16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale2x_c32to16(src, dst, sw, sh, sp, dw, dh, dp, 4); }
+void scale3x1_c32to16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale3x_c32to16(src, dst, sw, sh, sp, dw, dh, dp, 1); }
+void scale3x2_c32to16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale3x_c32to16(src, dst, sw, sh, sp, dw, dh, dp, 2); }
+void scale3x3_c32to16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale3x_c32to16(src, dst, sw, sh, sp, dw, dh, dp, 3); }
+void scale3x4_c32to16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale3x_c32to16(src, dst, sw, sh, sp, dw, dh, dp, 4); }
+void scale4x1_c32to16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale4x_c32to16(src, dst, sw, sh, sp, dw, dh, dp, 1); }
+void scale4x2_c32to16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale4x_c32to16(src, dst, sw, sh, sp, dw, dh, dp, 2); }
+void scale4x3_c32to16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale4x_c32to16(src, dst, sw, sh, sp, dw, dh, dp, 3); }
+void scale4x4_c32to16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale4x_c32to16(src, dst, sw, sh, sp, dw, dh, dp, 4); }
+void scale5x1_c32to16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale5x_c32to16(src, dst, sw, sh, sp, dw, dh, dp, 1); }
+void scale5x2_c32to16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale5x_c32to16(src, dst, sw, sh, sp, dw, dh, dp, 2); }
+void scale5x3_c32to16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale5x_c32to16(src, dst, sw, sh, sp, dw, dh, dp, 3); }
+void scale5x4_c32to16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale5x_c32to16(src, dst, sw, sh, sp, dw, dh, dp, 4); }
+void scale5x5_c32to16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale5x_c32to16(src, dst, sw, sh, sp, dw, dh, dp, 5); }
+void scale6x1_c32to16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale6x_c32to16(src, dst, sw, sh, sp, dw, dh, dp, 1); }
+void scale6x2_c32to16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale6x_c32to16(src, dst, sw, sh, sp, dw, dh, dp, 2); }
+void scale6x3_c32to16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale6x_c32to16(src, dst, sw, sh, sp, dw, dh, dp, 3); }
+void scale6x4_c32to16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale6x_c32to16(src, dst, sw, sh, sp, dw, dh, dp, 4); }
+void scale6x5_c32to16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale6x_c32to16(src, dst, sw, sh, sp, dw, dh, dp, 5); }
+void scale6x6_c32to16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale6x_c32to16(src, dst, sw, sh, sp, dw, dh, dp, 6); }
+
 #ifdef HAS_NEON
 
 //
@@ -2865,6 +2974,258 @@ void scaler_n32(uint32_t xmul, uint32_t ymul, void* __restrict src, void* __rest
 
 #endif
 
+#ifdef __SSE2__
+
+//
+//	SSE2 scalers for x86 hosts, each dst row is built with pshufd/punpck
+//	from unaligned loads and stores so any x-offset or pitch works,
+//	then the other ymul-1 rows are memcpy'd. 1x is a plain memcpy so
+//	it uses the C scaler, and so do the odd 16bpp multipliers since a
+//	16-bit lane can't be repeated 3 or 5 times with SSE2 shuffles
+//
+
+#define LANES(a,b,c,d) _MM_SHUFFLE(d,c,b,a)
+
+// repeat each of the four 32-bit lanes of v rep times, 4*rep lanes out
+static inline void repeat32_s(uint32_t* d, __m128i v, uint32_t rep) {
+	__m128i* o = (__m128i*)d;
+	switch (rep) {
+		case 1:
+			_mm_storeu_si128(o+0, v);
+			break;
+		case 2:
+			_mm_storeu_si128(o+0, _mm_unpacklo_epi32(v, v));
+			_mm_storeu_si128(o+1, _mm_unpackhi_epi32(v, v));
+			break;
+		case 3:
+			_mm_storeu_si128(o+0, _mm_shuffle_epi32(v, LANES(0,0,0,1)));
+			_mm_storeu_si128(o+1, _mm_shuffle_epi32(v, LANES(1,1,2,2)));
+			_mm_storeu_si128(o+2, _mm_shuffle_epi32(v, LANES(2,3,3,3)));
+			break;
+		case 4:
+			_mm_storeu_si128(o+0, _mm_shuffle_epi32(v, LANES(0,0,0,0)));
+			_mm_storeu_si128(o+1, _mm_shuffle_epi32(v, LANES(1,1,1,1)));
+			_mm_storeu_si128(o+2, _mm_shuffle_epi32(v, LANES(2,2,2,2)));
+			_mm_storeu_si128(o+3, _mm_shuffle_epi32(v, LANES(3,3,3,3)));
+			break;
+		case 5:
+			_mm_storeu_si128(o+0, _mm_shuffle_epi32(v, LANES(0,0,0,0)));
+			_mm_storeu_si128(o+1, _mm_shuffle_epi32(v, LANES(0,1,1,1)));
+			_mm_storeu_si128(o+2, _mm_shuffle_epi32(v, LANES(1,1,2,2)));
+			_mm_storeu_si128(o+3, _mm_shuffle_epi32(v, LANES(2,2,2,3)));
+			_mm_storeu_si128(o+4, _mm_shuffle_epi32(v, LANES(3,3,3,3)));
+			break;
+		case 6:
+			_mm_storeu_si128(o+0, _mm_shuffle_epi32(v, LANES(0,0,0,0)));
+			_mm_storeu_si128(o+1, _mm_shuffle_epi32(v, LANES(0,0,1,1)));
+			_mm_storeu_si128(o+2, _mm_shuffle_epi32(v, LANES(1,1,1,1)));
+			_mm_storeu_si128(o+3, _mm_shuffle_epi32(v, LANES(2,2,2,2)));
+			_mm_storeu_si128(o+4, _mm_shuffle_epi32(v, LANES(2,2,3,3)));
+			_mm_storeu_si128(o+5, _mm_shuffle_epi32(v, LANES(3,3,3,3)));
+			break;
+	}
+}
+
+static inline void scalex_s32(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dp, uint32_t xmul, uint32_t ymul) {
+	if (!sw||!sh||!ymul) return;
+	uint32_t vw = sw & ~3, swl = sw*sizeof(uint32_t)*xmul;
+	if (!sp) { sp = sw*sizeof(uint32_t); } if (!dp) { dp = swl; }
+	for (; sh>0; sh--, src=(uint8_t*)src+sp) {
+		uint32_t* s = (uint32_t*)src;
+		uint32_t* d = (uint32_t*)dst;
+		uint32_t x = 0;
+		for (; x<vw; x+=4, d+=4*xmul) repeat32_s(d, _mm_loadu_si128((__m128i*)(s+x)), xmul);
+		for (; x<sw; x++) for (uint32_t i=xmul; i>0; i--) *d++ = s[x];
+		void* __restrict row = dst; dst = (uint8_t*)dst+dp;
+		for (uint32_t i=ymul-1; i>0; i--, dst=(uint8_t*)dst+dp) memcpy(dst, row, swl);
+	}
+}
+
+// even multipliers only, punpcklwd/punpckhwd pair each pixel into a
+// 32-bit lane then the lanes are repeated xmul/2 times
+static inline void scalex_s16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dp, uint32_t xmul, uint32_t ymul) {
+	if (!sw||!sh||!ymul) return;
+	uint32_t vw = sw & ~7, rep = xmul/2, swl = sw*sizeof(uint16_t)*xmul;
+	if (!sp) { sp = sw*sizeof(uint16_t); } if (!dp) { dp = swl; }
+	for (; sh>0; sh--, src=(uint8_t*)src+sp) {
+		uint16_t* s = (uint16_t*)src;
+		uint16_t* d = (uint16_t*)dst;
+		uint32_t x = 0;
+		for (; x<vw; x+=8, d+=8*xmul) {
+			__m128i v = _mm_loadu_si128((__m128i*)(s+x));
+			repeat32_s((uint32_t*)d, _mm_unpacklo_epi16(v, v), rep);
+			repeat32_s((uint32_t*)(d+4*xmul), _mm_unpackhi_epi16(v, v), rep);
+		}
+		for (; x<sw; x++) for (uint32_t i=xmul; i>0; i--) *d++ = s[x];
+		void* __restrict row = dst; dst = (uint8_t*)dst+dp;
+		for (uint32_t i=ymul-1; i>0; i--, dst=(uint8_t*)dst+dp) memcpy(dst, row, swl);
+	}
+}
+
+void scale1x_s16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp, uint32_t ymul) {
+	scale1x_c16(src, dst, sw, sh, sp, dw, dh, dp, ymul); }
+void scale2x_s16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp, uint32_t ymul) {
+	scalex_s16(src, dst, sw, sh, sp, dp, 2, ymul); }
+void scale3x_s16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp, uint32_t ymul) {
+	scale3x_c16(src, dst, sw, sh, sp, dw, dh, dp, ymul); }
+void scale4x_s16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp, uint32_t ymul) {
+	scalex_s16(src, dst, sw, sh, sp, dp, 4, ymul); }
+void scale5x_s16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp, uint32_t ymul) {
+	scale5x_c16(src, dst, sw, sh, sp, dw, dh, dp, ymul); }
+void scale6x_s16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp, uint32_t ymul) {
+	scalex_s16(src, dst, sw, sh, sp, dp, 6, ymul); }
+
+void scale1x_s32(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp, uint32_t ymul) {
+	scale1x_c32(src, dst, sw, sh, sp, dw, dh, dp, ymul); }
+void scale2x_s32(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp, uint32_t ymul) {
+	scalex_s32(src, dst, sw, sh, sp, dp, 2, ymul); }
+void scale3x_s32(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp, uint32_t ymul) {
+	scalex_s32(src, dst, sw, sh, sp, dp, 3, ymul); }
+void scale4x_s32(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp, uint32_t ymul) {
+	scalex_s32(src, dst, sw, sh, sp, dp, 4, ymul); }
+void scale5x_s32(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp, uint32_t ymul) {
+	scalex_s32(src, dst, sw, sh, sp, dp, 5, ymul); }
+void scale6x_s32(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp, uint32_t ymul) {
+	scalex_s32(src, dst, sw, sh, sp, dp, 6, ymul); }
+
+void scale1x1_s16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale1x_s16(src, dst, sw, sh, sp, dw, dh, dp, 1); }
+void scale1x2_s16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale1x_s16(src, dst, sw, sh, sp, dw, dh, dp, 2); }
+void scale1x3_s16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale1x_s16(src, dst, sw, sh, sp, dw, dh, dp, 3); }
+void scale1x4_s16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale1x_s16(src, dst, sw, sh, sp, dw, dh, dp, 4); }
+void scale2x1_s16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale2x_s16(src, dst, sw, sh, sp, dw, dh, dp, 1); }
+void scale2x2_s16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale2x_s16(src, dst, sw, sh, sp, dw, dh, dp, 2); }
+void scale2x3_s16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale2x_s16(src, dst, sw, sh, sp, dw, dh, dp, 3); }
+void scale2x4_s16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale2x_s16(src, dst, sw, sh, sp, dw, dh, dp, 4); }
+void scale3x1_s16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale3x_s16(src, dst, sw, sh, sp, dw, dh, dp, 1); }
+void scale3x2_s16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale3x_s16(src, dst, sw, sh, sp, dw, dh, dp, 2); }
+void scale3x3_s16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale3x_s16(src, dst, sw, sh, sp, dw, dh, dp, 3); }
+void scale3x4_s16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale3x_s16(src, dst, sw, sh, sp, dw, dh, dp, 4); }
+void scale4x1_s16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale4x_s16(src, dst, sw, sh, sp, dw, dh, dp, 1); }
+void scale4x2_s16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale4x_s16(src, dst, sw, sh, sp, dw, dh, dp, 2); }
+void scale4x3_s16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale4x_s16(src, dst, sw, sh, sp, dw, dh, dp, 3); }
+void scale4x4_s16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale4x_s16(src, dst, sw, sh, sp, dw, dh, dp, 4); }
+void scale5x1_s16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale5x_s16(src, dst, sw, sh, sp, dw, dh, dp, 1); }
+void scale5x2_s16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale5x_s16(src, dst, sw, sh, sp, dw, dh, dp, 2); }
+void scale5x3_s16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale5x_s16(src, dst, sw, sh, sp, dw, dh, dp, 3); }
+void scale5x4_s16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale5x_s16(src, dst, sw, sh, sp, dw, dh, dp, 4); }
+void scale5x5_s16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale5x_s16(src, dst, sw, sh, sp, dw, dh, dp, 5); }
+void scale6x1_s16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale6x_s16(src, dst, sw, sh, sp, dw, dh, dp, 1); }
+void scale6x2_s16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale6x_s16(src, dst, sw, sh, sp, dw, dh, dp, 2); }
+void scale6x3_s16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale6x_s16(src, dst, sw, sh, sp, dw, dh, dp, 3); }
+void scale6x4_s16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale6x_s16(src, dst, sw, sh, sp, dw, dh, dp, 4); }
+void scale6x5_s16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale6x_s16(src, dst, sw, sh, sp, dw, dh, dp, 5); }
+void scale6x6_s16(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale6x_s16(src, dst, sw, sh, sp, dw, dh, dp, 6); }
+
+void scale1x1_s32(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale1x_s32(src, dst, sw, sh, sp, dw, dh, dp, 1); }
+void scale1x2_s32(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale1x_s32(src, dst, sw, sh, sp, dw, dh, dp, 2); }
+void scale1x3_s32(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale1x_s32(src, dst, sw, sh, sp, dw, dh, dp, 3); }
+void scale1x4_s32(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale1x_s32(src, dst, sw, sh, sp, dw, dh, dp, 4); }
+void scale2x1_s32(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale2x_s32(src, dst, sw, sh, sp, dw, dh, dp, 1); }
+void scale2x2_s32(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale2x_s32(src, dst, sw, sh, sp, dw, dh, dp, 2); }
+void scale2x3_s32(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale2x_s32(src, dst, sw, sh, sp, dw, dh, dp, 3); }
+void scale2x4_s32(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale2x_s32(src, dst, sw, sh, sp, dw, dh, dp, 4); }
+void scale3x1_s32(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale3x_s32(src, dst, sw, sh, sp, dw, dh, dp, 1); }
+void scale3x2_s32(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale3x_s32(src, dst, sw, sh, sp, dw, dh, dp, 2); }
+void scale3x3_s32(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale3x_s32(src, dst, sw, sh, sp, dw, dh, dp, 3); }
+void scale3x4_s32(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale3x_s32(src, dst, sw, sh, sp, dw, dh, dp, 4); }
+void scale4x1_s32(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale4x_s32(src, dst, sw, sh, sp, dw, dh, dp, 1); }
+void scale4x2_s32(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale4x_s32(src, dst, sw, sh, sp, dw, dh, dp, 2); }
+void scale4x3_s32(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale4x_s32(src, dst, sw, sh, sp, dw, dh, dp, 3); }
+void scale4x4_s32(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale4x_s32(src, dst, sw, sh, sp, dw, dh, dp, 4); }
+void scale5x1_s32(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale5x_s32(src, dst, sw, sh, sp, dw, dh, dp, 1); }
+void scale5x2_s32(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale5x_s32(src, dst, sw, sh, sp, dw, dh, dp, 2); }
+void scale5x3_s32(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale5x_s32(src, dst, sw, sh, sp, dw, dh, dp, 3); }
+void scale5x4_s32(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale5x_s32(src, dst, sw, sh, sp, dw, dh, dp, 4); }
+void scale5x5_s32(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale5x_s32(src, dst, sw, sh, sp, dw, dh, dp, 5); }
+void scale6x1_s32(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale6x_s32(src, dst, sw, sh, sp, dw, dh, dp, 1); }
+void scale6x2_s32(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale6x_s32(src, dst, sw, sh, sp, dw, dh, dp, 2); }
+void scale6x3_s32(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale6x_s32(src, dst, sw, sh, sp, dw, dh, dp, 3); }
+void scale6x4_s32(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale6x_s32(src, dst, sw, sh, sp, dw, dh, dp, 4); }
+void scale6x5_s32(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale6x_s32(src, dst, sw, sh, sp, dw, dh, dp, 5); }
+void scale6x6_s32(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	scale6x_s32(src, dst, sw, sh, sp, dw, dh, dp, 6); }
+
+void scaler_s16(uint32_t xmul, uint32_t ymul, void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	void (* const func[6][8])(void* __restrict, void* __restrict, uint32_t, uint32_t, uint32_t, uint32_t, uint32_t, uint32_t) = {
+			{ &scale1x1_s16, &scale1x2_s16, &scale1x3_s16, &scale1x4_s16, &dummy, &dummy, &dummy, &dummy },
+			{ &scale2x1_s16, &scale2x2_s16, &scale2x3_s16, &scale2x4_s16, &dummy, &dummy, &dummy, &dummy },
+			{ &scale3x1_s16, &scale3x2_s16, &scale3x3_s16, &scale3x4_s16, &dummy, &dummy, &dummy, &dummy },
+			{ &scale4x1_s16, &scale4x2_s16, &scale4x3_s16, &scale4x4_s16, &dummy, &dummy, &dummy, &dummy },
+			{ &scale5x1_s16, &scale5x2_s16, &scale5x3_s16, &scale5x4_s16, &scale5x5_s16, &dummy, &dummy, &dummy },
+			{ &scale6x1_s16, &scale6x2_s16, &scale6x3_s16, &scale6x4_s16, &scale6x5_s16, &scale6x6_s16, &dummy, &dummy }
+		   };
+	if ((--xmul < 6)&&(--ymul < 6)) func[xmul][ymul](src, dst, sw, sh, sp, dw, dh, dp);
+	return;
+}
+
+void scaler_s32(uint32_t xmul, uint32_t ymul, void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	void (* const func[6][8])(void* __restrict, void* __restrict, uint32_t, uint32_t, uint32_t, uint32_t, uint32_t, uint32_t) = {
+			{ &scale1x1_s32, &scale1x2_s32, &scale1x3_s32, &scale1x4_s32, &dummy, &dummy, &dummy, &dummy },
+			{ &scale2x1_s32, &scale2x2_s32, &scale2x3_s32, &scale2x4_s32, &dummy, &dummy, &dummy, &dummy },
+			{ &scale3x1_s32, &scale3x2_s32, &scale3x3_s32, &scale3x4_s32, &dummy, &dummy, &dummy, &dummy },
+			{ &scale4x1_s32, &scale4x2_s32, &scale4x3_s32, &scale4x4_s32, &dummy, &dummy, &dummy, &dummy },
+			{ &scale5x1_s32, &scale5x2_s32, &scale5x3_s32, &scale5x4_s32, &scale5x5_s32, &dummy, &dummy, &dummy },
+			{ &scale6x1_s32, &scale6x2_s32, &scale6x3_s32, &scale6x4_s32, &scale6x5_s32, &scale6x6_s32, &dummy, &dummy }
+		   };
+	if ((--xmul < 6)&&(--ymul < 6)) func[xmul][ymul](src, dst, sw, sh, sp, dw, dh, dp);
+	return;
+}
+
+#endif
+
 void scaler_c16(uint32_t xmul, uint32_t ymul, void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
 	void (* const func[6][8])(void* __restrict, void* __restrict, uint32_t, uint32_t, uint32_t, uint32_t, uint32_t, uint32_t) = {
 			{ &scale1x1_c16, &scale1x2_c16, &scale1x3_c16, &scale1x4_c16, &dummy, &dummy, &dummy, &dummy },
@@ -2891,6 +3252,39 @@ void scaler_c32(uint32_t xmul, uint32_t ymul, void* __restrict src, void* __rest
 	return;
 }
 
+void scaler_c32to16(uint32_t xmul, uint32_t ymul, void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+	void (* const func[6][8])(void* __restrict, void* __restrict, uint32_t, uint32_t, uint32_t, uint32_t, uint32_t, uint32_t) = {
+			{ &scale1x1_c32to16, &scale1x2_c32to16, &scale1x3_c32to16, &scale1x4_c32to16, &dummy, &dummy, &dummy, &dummy },
+			{ &scale2x1_c32to16, &scale2x2_c32to16, &scale2x3_c32to16, &scale2x4_c32to16, &dummy, &dummy, &dummy, &dummy },
+			{ &scale3x1_c32to16, &scale3x2_c32to16, &scale3x3_c32to16, &scale3x4_c32to16, &dummy, &dummy, &dummy, &dummy },
+			{ &scale4x1_c32to16, &scale4x2_c32to16, &scale4x3_c32to16, &scale4x4_c32to16, &dummy, &dummy, &dummy, &dummy },
+			{ &scale5x1_c32to16, &scale5x2_c32to16, &scale5x3_c32to16, &scale5x4_c32to16, &scale5x5_c32to16, &dummy, &dummy, &dummy },
+			{ &scale6x1_c32to16, &scale6x2_c32to16, &scale6x3_c32to16, &scale6x4_c32to16, &scale6x5_c32to16, &scale6x6_c32to16, &dummy, &dummy }
+		   };
+	if ((--xmul < 6)&&(--ymul < 6)) func[xmul][ymul](src, dst, sw, sh, sp, dw, dh, dp);
+	return;
+}
+
+// the fastest backend this build has, picked at compile time
+void scaler_16(uint32_t xmul, uint32_t ymul, void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+#if defined(HAS_NEON)
+	scaler_n16(xmul, ymul, src, dst, sw, sh, sp, dw, dh, dp);
+#elif defined(__SSE2__)
+	scaler_s16(xmul, ymul, src, dst, sw, sh, sp, dw, dh, dp);
+#else
+	scaler_c16(xmul, ymul, src, dst, sw, sh, sp, dw, dh, dp);
+#endif
+}
+void scaler_32(uint32_t xmul, uint32_t ymul, void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
+#if defined(HAS_NEON)
+	scaler_n32(xmul, ymul, src, dst, sw, sh, sp, dw, dh, dp);
+#elif defined(__SSE2__)
+	scaler_s32(xmul, ymul, src, dst, sw, sh, sp, dw, dh, dp);
+#else
+	scaler_c32(xmul, ymul, src, dst, sw, sh, sp, dw, dh, dp);
+#endif
+}
+
 
 // from gambatte-dms
 //from RGB565
@@ -2908,22 +3302,26 @@ void scale1x_line(void* __restrict src, void* __restrict dst, uint32_t sw, uint3
 	// eg. gb has a 160 pixel wide image but 
 	// gambatte uses a 256 pixel wide buffer
 	// (only matters when using memcpy) 
-	int ip = sw * FIXED_BPP; 
-	int src_stride = 2 * sp / FIXED_BPP;
-	int dst_stride = 2 * dp / FIXED_BPP;
+	int ip = sw * sizeof(uint16_t); 
+	int src_stride = sp / sizeof(uint16_t);
+	int dst_stride = dp / sizeof(uint16_t);
 	int cpy_pitch = MIN(ip, dp);
 	
+	// even rows copied, odd rows darkened
 	uint16_t k = 0x0000;
 	uint16_t* restrict src_row = (uint16_t*)src;
 	uint16_t* restrict dst_row = (uint16_t*)dst;
 	for (int y=0; y<sh; y+=2) {
 		memcpy(dst_row, src_row, cpy_pitch);
+		if (y+1==sh) break; // odd height, no line under the last row
 		dst_row += dst_stride;
 		src_row += src_stride;
 		for (unsigned x=0; x<sw; x++) {
 			uint16_t s = *(src_row + x);
 			*(dst_row + x) = Weight3_1(s, k);
 		}
+		dst_row += dst_stride;
+		src_row += src_stride;
 	}
 }
 void scale2x_line(void* __restrict src, void* __restrict dst, uint32_t sw, uint32_t sh, uint32_t sp, uint32_t dw, uint32_t dh, uint32_t dp) {
@@ -3070,4 +3468,196 @@ void scale3x_grid(void* __restrict src, void* __restrict dst, uint32_t sw, uint3
 			dst_row += 3;
 		}
 	}
-}
\ No newline at end of file
+}
+
+///////////////////////////////
+
+// blended scaler for non-integer scales, after scale_blend from picoarch.
+// every dst pixel blends the two nearest src pixels in quarter steps
+// (0, 1/4, 1/2, 3/4, 1) on each axis. which pair and which step is
+// worked out once in scaleAA_get, a column table and a row table, so
+// scaling is a gather along each src row (done once per src row, kept
+// in a two row cache while consecutive dst rows share it) then a
+// straight blend of two of those rows per dst row
+
+static struct AA_Context {
+	uint32_t sw;
+	uint32_t sh;
+	uint32_t dw;
+	uint32_t dh;
+	
+	// per dst column, src columns a and b and which of a/avg/b to average
+	uint16_t* xa;
+	uint16_t* xb;
+	uint8_t* xp;
+	uint8_t* xq;
+	
+	// per dst row, src rows a and b and how far towards b (0-4 quarters)
+	uint16_t* ya;
+	uint16_t* yb;
+	uint8_t* yw;
+	
+	uint16_t* rows[2]; // horizontally scaled src rows, slot is src row & 1
+	int row_y[2];
+} aa;
+
+// per channel average of two 565 pixels rounding up, same result as
+// picoarch's (a+b+((a^b)&0x0821))>>1 without needing the 17th bit, so
+// it also works in 16-bit SIMD lanes
+#define AVG565_MASK 0xF7DE
+static inline uint16_t avg565(uint16_t a, uint16_t b) {
+	return (a | b) - (((a ^ b) & AVG565_MASK) >> 1);
+}
+
+#if defined(__ARM_NEON)
+static inline uint16x8_t avg565_n(uint16x8_t a, uint16x8_t b) {
+	return vsubq_u16(vorrq_u16(a, b), vshrq_n_u16(vandq_u16(veorq_u16(a, b), vdupq_n_u16(AVG565_MASK)), 1));
+}
+#elif defined(__SSE2__)
+static inline __m128i avg565_s(__m128i a, __m128i b) {
+	return _mm_sub_epi16(_mm_or_si128(a, b), _mm_srli_epi16(_mm_and_si128(_mm_xor_si128(a, b), _mm_set1_epi16(AVG565_MASK)), 1));
+}
+#endif
+
+// 1 = 3/4 a + 1/4 b, 2 = halfway, 3 = 1/4 a + 3/4 b
+static void scaleAA_blendRow(const uint16_t* __restrict a, const uint16_t* __restrict b, uint16_t* __restrict d, uint32_t n, int w) {
+	uint32_t x = 0;
+#if defined(__ARM_NEON)
+	for (; x+8<=n; x+=8) {
+		uint16x8_t va = vld1q_u16(a+x);
+		uint16x8_t vb = vld1q_u16(b+x);
+		uint16x8_t vm = avg565_n(va, vb);
+		if (w==1) vm = avg565_n(va, vm);
+		else if (w==3) vm = avg565_n(vm, vb);
+		vst1q_u16(d+x, vm);
+	}
+#elif defined(__SSE2__)
+	for (; x+8<=n; x+=8) {
+		__m128i va = _mm_loadu_si128((const __m128i*)(a+x));
+		__m128i vb = _mm_loadu_si128((const __m128i*)(b+x));
+		__m128i vm = avg565_s(va, vb);
+		if (w==1) vm = avg565_s(va, vm);
+		else if (w==3) vm = avg565_s(vm, vb);
+		_mm_storeu_si128((__m128i*)(d+x), vm);
+	}
+#endif
+	for (; x<n; x++) {
+		uint16_t m = avg565(a[x], b[x]);
+		if (w==1) m = avg565(a[x], m);
+		else if (w==3) m = avg565(m, b[x]);
+		d[x] = m;
+	}
+}
+
+static uint16_t* scaleAA_getRow(void* __restrict src, uint32_t pitch, uint32_t y) {
+	int slot = y & 1;
+	uint16_t* row = aa.rows[slot];
+	if (aa.row_y[slot]==(int)y) return row;
+	
+	const uint16_t* s = (const uint16_t*)((uint8_t*)src + y * pitch);
+	for (uint32_t x=0; x<aa.dw; x++) {
+		uint16_t v[3];
+		v[0] = s[aa.xa[x]];
+		v[2] = s[aa.xb[x]];
+		v[1] = avg565(v[0], v[2]);
+		row[x] = avg565(v[aa.xp[x]], v[aa.xq[x]]);
+	}
+	aa.row_y[slot] = y;
+	return row;
+}
+
+static void scaleAA(void* __restrict src, void* __restrict dst, uint32_t w, uint32_t h, uint32_t pitch, uint32_t dst_w, uint32_t dst_h, uint32_t dst_p) {
+	aa.row_y[0] = aa.row_y[1] = -1; // new frame
+	for (uint32_t y=0; y<aa.dh; y++, dst=(uint8_t*)dst+dst_p) {
+		int weight = aa.yw[y];
+		if (weight==0) memcpy(dst, scaleAA_getRow(src, pitch, aa.ya[y]), aa.dw * sizeof(uint16_t));
+		else if (weight==4) memcpy(dst, scaleAA_getRow(src, pitch, aa.yb[y]), aa.dw * sizeof(uint16_t));
+		else {
+			uint16_t* a = scaleAA_getRow(src, pitch, aa.ya[y]);
+			uint16_t* b = scaleAA_getRow(src, pitch, aa.yb[y]);
+			scaleAA_blendRow(a, b, dst, aa.dw, weight);
+		}
+	}
+}
+
+static inline int gcd(int a, int b) {
+	return b ? gcd(b, a % b) : a;
+}
+
+// steps through dst positions along one axis the way picoarch did and
+// records the src pair and blend step for each. a band of hard (unblended)
+// pixels either side of each src pixel is (sharpness/2)% of its width,
+// blend_bias picks the side that wins when both mid-band tests pass
+static void scaleAA_axis(uint32_t s, uint32_t d, int sharpness, int blend_bias, uint16_t* ia, uint16_t* ib, uint8_t* iw) {
+	int g = gcd(s, d);
+	int ratio_in = s / g;
+	int ratio_out = d / g;
+	int hard = (ratio_out * sharpness + 100) / 200;
+	int half = ratio_out >> 1;
+	
+	uint32_t i = 0;
+	int pos = 0;
+	for (uint32_t a=0; a<s; a++) {
+		uint32_t b = a+1<s ? a+1 : a;
+		while (pos<ratio_out && i<d) {
+			int w;
+			if (pos > ratio_out - hard) w = 4;
+			else if (pos <= hard) w = 0;
+			else if (blend_bias && pos <= half) w = 1;
+			else if (pos > ratio_out - half) w = 3;
+			else if (pos <= half) w = 1;
+			else w = 2;
+			ia[i] = a;
+			ib[i] = b;
+			iw[i] = w;
+			i += 1;
+			pos += ratio_in;
+		}
+		pos -= ratio_out;
+	}
+}
+
+void scaleAA_free(void) {
+	free(aa.xa); free(aa.xb); free(aa.xp); free(aa.xq);
+	free(aa.ya); free(aa.yb); free(aa.yw);
+	free(aa.rows[0]); free(aa.rows[1]);
+	memset(&aa, 0, sizeof(aa));
+}
+scaler_t scaleAA_get(uint32_t sw, uint32_t sh, uint32_t dw, uint32_t dh, int sharpness) {
+	scaleAA_free(); // sizes changed
+	if (!sw || !sh || !dw || !dh) return NULL;
+	if (sw>UINT16_MAX+1 || sh>UINT16_MAX+1) return NULL; // src indices are uint16_t
+	if (sharpness<0) sharpness = (sw>dw) ? 40 : 80; // picoarch's 1/5 and 1/2.5 of a pixel either side
+	if (sharpness>100) sharpness = 100;
+	
+	aa.sw = sw;
+	aa.sh = sh;
+	aa.dw = dw;
+	aa.dh = dh;
+	aa.xa = malloc(dw * sizeof(uint16_t));
+	aa.xb = malloc(dw * sizeof(uint16_t));
+	aa.xp = malloc(dw);
+	aa.xq = malloc(dw);
+	aa.ya = malloc(dh * sizeof(uint16_t));
+	aa.yb = malloc(dh * sizeof(uint16_t));
+	aa.yw = malloc(dh);
+	aa.rows[0] = malloc(dw * sizeof(uint16_t));
+	aa.rows[1] = malloc(dw * sizeof(uint16_t));
+	if (!aa.xa || !aa.xb || !aa.xp || !aa.xq || !aa.ya || !aa.yb || !aa.yw || !aa.rows[0] || !aa.rows[1]) {
+		scaleAA_free();
+		return NULL;
+	}
+	
+	// the column steps become which two of a, avg(a,b) and b to average
+	static const uint8_t p[5] = {0,0,1,1,2};
+	static const uint8_t q[5] = {0,1,1,2,2};
+	scaleAA_axis(sw, dw, sharpness, 0, aa.xa, aa.xb, aa.xp);
+	for (uint32_t x=0; x<dw; x++) {
+		int w = aa.xp[x];
+		aa.xp[x] = p[w];
+		aa.xq[x] = q[w];
+	}
+	scaleAA_axis(sh, dh, sharpness, 1, aa.ya, aa.yb, aa.yw);
+	
+	return scaleAA;
+}
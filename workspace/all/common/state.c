@@ -0,0 +1,163 @@
+#include <string.h>
+#include <zlib.h>
+
+#include "state.h"
+
+///////////////////////////////
+
+// lz4 block format, a run of sequences of a token (literal count in
+// the high nibble, match length-4 in the low, 15 meaning more follow
+// in bytes up to 255), the literals, then a little-endian 16-bit
+// offset back to the match. the last sequence is only literals and
+// is at least LZ_LAST_LITERALS long
+
+#define LZ_HASH_BITS 12
+#define LZ_MIN_MATCH 4
+#define LZ_LAST_LITERALS 5
+#define LZ_MATCH_LIMIT 12 // no match starts within this of the end
+#define LZ_MAX_OFFSET 65535
+#define LZ_BOUND(size) ((size) + (size) / 255 + 16)
+
+static uint32_t LZ_read32(const uint8_t* p) {
+	uint32_t value;
+	memcpy(&value, p, 4);
+	return value;
+}
+static uint8_t* LZ_writeLength(uint8_t* out, size_t length) { // what didn't fit in the token
+	while (length>=255) {
+		*out++ = 255;
+		length -= 255;
+	}
+	*out++ = length;
+	return out;
+}
+static uint8_t* LZ_writeSequence(uint8_t* out, const uint8_t* literals, size_t literal_count, size_t offset, size_t match_length) {
+	uint8_t* token = out++;
+	*token = (literal_count<15 ? literal_count : 15) << 4;
+	if (literal_count>=15) out = LZ_writeLength(out, literal_count - 15);
+	memcpy(out, literals, literal_count);
+	out += literal_count;
+	if (!match_length) return out; // last sequence
+	
+	*out++ = offset;
+	*out++ = offset >> 8;
+	match_length -= LZ_MIN_MATCH;
+	*token |= match_length<15 ? match_length : 15;
+	if (match_length>=15) out = LZ_writeLength(out, match_length - 15);
+	return out;
+}
+static size_t LZ_compress(const uint8_t* in, size_t size, uint8_t* out) { // out holds LZ_BOUND(size)
+	uint32_t table[1<<LZ_HASH_BITS] = {0}; // last position of each hashed 4 bytes
+	const uint8_t* end = in + size;
+	const uint8_t* match_end = end - LZ_LAST_LITERALS;
+	const uint8_t* ip = in;
+	const uint8_t* anchor = in; // first literal not yet written
+	uint8_t* op = out;
+	
+	if (size>LZ_MATCH_LIMIT) {
+		while (ip<end - LZ_MATCH_LIMIT) {
+			uint32_t sequence = LZ_read32(ip);
+			uint32_t hash = (sequence * 2654435761u) >> (32 - LZ_HASH_BITS);
+			const uint8_t* ref = in + table[hash];
+			table[hash] = ip - in;
+			if (ref>=ip || ip-ref>LZ_MAX_OFFSET || LZ_read32(ref)!=sequence) {
+				ip += 1 + ((ip - anchor) >> 6); // skip faster through data that won't compress
+				continue;
+			}
+			
+			while (ip>anchor && ref>in && ip[-1]==ref[-1]) {
+				ip--;
+				ref--;
+			}
+			size_t length = LZ_MIN_MATCH;
+			while (ip+length<match_end && ip[length]==ref[length]) length++;
+			
+			op = LZ_writeSequence(op, anchor, ip - anchor, ip - ref, length);
+			ip += length;
+			anchor = ip;
+		}
+	}
+	op = LZ_writeSequence(op, anchor, end - anchor, 0, 0);
+	return op - out;
+}
+static int LZ_readLength(const uint8_t** in, const uint8_t* in_end, size_t* length) {
+	uint8_t byte;
+	do {
+		if (*in>=in_end) return -1;
+		byte = *(*in)++;
+		*length += byte;
+	} while (byte==255);
+	return 0;
+}
+static int LZ_decompress(const uint8_t* in, size_t in_size, uint8_t* out, size_t out_size) { // returns 0 if in decodes to exactly out_size bytes
+	const uint8_t* in_end = in + in_size;
+	uint8_t* op = out;
+	uint8_t* out_end = out + out_size;
+	while (in<in_end) {
+		uint8_t token = *in++;
+		size_t literal_count = token >> 4;
+		if (literal_count==15 && LZ_readLength(&in, in_end, &literal_count)) return -1;
+		if (literal_count>(size_t)(in_end-in) || literal_count>(size_t)(out_end-op)) return -1;
+		memcpy(op, in, literal_count);
+		op += literal_count;
+		in += literal_count;
+		if (in==in_end) break; // last sequence
+		
+		if (in_end-in<2) return -1;
+		size_t offset = in[0] | in[1] << 8;
+		in += 2;
+		if (!offset || offset>(size_t)(op-out)) return -1;
+		size_t length = token & 15;
+		if (length==15 && LZ_readLength(&in, in_end, &length)) return -1;
+		length += LZ_MIN_MATCH;
+		if (length>(size_t)(out_end-op)) return -1;
+		
+		const uint8_t* ref = op - offset;
+		if (offset>=length) memcpy(op, ref, length);
+		else for (size_t i=0; i<length; i++) op[i] = ref[i]; // overlapping, a repeating pattern
+		op += length;
+	}
+	return op==out_end ? 0 : -1;
+}
+
+///////////////////////////////
+
+size_t STATE_encodeBound(size_t size) {
+	return sizeof(StateHeader) + LZ_BOUND(size);
+}
+size_t STATE_encode(const void* state, size_t size, const char* core, void* out) {
+	if (!size || size>UINT32_MAX - LZ_BOUND(0)) return 0;
+	
+	StateHeader* header = out;
+	memset(header, 0, sizeof(StateHeader));
+	memcpy(header->magic, STATE_MAGIC, 4);
+	header->version = STATE_VERSION;
+	strncpy(header->core, core, sizeof(header->core)-1);
+	header->size = size;
+	header->compressed_size = LZ_compress(state, size, (uint8_t*)out + sizeof(StateHeader));
+	header->checksum = crc32(0, state, size);
+	
+	return sizeof(StateHeader) + header->compressed_size;
+}
+int STATE_readHeader(const void* data, size_t size, StateHeader* header) {
+	if (size<sizeof(StateHeader) || memcmp(data, STATE_MAGIC, 4)) return 1;
+	memcpy(header, data, sizeof(StateHeader));
+	
+	// nothing decodes to nothing and neither codec expands past its bound
+	size_t bound = header->version==STATE_VERSION_ZLIB ? compressBound(header->size) : LZ_BOUND((size_t)header->size);
+	if (!header->size || !header->compressed_size || header->compressed_size>bound) return -1;
+	return 0;
+}
+int STATE_decode(const StateHeader* header, const void* compressed, void* state) {
+	if (header->version==STATE_VERSION) {
+		if (LZ_decompress(compressed, header->compressed_size, state, header->size)) return -1;
+	}
+	else if (header->version==STATE_VERSION_ZLIB) {
+		uLongf size = header->size;
+		if (uncompress(state, &size, compressed, header->compressed_size)!=Z_OK || size!=header->size) return -1;
+	}
+	else return -1;
+	
+	if (crc32(0, state, header->size)!=header->checksum) return -2;
+	return 0;
+}
@@ -0,0 +1,33 @@
+#ifndef STATE_H
+#define STATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+//
+//	compressed save state container, a small header ahead of the
+//	compressed serialize() blob. legacy states are just the blob,
+//	without the header. version 2 states are lz4 block format
+//	(greedy, fast to write and several times faster to read than
+//	zlib), version 1 states are zlib and can still be read
+//
+
+#define STATE_MAGIC "MNST"
+#define STATE_VERSION 2
+#define STATE_VERSION_ZLIB 1
+
+typedef struct StateHeader { // little-endian, like every device we run on
+	char magic[4];
+	uint32_t version;
+	char core[32]; // core name, informational
+	uint32_t size; // uncompressed
+	uint32_t compressed_size;
+	uint32_t checksum; // crc32 of the uncompressed data
+} StateHeader;
+
+size_t STATE_encodeBound(size_t size); // worst case STATE_encode() output
+size_t STATE_encode(const void* state, size_t size, const char* core, void* out); // returns bytes written to out, 0 on failure
+int STATE_readHeader(const void* data, size_t size, StateHeader* header); // returns 0 for a usable header, 1 for a legacy state and -1 for a corrupt header
+int STATE_decode(const StateHeader* header, const void* compressed, void* state); // compressed holds header->compressed_size bytes and state header->size. returns 0 on success, -1 on bad data or an unknown version and -2 on a checksum mismatch
+
+#endif
@@ -6,7 +6,10 @@
 #include <fcntl.h>
 #include <math.h>
 #include <ctype.h>
+#include <errno.h>
 #include <sys/time.h>
+#include <sched.h>
+#include <pthread.h>
 #include "defines.h"
 #include "utils.h"
 
@@ -190,6 +193,24 @@ void putInt(char* path, int value) {
 	sprintf(buffer, "%d", value);
 	putFile(path, buffer);
 }
+uint64_t hash64(void* data, size_t size) {
+	// not cryptographic, just a quick way to tell if a buffer changed
+	uint8_t* bytes = data;
+	uint64_t hash = 0x9E3779B97F4A7C15ull ^ size;
+	while (size>=8) {
+		uint64_t word;
+		memcpy(&word, bytes, 8);
+		hash = (hash ^ word) * 0xFF51AFD7ED558CCDull;
+		hash ^= hash >> 32;
+		bytes += 8;
+		size -= 8;
+	}
+	while (size--) hash = (hash ^ *bytes++) * 0x100000001B3ull;
+	hash ^= hash >> 33;
+	hash *= 0xC4CEB9FE1A85EC53ull;
+	hash ^= hash >> 33;
+	return hash;
+}
 
 uint64_t getMicroseconds(void) {
     uint64_t ret;
@@ -201,4 +222,11 @@ uint64_t getMicroseconds(void) {
     ret += (uint64_t)tv.tv_usec;
 
     return ret;
-}
\ No newline at end of file
+}
+int pinThread(int cpu) {
+	if (cpu<0 || cpu>=sysconf(_SC_NPROCESSORS_CONF)) return -1;
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) ? -1 : 0;
+}
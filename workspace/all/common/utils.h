@@ -25,6 +25,8 @@ void getFile(char* path, char* buffer, size_t buffer_size);
 void putInt(char* path, int value);
 int getInt(char* path);
 
+uint64_t hash64(void* data, size_t size);
 uint64_t getMicroseconds(void);
+int pinThread(int cpu); // pins the calling thread, returns 0 on success
 
 #endif
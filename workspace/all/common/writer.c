@@ -0,0 +1,162 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include "writer.h"
+
+///////////////////////////////
+
+static struct Writer_Context {
+	pthread_t pt;
+	pthread_mutex_t mx;
+	pthread_cond_t cv;
+	WriterJob jobs[WRITER_BUFFERS];
+	int next; // next job to hand out
+	int current; // next job to write
+	int started;
+	int quit;
+} writer = {
+	.mx = PTHREAD_MUTEX_INITIALIZER,
+	.cv = PTHREAD_COND_INITIALIZER,
+};
+
+static uint64_t Writer_now(void) {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+static void Writer_write(WriterJob* job) {
+	uint64_t then = Writer_now();
+	void* data = job->data;
+	size_t size = job->size;
+	if (job->encode && !(data=job->encode(job, &size))) {
+		data = job->data; // encode reports its own errors, write it as is
+		size = job->size;
+	}
+	int error = Writer_putFile(job->path, data, size) ? errno : 0;
+	job->elapsed = Writer_now() - then;
+	if (job->done) job->done(job, error);
+}
+static void* Writer_thread(void* arg) {
+	pthread_mutex_lock(&writer.mx);
+	while (1) {
+		WriterJob* job = &writer.jobs[writer.current];
+		if (!job->pending) {
+			if (writer.quit) break;
+			pthread_cond_wait(&writer.cv, &writer.mx);
+			continue;
+		}
+		pthread_mutex_unlock(&writer.mx);
+		
+		Writer_write(job);
+		
+		pthread_mutex_lock(&writer.mx);
+		job->pending = 0;
+		writer.current = (writer.current + 1) % WRITER_BUFFERS;
+		pthread_cond_broadcast(&writer.cv);
+	}
+	pthread_mutex_unlock(&writer.mx);
+	return NULL;
+}
+
+WriterJob* Writer_acquire(size_t size) {
+	pthread_mutex_lock(&writer.mx);
+	WriterJob* job = &writer.jobs[writer.next];
+	while (job->pending) pthread_cond_wait(&writer.cv, &writer.mx); // both buffers in flight
+	pthread_mutex_unlock(&writer.mx);
+	
+	if (job->capacity<size) {
+		void* data = realloc(job->data, size);
+		if (!data) return NULL;
+		job->data = data;
+		job->capacity = size;
+	}
+	job->size = size;
+	job->encode = NULL;
+	job->done = NULL;
+	job->userdata = NULL;
+	return job;
+}
+void Writer_submit(WriterJob* job, char* path) {
+	snprintf(job->path, sizeof(job->path), "%s", path);
+	pthread_mutex_lock(&writer.mx);
+	if (!writer.started) writer.started = !pthread_create(&writer.pt, NULL, Writer_thread, NULL);
+	if (!writer.started) { // write it ourselves
+		pthread_mutex_unlock(&writer.mx);
+		Writer_write(job);
+		return;
+	}
+	job->pending = 1;
+	writer.next = (writer.next + 1) % WRITER_BUFFERS;
+	pthread_cond_broadcast(&writer.cv);
+	pthread_mutex_unlock(&writer.mx);
+}
+void Writer_flush(void) {
+	pthread_mutex_lock(&writer.mx);
+	for (int i=0; i<WRITER_BUFFERS; i++) {
+		while (writer.jobs[i].pending) pthread_cond_wait(&writer.cv, &writer.mx);
+	}
+	pthread_mutex_unlock(&writer.mx);
+}
+void Writer_quit(void) {
+	if (writer.started) {
+		pthread_mutex_lock(&writer.mx);
+		writer.quit = 1;
+		pthread_cond_broadcast(&writer.cv);
+		pthread_mutex_unlock(&writer.mx);
+		pthread_join(writer.pt, NULL);
+		writer.started = 0;
+		writer.quit = 0;
+	}
+	for (int i=0; i<WRITER_BUFFERS; i++) {
+		if (writer.jobs[i].data) free(writer.jobs[i].data);
+		if (writer.jobs[i].encoded) free(writer.jobs[i].encoded);
+		writer.jobs[i].data = NULL;
+		writer.jobs[i].encoded = NULL;
+		writer.jobs[i].capacity = 0;
+		writer.jobs[i].encoded_capacity = 0;
+	}
+}
+
+int Writer_putFile(char* path, void* data, size_t size) {
+	// write next to the real file then swap it in so a
+	// crash or power loss never leaves a half written file
+	char tmp_path[WRITER_MAX_PATH + 4];
+	snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+	
+	int fd = open(tmp_path, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+	if (fd<0) return -1;
+	
+	uint8_t* next = data;
+	while (size) {
+		ssize_t written = write(fd, next, size);
+		if (written<0) {
+			if (errno==EINTR) continue;
+			goto error;
+		}
+		next += written;
+		size -= written;
+	}
+	
+	if (fsync(fd)) goto error;
+	if (close(fd)) {
+		fd = -1;
+		goto error;
+	}
+	if (rename(tmp_path, path)) {
+		fd = -1;
+		goto error;
+	}
+	return 0;
+error:;
+	int error = errno; // for the caller, not whatever cleaning up sets
+	if (fd>=0) close(fd);
+	unlink(tmp_path);
+	errno = error;
+	return -1;
+}
@@ -0,0 +1,39 @@
+#ifndef WRITER_H
+#define WRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+//
+//	writes files on a background thread. the caller fills one of a
+//	pair of reusable buffers and hands it off, the writer thread does
+//	the (slow, sd card) io and swaps the new file in atomically with
+//	Writer_putFile(), so the caller never waits on the disk unless
+//	both buffers are still in flight
+//
+
+#define WRITER_BUFFERS 2
+#define WRITER_MAX_PATH 512
+
+typedef struct WriterJob {
+	char path[WRITER_MAX_PATH];
+	void* data;
+	size_t size;
+	size_t capacity;
+	void* (*encode)(struct WriterJob* job, size_t* size); // optional, runs on the writer thread, NULL to write data as is
+	void* encoded; // scratch for encode
+	size_t encoded_capacity;
+	void (*done)(struct WriterJob* job, int error); // optional, on the writer thread once the file is written (error 0) or not (an errno)
+	void* userdata; // for done
+	uint64_t elapsed; // us spent encoding and writing, for done
+	int pending; // owned by the writer thread while set
+} WriterJob;
+
+WriterJob* Writer_acquire(size_t size); // returns a buffer of at least size bytes with encode and done cleared, NULL on failure
+void Writer_submit(WriterJob* job, char* path); // writes it on the calling thread if the writer thread can't start
+void Writer_flush(void); // waits for everything submitted so far to hit the disk
+void Writer_quit(void);
+
+int Writer_putFile(char* path, void* data, size_t size); // via path.tmp, fsyncing only that file, returns 0 on success
+
+#endif
@@ -0,0 +1,528 @@
+#define _FILE_OFFSET_BITS 64 // for archives over 2GB on 32-bit platforms
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <zlib.h>
+#include <pthread.h>
+#include "zip.h"
+
+///////////////////////////////////////
+
+#define ZIP_LOCAL_HEADER_SIZE 30
+#define ZIP_CENTRAL_HEADER_SIZE 46
+#define ZIP_EOCD_SIZE 22
+#define ZIP_EOCD64_SIZE 56
+#define ZIP_EOCD64_LOCATOR_SIZE 20
+#define ZIP_MAX_COMMENT 65535
+
+#define ZIP_LOCAL_SIGNATURE 0x04034b50
+#define ZIP_CENTRAL_SIGNATURE 0x02014b50
+#define ZIP_EOCD_SIGNATURE 0x06054b50
+#define ZIP_EOCD64_SIGNATURE 0x06064b50
+#define ZIP_EOCD64_LOCATOR_SIGNATURE 0x07064b50
+
+#define ZIP_EXTRA_ZIP64 0x0001
+
+#define ZIP_MIN(a,b) ((a)<(b)?(a):(b))
+#define ZIP_CHUNK_SIZE 65536
+#define ZIP_PIPE_SIZE (1024 * 1024) // per buffer
+#define ZIP_PIPE_DEPTH 2 // buffers per stage
+#define ZIP_PIPE_MIN (4 * 1024 * 1024) // smaller members inflate on the calling thread, by default
+#define ZIP_LE_READ16(buf) ((uint16_t)(((uint8_t *)(buf))[1] << 8 | ((uint8_t *)(buf))[0]))
+#define ZIP_LE_READ32(buf) ((uint32_t)(((uint8_t *)(buf))[3] << 24 | ((uint8_t *)(buf))[2] << 16 | ((uint8_t *)(buf))[1] << 8 | ((uint8_t *)(buf))[0]))
+#define ZIP_LE_READ64(buf) ((uint64_t)ZIP_LE_READ32((uint8_t *)(buf)+4) << 32 | ZIP_LE_READ32(buf))
+
+///////////////////////////////////////
+
+static uint64_t zip_pipe_min = ZIP_PIPE_MIN;
+
+static int ZIP_readAt(FILE* file, uint64_t offset, void* buffer, size_t size) {
+	if (fseeko(file, offset, SEEK_SET)) return -1;
+	return size==fread(buffer, 1, size, file) ? 0 : -1;
+}
+
+static char* ZIP_getExtension(char* name) {
+	char* ext = strrchr(name, '.');
+	if (!ext || strchr(ext, '/')) return NULL;
+	return ext+1;
+}
+static int ZIP_hashExtension(char* ext) {
+	uint32_t hash = 5381;
+	while (*ext) hash = hash * 33 + tolower(*ext++);
+	return hash % ZIP_EXT_BUCKETS;
+}
+
+///////////////////////////////////////
+
+static int ZIP_findDirectory(FILE* file, uint64_t* cd_offset, uint64_t* cd_size, uint64_t* count) {
+	if (fseeko(file, 0, SEEK_END)) return -1;
+	uint64_t file_size = ftello(file);
+	if (file_size<ZIP_EOCD_SIZE) return -1;
+
+	// the eocd record is at the very end, followed only by an optional comment
+	size_t tail_size = ZIP_MIN(file_size, ZIP_EOCD_SIZE + ZIP_MAX_COMMENT);
+	uint64_t tail_offset = file_size - tail_size;
+	uint8_t* tail = malloc(tail_size);
+	if (!tail) return -1;
+	if (ZIP_readAt(file, tail_offset, tail, tail_size)) goto error;
+
+	uint8_t* eocd = NULL;
+	for (int i=tail_size-ZIP_EOCD_SIZE; i>=0; i--) {
+		if (ZIP_LE_READ32(tail+i)==ZIP_EOCD_SIGNATURE) {
+			eocd = tail+i;
+			break;
+		}
+	}
+	if (!eocd) goto error;
+
+	*count = ZIP_LE_READ16(eocd+10);
+	*cd_size = ZIP_LE_READ32(eocd+12);
+	*cd_offset = ZIP_LE_READ32(eocd+16);
+
+	// zip64 archives put a locator right before the eocd
+	uint64_t eocd_offset = tail_offset + (eocd - tail);
+	if (eocd_offset>=ZIP_EOCD64_LOCATOR_SIZE) {
+		uint8_t locator[ZIP_EOCD64_LOCATOR_SIZE];
+		if (!ZIP_readAt(file, eocd_offset-ZIP_EOCD64_LOCATOR_SIZE, locator, ZIP_EOCD64_LOCATOR_SIZE) && ZIP_LE_READ32(locator)==ZIP_EOCD64_LOCATOR_SIGNATURE) {
+			uint8_t eocd64[ZIP_EOCD64_SIZE];
+			if (ZIP_readAt(file, ZIP_LE_READ64(locator+8), eocd64, ZIP_EOCD64_SIZE) || ZIP_LE_READ32(eocd64)!=ZIP_EOCD64_SIGNATURE) goto error;
+			*count = ZIP_LE_READ64(eocd64+32);
+			*cd_size = ZIP_LE_READ64(eocd64+40);
+			*cd_offset = ZIP_LE_READ64(eocd64+48);
+		}
+	}
+
+	free(tail);
+	return (*cd_offset + *cd_size <= file_size) ? 0 : -1;
+error:
+	free(tail);
+	return -1;
+}
+
+static void ZIP_readExtra(ZIP_Member* member, uint8_t* extra, uint16_t len) {
+	while (len>=4) {
+		uint16_t id = ZIP_LE_READ16(extra);
+		uint16_t size = ZIP_LE_READ16(extra+2);
+		if (size+4>len) return;
+
+		if (id==ZIP_EXTRA_ZIP64) {
+			// only the fields saturated in the central header are present, in this order
+			uint8_t* field = extra+4;
+			uint8_t* end = field+size;
+			if (member->size==0xFFFFFFFF && field+8<=end) {
+				member->size = ZIP_LE_READ64(field);
+				field += 8;
+			}
+			if (member->compressed_size==0xFFFFFFFF && field+8<=end) {
+				member->compressed_size = ZIP_LE_READ64(field);
+				field += 8;
+			}
+			if (member->offset==0xFFFFFFFF && field+8<=end) {
+				member->offset = ZIP_LE_READ64(field);
+			}
+			return;
+		}
+
+		extra += size+4;
+		len -= size+4;
+	}
+}
+
+ZIP_Archive* ZIP_open(char* path) {
+	uint8_t* cd = NULL;
+	ZIP_Archive* zip = calloc(1, sizeof(ZIP_Archive));
+	if (!zip) return NULL;
+	for (int i=0; i<ZIP_EXT_BUCKETS; i++) zip->buckets[i] = -1;
+
+	zip->file = fopen(path, "r");
+	if (!zip->file) goto error;
+
+	uint64_t cd_offset, cd_size, count;
+	if (ZIP_findDirectory(zip->file, &cd_offset, &cd_size, &count)) goto error;
+	if (count>cd_size/ZIP_CENTRAL_HEADER_SIZE) goto error;
+
+	cd = malloc(cd_size);
+	zip->members = calloc(count?count:1, sizeof(ZIP_Member));
+	zip->names = malloc(cd_size); // names can't be longer than the directory itself
+	if (!cd || !zip->members || !zip->names) goto error;
+	if (ZIP_readAt(zip->file, cd_offset, cd, cd_size)) goto error;
+
+	uint8_t* header = cd;
+	uint8_t* end = cd + cd_size;
+	char* name = zip->names;
+	for (uint64_t i=0; i<count; i++) {
+		if (header+ZIP_CENTRAL_HEADER_SIZE>end || ZIP_LE_READ32(header)!=ZIP_CENTRAL_SIGNATURE) goto error;
+
+		uint16_t name_len = ZIP_LE_READ16(header+28);
+		uint16_t extra_len = ZIP_LE_READ16(header+30);
+		uint16_t comment_len = ZIP_LE_READ16(header+32);
+		uint8_t* next = header + ZIP_CENTRAL_HEADER_SIZE + name_len + extra_len + comment_len;
+		if (next>end) goto error;
+
+		// skip directories
+		if (name_len && header[ZIP_CENTRAL_HEADER_SIZE+name_len-1]=='/') {
+			header = next;
+			continue;
+		}
+
+		ZIP_Member* member = &zip->members[zip->count++];
+		member->flags = ZIP_LE_READ16(header+8);
+		member->method = ZIP_LE_READ16(header+10);
+		member->crc = ZIP_LE_READ32(header+16);
+		member->compressed_size = ZIP_LE_READ32(header+20);
+		member->size = ZIP_LE_READ32(header+24);
+		member->offset = ZIP_LE_READ32(header+42);
+		ZIP_readExtra(member, header+ZIP_CENTRAL_HEADER_SIZE+name_len, extra_len);
+
+		memcpy(name, header+ZIP_CENTRAL_HEADER_SIZE, name_len);
+		name[name_len] = '\0';
+		member->name = name;
+		name += name_len+1;
+
+		header = next;
+	}
+	free(cd);
+
+	// index by extension, walking backwards so each chain is in archive order
+	for (int i=zip->count-1; i>=0; i--) {
+		ZIP_Member* member = &zip->members[i];
+		char* ext = ZIP_getExtension(member->name);
+		member->next = -1;
+		if (!ext) continue;
+
+		int bucket = ZIP_hashExtension(ext);
+		member->next = zip->buckets[bucket];
+		zip->buckets[bucket] = i;
+	}
+
+	return zip;
+error:
+	if (cd) free(cd);
+	ZIP_close(zip);
+	return NULL;
+}
+void ZIP_close(ZIP_Archive* zip) {
+	if (!zip) return;
+	if (zip->file) fclose(zip->file);
+	if (zip->members) free(zip->members);
+	if (zip->names) free(zip->names);
+	free(zip);
+}
+
+ZIP_Member* ZIP_find(ZIP_Archive* zip, char* name) {
+	for (int i=0; i<zip->count; i++) {
+		if (!strcmp(zip->members[i].name, name)) return &zip->members[i];
+	}
+	return NULL;
+}
+ZIP_Member* ZIP_findExtension(ZIP_Archive* zip, char* ext) {
+	for (int i=zip->buckets[ZIP_hashExtension(ext)]; i>=0; i=zip->members[i].next) {
+		ZIP_Member* member = &zip->members[i];
+		if (!strcasecmp(ZIP_getExtension(member->name), ext)) return member;
+	}
+	return NULL;
+}
+
+///////////////////////////////////////
+
+static int ZIP_seekData(ZIP_Archive* zip, ZIP_Member* member) {
+	// the local header's name and extra lengths can differ from the central directory's
+	uint8_t header[ZIP_LOCAL_HEADER_SIZE];
+	if (ZIP_readAt(zip->file, member->offset, header, ZIP_LOCAL_HEADER_SIZE)) return -1;
+	if (ZIP_LE_READ32(header)!=ZIP_LOCAL_SIGNATURE) return -1;
+	return fseeko(zip->file, ZIP_LE_READ16(header+26) + ZIP_LE_READ16(header+28), SEEK_CUR);
+}
+
+static int ZIP_copy(FILE* zip, FILE* dst, uint8_t* mem, uint64_t size) { // uncompressed
+	if (mem) return size==fread(mem, 1, size, zip) ? 0 : -1;
+
+	uint8_t buffer[ZIP_CHUNK_SIZE];
+	while (size) {
+		size_t sz = ZIP_MIN(size, ZIP_CHUNK_SIZE);
+		if (sz!= fread(buffer, 1, sz, zip)) return -1;
+		if (sz!=fwrite(buffer, 1, sz, dst)) return -1;
+		size -= sz;
+	}
+	return 0;
+}
+static int ZIP_inflate(FILE* zip, FILE* dst, uint8_t* mem, uint64_t size, uint64_t dst_size) { // compressed
+	z_stream stream = {0};
+	size_t have = 0;
+	uint8_t  in[ZIP_CHUNK_SIZE];
+	uint8_t out[ZIP_CHUNK_SIZE];
+	uint8_t scratch;
+	int ret = -1;
+
+	ret = inflateInit2(&stream, -MAX_WBITS);
+	if (ret != Z_OK)
+		return ret;
+
+	do {
+		size_t insize = ZIP_MIN(size, ZIP_CHUNK_SIZE);
+
+		stream.avail_in = fread(in, 1, insize, zip);
+		if (ferror(zip)) {
+			(void)inflateEnd(&stream);
+			return Z_ERRNO;
+		}
+
+		if (!stream.avail_in)
+			break;
+		stream.next_in = in;
+
+		do {
+			// inflate straight into memory when we have it
+			uint8_t* next = mem ? mem + stream.total_out : out;
+			size_t avail = mem ? ZIP_MIN(dst_size - stream.total_out, ZIP_CHUNK_SIZE) : ZIP_CHUNK_SIZE;
+			int full = !avail; // only the end of stream marker may be left
+			if (full) {
+				next = &scratch;
+				avail = 1;
+			}
+			stream.avail_out = avail;
+			stream.next_out = next;
+
+			ret = inflate(&stream, Z_NO_FLUSH);
+			if (full && !stream.avail_out) ret = Z_DATA_ERROR; // more data than advertised
+			switch(ret) {
+				case Z_NEED_DICT:
+					ret = Z_DATA_ERROR;
+				case Z_DATA_ERROR:
+				case Z_MEM_ERROR:
+					(void)inflateEnd(&stream);
+					return ret;
+			}
+
+			have = avail - stream.avail_out;
+			if (!mem && (fwrite(out, 1, have, dst) != have || ferror(dst))) {
+				(void)inflateEnd(&stream);
+				return Z_ERRNO;
+			}
+		} while (stream.avail_out == 0 && ret != Z_STREAM_END);
+
+		size -= insize;
+	} while (size && ret != Z_STREAM_END);
+
+	(void)inflateEnd(&stream);
+
+	if (ret == Z_STREAM_END && stream.total_out==dst_size) {
+		return Z_OK;
+	} else {
+		return Z_DATA_ERROR;
+	}
+}
+
+///////////////////////////////////////
+// pipelined inflate for big members
+// reader thread -> inflate (calling thread) -> writer thread
+// deflate can't be split without an index of restart points so
+// inflate itself stays serial, but it no longer waits on io
+
+typedef struct ZIP_Pipe {
+	pthread_mutex_t mx;
+	pthread_cond_t cv;
+	uint8_t* buffers[ZIP_PIPE_DEPTH];
+	size_t sizes[ZIP_PIPE_DEPTH];
+	int head; // next buffer to fill
+	int tail; // next buffer to drain
+	int count; // filled buffers
+	int done; // producer has nothing more to add
+	int abort; // consumer gave up
+} ZIP_Pipe;
+
+static int ZIP_Pipe_init(ZIP_Pipe* pipe) {
+	memset(pipe, 0, sizeof(ZIP_Pipe));
+	pthread_mutex_init(&pipe->mx, NULL);
+	pthread_cond_init(&pipe->cv, NULL);
+	for (int i=0; i<ZIP_PIPE_DEPTH; i++) {
+		pipe->buffers[i] = malloc(ZIP_PIPE_SIZE);
+		if (!pipe->buffers[i]) return -1;
+	}
+	return 0;
+}
+static void ZIP_Pipe_quit(ZIP_Pipe* pipe) {
+	for (int i=0; i<ZIP_PIPE_DEPTH; i++) {
+		if (pipe->buffers[i]) free(pipe->buffers[i]);
+	}
+	pthread_cond_destroy(&pipe->cv);
+	pthread_mutex_destroy(&pipe->mx);
+}
+
+static uint8_t* ZIP_Pipe_acquire(ZIP_Pipe* pipe) { // producer, NULL if aborted
+	pthread_mutex_lock(&pipe->mx);
+	while (pipe->count==ZIP_PIPE_DEPTH && !pipe->abort) pthread_cond_wait(&pipe->cv, &pipe->mx);
+	uint8_t* buffer = pipe->abort ? NULL : pipe->buffers[pipe->head];
+	pthread_mutex_unlock(&pipe->mx);
+	return buffer;
+}
+static void ZIP_Pipe_commit(ZIP_Pipe* pipe, size_t size, int done) { // producer
+	pthread_mutex_lock(&pipe->mx);
+	if (size) {
+		pipe->sizes[pipe->head] = size;
+		pipe->head = (pipe->head + 1) % ZIP_PIPE_DEPTH;
+		pipe->count += 1;
+	}
+	pipe->done = done;
+	pthread_cond_signal(&pipe->cv);
+	pthread_mutex_unlock(&pipe->mx);
+}
+static uint8_t* ZIP_Pipe_peek(ZIP_Pipe* pipe, size_t* size) { // consumer, NULL once drained
+	pthread_mutex_lock(&pipe->mx);
+	while (!pipe->count && !pipe->done) pthread_cond_wait(&pipe->cv, &pipe->mx);
+	uint8_t* buffer = NULL;
+	if (pipe->count) {
+		buffer = pipe->buffers[pipe->tail];
+		*size = pipe->sizes[pipe->tail];
+	}
+	pthread_mutex_unlock(&pipe->mx);
+	return buffer;
+}
+static void ZIP_Pipe_release(ZIP_Pipe* pipe) { // consumer
+	pthread_mutex_lock(&pipe->mx);
+	pipe->tail = (pipe->tail + 1) % ZIP_PIPE_DEPTH;
+	pipe->count -= 1;
+	pthread_cond_signal(&pipe->cv);
+	pthread_mutex_unlock(&pipe->mx);
+}
+static void ZIP_Pipe_abort(ZIP_Pipe* pipe) { // consumer
+	pthread_mutex_lock(&pipe->mx);
+	pipe->abort = 1;
+	pthread_cond_signal(&pipe->cv);
+	pthread_mutex_unlock(&pipe->mx);
+}
+
+typedef struct ZIP_Job {
+	ZIP_Pipe in;
+	ZIP_Pipe out;
+	FILE* src;
+	FILE* dst;
+	uint64_t size; // compressed bytes left to read
+	int error;
+} ZIP_Job;
+
+static void* ZIP_readThread(void* arg) {
+	ZIP_Job* job = arg;
+	while (job->size) {
+		uint8_t* buffer = ZIP_Pipe_acquire(&job->in);
+		if (!buffer) break;
+
+		size_t sz = ZIP_MIN(job->size, ZIP_PIPE_SIZE);
+		if (sz!=fread(buffer, 1, sz, job->src)) {
+			job->error = 1;
+			break;
+		}
+		job->size -= sz;
+		ZIP_Pipe_commit(&job->in, sz, !job->size);
+	}
+	ZIP_Pipe_commit(&job->in, 0, 1);
+	return NULL;
+}
+static void* ZIP_writeThread(void* arg) {
+	ZIP_Job* job = arg;
+	uint8_t* buffer;
+	size_t size;
+	while ((buffer=ZIP_Pipe_peek(&job->out, &size))) {
+		if (size!=fwrite(buffer, 1, size, job->dst)) {
+			job->error = 1;
+			ZIP_Pipe_abort(&job->out);
+			break;
+		}
+		ZIP_Pipe_release(&job->out);
+	}
+	return NULL;
+}
+
+static int ZIP_inflatePipelined(FILE* zip, FILE* dst, uint8_t* mem, uint64_t size, uint64_t dst_size) {
+	z_stream stream = {0};
+	int ret = Z_DATA_ERROR;
+	int has_writer = 0;
+	pthread_t reader;
+	pthread_t writer;
+
+	ZIP_Job job = {0};
+	job.src = zip;
+	job.dst = dst;
+	job.size = size;
+	if (ZIP_Pipe_init(&job.in) || (!mem && ZIP_Pipe_init(&job.out))) goto error;
+
+	if (inflateInit2(&stream, -MAX_WBITS)!=Z_OK) goto error;
+	if (pthread_create(&reader, NULL, ZIP_readThread, &job)) {
+		(void)inflateEnd(&stream);
+		goto error;
+	}
+	if (!mem) has_writer = !pthread_create(&writer, NULL, ZIP_writeThread, &job);
+
+	uint8_t* in;
+	uint8_t* out = NULL;
+	uint8_t scratch;
+	int full = 0;
+	size_t in_size;
+	while ((in=ZIP_Pipe_peek(&job.in, &in_size))) {
+		stream.next_in = in;
+		stream.avail_in = in_size;
+		do {
+			if (mem) {
+				// inflate straight into memory
+				size_t avail = ZIP_MIN(dst_size - stream.total_out, ZIP_PIPE_SIZE);
+				full = !avail; // only the end of stream marker may be left
+				stream.next_out = full ? &scratch : mem + stream.total_out;
+				stream.avail_out = full ? 1 : avail;
+			}
+			else {
+				if (!has_writer || !(out=ZIP_Pipe_acquire(&job.out))) {
+					ret = Z_ERRNO;
+					break;
+				}
+				stream.next_out = out;
+				stream.avail_out = ZIP_PIPE_SIZE;
+			}
+
+			ret = inflate(&stream, Z_NO_FLUSH);
+			if (ret==Z_NEED_DICT) ret = Z_DATA_ERROR;
+			if (full && !stream.avail_out) ret = Z_DATA_ERROR; // more data than advertised
+
+			if (!mem) ZIP_Pipe_commit(&job.out, ZIP_PIPE_SIZE - stream.avail_out, 0);
+		} while ((stream.avail_in || !stream.avail_out) && ret==Z_OK); // drain input and any pending output
+		ZIP_Pipe_release(&job.in);
+
+		if (ret!=Z_OK && ret!=Z_BUF_ERROR) break;
+	}
+
+	// unblock and collect the other stages
+	ZIP_Pipe_abort(&job.in);
+	pthread_join(reader, NULL);
+	if (!mem) {
+		ZIP_Pipe_commit(&job.out, 0, 1);
+		if (has_writer) pthread_join(writer, NULL);
+	}
+
+	(void)inflateEnd(&stream);
+	if (ret==Z_STREAM_END && stream.total_out==dst_size && !job.error) ret = Z_OK;
+	else if (ret==Z_OK || ret==Z_STREAM_END) ret = Z_DATA_ERROR;
+error:
+	ZIP_Pipe_quit(&job.in);
+	if (!mem) ZIP_Pipe_quit(&job.out);
+	return ret;
+}
+
+static int ZIP_extract(ZIP_Archive* zip, ZIP_Member* member, FILE* dst, uint8_t* mem) {
+	if (ZIP_seekData(zip, member)) return -1;
+	switch (member->method) {
+		case 0: return member->compressed_size==member->size ? ZIP_copy(zip->file, dst, mem, member->size) : -1;
+		case 8:
+			if (member->compressed_size>=zip_pipe_min) return ZIP_inflatePipelined(zip->file, dst, mem, member->compressed_size, member->size);
+			return ZIP_inflate(zip->file, dst, mem, member->compressed_size, member->size);
+	}
+	return -1; // unsupported compression method
+}
+void ZIP_setPipelineMin(uint64_t size) {
+	zip_pipe_min = size ? size : ZIP_PIPE_MIN;
+}
+int ZIP_extractToFile(ZIP_Archive* zip, ZIP_Member* member, FILE* dst) {
+	return ZIP_extract(zip, member, dst, NULL);
+}
+int ZIP_extractToMemory(ZIP_Archive* zip, ZIP_Member* member, void* dst) {
+	return ZIP_extract(zip, member, NULL, dst);
+}
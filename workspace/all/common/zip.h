@@ -0,0 +1,45 @@
+#ifndef ZIP_H
+#define ZIP_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+//
+//	minimal zip reader, based on picoarch/unzip.c
+//	reads the central directory once so members with data
+//	descriptors (general purpose flag bit 3) and zip64
+//	archives work, and indexes members by extension
+//
+
+#define ZIP_EXT_BUCKETS 64
+
+typedef struct ZIP_Member {
+	char* name;
+	uint16_t flags;
+	uint16_t method; // 0: stored, 8: deflate
+	uint32_t crc;
+	uint64_t compressed_size;
+	uint64_t size;
+	uint64_t offset; // of the local header
+	int next; // index of next member with the same extension hash, -1 to end
+} ZIP_Member;
+
+typedef struct ZIP_Archive {
+	FILE* file;
+	int count;
+	ZIP_Member* members;
+	char* names; // backing store for member names
+	int buckets[ZIP_EXT_BUCKETS]; // first member index per extension hash, -1 if empty
+} ZIP_Archive;
+
+ZIP_Archive* ZIP_open(char* path); // returns NULL on failure
+void ZIP_close(ZIP_Archive* zip);
+
+ZIP_Member* ZIP_find(ZIP_Archive* zip, char* name);
+ZIP_Member* ZIP_findExtension(ZIP_Archive* zip, char* ext); // ext without the dot, case insensitive, first in archive order
+
+int ZIP_extractToFile(ZIP_Archive* zip, ZIP_Member* member, FILE* dst); // returns 0 on success
+int ZIP_extractToMemory(ZIP_Archive* zip, ZIP_Member* member, void* dst); // dst must hold member->size bytes
+void ZIP_setPipelineMin(uint64_t size); // compressed size from which extraction reads, inflates and writes on separate threads, 0 for the default
+
+#endif
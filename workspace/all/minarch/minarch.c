@@ -9,15 +9,27 @@
 #include <libgen.h>
 #include <time.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <errno.h>
 #include <zlib.h>
 #include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <math.h>
 
 #include "libretro.h"
 #include "defines.h"
 #include "api.h"
 #include "utils.h"
 #include "scaler.h"
+#include "pixel.h"
+#include "zip.h"
+#include "delta.h"
+#include "mailbox.h"
+#include "rom.h"
+#include "writer.h"
+#include "state.h"
+#include "runahead.h"
 
 #include "i18n.h"
 ///////////////////////////////////////
@@ -28,13 +40,12 @@ static int show_menu = 0;
 static int simple_mode = 0;
 static int thread_video = 0;
 static int was_threaded = 0;
-static int should_run_core = 1; // used by threaded video
 
-static pthread_t		core_pt;
-static pthread_mutex_t	core_mx;
-static pthread_cond_t	core_rq; // not sure this is required
-static SDL_Surface*	backbuffer = NULL;
-static void* coreThread(void *arg);
+static void CoreThread_requestPause(void);
+static void CoreThread_pause(void);
+static void CoreThread_resume(void);
+void Core_setControllerDevice(unsigned device);
+static void getThrottleState(struct retro_throttle_state* state);
 
 enum {
 	SCALE_NATIVE,
@@ -51,11 +62,28 @@ static int screen_effect = EFFECT_NONE;
 static int prevent_tearing = 1; // lenient
 static int show_debug = 0;
 static int max_ff_speed = 3; // 4x
+static int ff_audio = FF_AUDIO_DECIMATE;
+static int compress_states = 1;
+static int rewind_buffer = 0; // index in rewind_sizes, 0 is off
+static int rewind_granularity = 1; // snapshot every n frames
+static int rewinding = 0;
 static int fast_forward = 0;
+static int runahead_frames = 0; // 0 is off
+static int runahead_instance = 0; // run ahead in a second copy of the core
+static int skip_video = 0; // the core's current frame won't be seen
+static int skip_audio = 0; // or heard
+static int skip_poll = 0; // input was already polled this frame
+static int frameskip = 0; // FRAMESKIP_*
+static int frame_pacing = 2; // hybrid
+static int video_pipeline = 0; // frames of latency the pipeline may add, 0 is off
+static int core_cpu = -1; // cfg only, pins the core thread, -1 lets the scheduler decide
+static int pipeline_cpu = -1; // cfg only, pins the pipeline worker
 static int overclock = 1; // normal
 static int has_custom_controllers = 0;
 static int gamepad_type = 0; // index in gamepad_labels/gamepad_values
 static int downsample = 0; // set to 1 to convert from 8888 to 565
+static int allow_xrgb8888 = 0; // otherwise cores are told 565 is all we take
+static int dither = 0; // when downsampling
 
 // these are no longer constants as of the RG CubeXX (even though they look like it)
 static int DEVICE_WIDTH = 0; // FIXED_WIDTH;
@@ -83,6 +111,8 @@ static struct Core {
 	double fps;
 	double sample_rate;
 	double aspect_ratio;
+	unsigned max_width; // geometry.max_*
+	unsigned max_height;
 	
 	void* handle;
 	void (*init)(void);
@@ -104,85 +134,20 @@ static struct Core {
 	void *(*get_memory_data)(unsigned id);
 	size_t (*get_memory_size)(unsigned id);
 	
-	// retro_audio_buffer_status_callback_t audio_buffer_status;
+	retro_audio_buffer_status_callback_t audio_buffer_status;
+	struct retro_frame_time_callback frame_time; // callback is NULL if unused
 } core;
 
-///////////////////////////////////////
-// based on picoarch/unzip.c
-
-#define ZIP_HEADER_SIZE 30
-#define ZIP_CHUNK_SIZE 65536
-#define ZIP_LE_READ16(buf) ((uint16_t)(((uint8_t *)(buf))[1] << 8 | ((uint8_t *)(buf))[0]))
-#define ZIP_LE_READ32(buf) ((uint32_t)(((uint8_t *)(buf))[3] << 24 | ((uint8_t *)(buf))[2] << 16 | ((uint8_t *)(buf))[1] << 8 | ((uint8_t *)(buf))[0]))
-typedef int (*Zip_extract_t)(FILE* zip, FILE* dst, size_t size);
-
-///////////////////////////////////////
-static int Zip_copy(FILE* zip, FILE* dst, size_t size) { // uncompressed?
-	uint8_t buffer[ZIP_CHUNK_SIZE];
-	while (size) {
-		size_t sz = MIN(size, ZIP_CHUNK_SIZE);
-		if (sz!= fread(buffer, 1, sz, zip)) return -1;
-		if (sz!=fwrite(buffer, 1, sz, dst)) return -1;
-		size -= sz;
-	}
-	return 0;
-}
-static int Zip_inflate(FILE* zip, FILE* dst, size_t size) { // compressed
-	z_stream stream = {0};
-	size_t have = 0;
-	uint8_t  in[ZIP_CHUNK_SIZE];
-	uint8_t out[ZIP_CHUNK_SIZE];
-	int ret = -1;
-
-	ret = inflateInit2(&stream, -MAX_WBITS);
-	if (ret != Z_OK)
-		return ret;
-	
-	do {
-		size_t insize = MIN(size, ZIP_CHUNK_SIZE);
-
-		stream.avail_in = fread(in, 1, insize, zip);
-		if (ferror(zip)) {
-			(void)inflateEnd(&stream);
-			return Z_ERRNO;
-		}
-
-		if (!stream.avail_in)
-			break;
-		stream.next_in = in;
-
-		do {
-			stream.avail_out = ZIP_CHUNK_SIZE;
-			stream.next_out = out;
-
-			ret = inflate(&stream, Z_NO_FLUSH);
-			switch(ret) {
-				case Z_NEED_DICT:
-					ret = Z_DATA_ERROR;
-				case Z_DATA_ERROR:
-				case Z_MEM_ERROR:
-					(void)inflateEnd(&stream);
-					return ret;
-			}
-
-			have = ZIP_CHUNK_SIZE - stream.avail_out;
-			if (fwrite(out, 1, have, dst) != have || ferror(dst)) {
-				(void)inflateEnd(&stream);
-				return Z_ERRNO;
-			}
-		} while (stream.avail_out == 0);
-
-		size -= insize;
-	} while (size && ret != Z_STREAM_END);
-
-	(void)inflateEnd(&stream);
-
-	if (!size || ret == Z_STREAM_END) {
-		return Z_OK;
-	} else {
-		return Z_DATA_ERROR;
-	}
-}
+// state shared by the run ahead section and the core callbacks
+static struct RunAhead_Context {
+	char core_path[MAX_PATH]; // to load the second instance from
+	struct Core secondary; // only the function pointers and handle are used
+	int open; // secondary is loaded and has the game
+	int changed; // core options changed since the secondary last asked
+	int failed; // core can't serialize, stop trying until the game changes
+	RunAhead ahead; // the state RunAhead_step() saves and loads
+	uint64_t overhead; // us per frame spent on frames nobody sees, smoothed
+} runahead = {0};
 
 ///////////////////////////////////////
 static struct Game {
@@ -190,12 +155,37 @@ static struct Game {
 	char name[MAX_PATH]; // TODO: rename to basename?
 	char m3u_path[MAX_PATH];
 	char tmp_path[MAX_PATH]; // location of unzipped file
+	char zip_path[MAX_PATH]; // archive.zip#member.ext when unzipped to memory
 	void* data;
 	size_t size;
+	int is_mapped; // data is an mmap of the rom, not a malloc
 	int is_open;
 } game;
 
+static void Game_load(char* path) {
+	uint64_t then = getMicroseconds();
+	
+	if (!ROM_map(path, &game.data, &game.size)) game.is_mapped = 1;
+	else {
+		LOG_info("mmap failed, falling back to buffered read: %s\n", strerror(errno));
+		if (ROM_read(path, &game.data, &game.size)) {
+			LOG_error("Error opening game: %s\n\t%s\n", path, strerror(errno));
+			return;
+		}
+	}
+	
+	LOG_info("loaded %s %zu bytes in %llums\n", game.is_mapped?"mapped":"read", game.size, (unsigned long long)(getMicroseconds() - then) / 1000);
+}
+
 
+static void Game_removeTmp(void) { // the unzipped file and the directory mkdtemp() made for it
+	if (!game.tmp_path[0]) return;
+	remove(game.tmp_path);
+	char* slash = strrchr(game.tmp_path, '/');
+	*slash = '\0';
+	rmdir(game.tmp_path);
+	game.tmp_path[0] = '\0';
+}
 static void Game_open(char* path) {
 	LOG_info("Game_open\n");
 	memset(&game, 0, sizeof(game));
@@ -223,109 +213,92 @@ static void Game_open(char* path) {
 	
 		// if the core doesn't support zip files natively
 		if (!supports_zip) {
-			FILE *zip = fopen(game.path, "r");
+			ZIP_Archive* zip = ZIP_open(game.path);
 			if (zip==NULL) {
 				LOG_error("Error opening archive: %s\n\t%s\n", game.path, strerror(errno));
 				return;
 			}
 			
-			// extract a known file format
-			uint8_t header[ZIP_HEADER_SIZE];
-			uint32_t next = 0;
-			uint16_t len = 0;
-			char filename[MAX_PATH];
-			uint32_t compressed_size = 0;
-			char extension[8];
-			while (1) {
-				if (next) fseek(zip, next, SEEK_CUR);
-				
-				if (ZIP_HEADER_SIZE!=fread(header, 1, ZIP_HEADER_SIZE, zip)) break;
-				
-				if ((uint16_t)(header[6]) & 0x0008) break;
-				
-				len = ZIP_LE_READ16(&header[26]);
-				if (len>=MAX_PATH) break;
-				
-				if (len!=fread(filename,1,len,zip)) break;
-				filename[len] = '\0';
+			// extract a known file format, first in archive order
+			ZIP_Member* member = NULL;
+			for (i=0; extensions[i]; i++) {
+				ZIP_Member* match = ZIP_findExtension(zip, extensions[i]);
+				if (match && (!member || match<member)) member = match;
+			}
+			
+			if (member) {
+				char* filename = member->name;
 				LOG_info("filename: %s\n", filename);
 				
-				compressed_size = ZIP_LE_READ32(&header[18]);
-				
-				fseek(zip, ZIP_LE_READ16(&header[28]), SEEK_CUR);
-				next = compressed_size;
-				
-				int found = 0;
-				for (i=0; extensions[i]; i++) {
-					sprintf(extension, ".%s", extensions[i]);
-					if (suffixMatch(extension, filename)) {
-						
-						found = 1;
-						break;
+				// cores that take data don't need the member on disk
+				if (!core.need_fullpath) {
+					uint64_t then = getMicroseconds();
+					game.data = member->size ? malloc(member->size) : NULL;
+					if (!game.data || ZIP_extractToMemory(zip, member, game.data)) {
+						if (game.data) free(game.data);
+						game.data = NULL;
+						LOG_error("Error extracting file: %s\n\t%s\n", filename, strerror(errno));
+						ZIP_close(zip);
+						return;
 					}
+					game.size = member->size;
+					if (snprintf(game.zip_path, sizeof(game.zip_path), "%s#%s", game.path, basename(filename))>=sizeof(game.zip_path)) {
+						free(game.data);
+						game.data = NULL;
+						game.size = 0;
+						game.zip_path[0] = '\0';
+						LOG_error("Archive member path too long: %s#%s\n", game.path, filename);
+						ZIP_close(zip);
+						return;
+					}
+					LOG_info("unzipped %zu bytes in %llums\n", game.size, (unsigned long long)(getMicroseconds() - then) / 1000);
 				}
-				if (!found) continue;
-				
-				char tmp_template[MAX_PATH];
-				strcpy(tmp_template, "/tmp/minarch-XXXXXX");
-				char* tmp_dirname = mkdtemp(tmp_template);
-				// LOG_info("tmp_dirname: %s\n", tmp_dirname);
-				sprintf(game.tmp_path, "%s/%s", tmp_dirname, basename(filename));
-				
-				// TODO: we need to clear game.tmp_path if anything below this point fails!
-				
-				FILE* dst = fopen(game.tmp_path, "w");
-				if (dst==NULL) {
-					game.tmp_path[0] = '\0';
-					LOG_error("Error extracting file: %s\n\t%s\n", filename, strerror(errno));
-					return;
-				}
+				else {
+					char tmp_template[MAX_PATH];
+					strcpy(tmp_template, "/tmp/minarch-XXXXXX");
+					char* tmp_dirname = mkdtemp(tmp_template);
+					if (tmp_dirname==NULL) {
+						LOG_error("Error creating temp directory for: %s\n\t%s\n", filename, strerror(errno));
+						ZIP_close(zip);
+						return;
+					}
+					if (snprintf(game.tmp_path, sizeof(game.tmp_path), "%s/%s", tmp_dirname, basename(filename))>=sizeof(game.tmp_path)) {
+						rmdir(tmp_dirname);
+						game.tmp_path[0] = '\0';
+						LOG_error("Archive member path too long: %s/%s\n", tmp_dirname, filename);
+						ZIP_close(zip);
+						return;
+					}
 				
-				Zip_extract_t extract = NULL;
-				switch (ZIP_LE_READ16(&header[8])) {
-					case 0: extract = Zip_copy; break;
-					case 8: extract = Zip_inflate; break;
-				}
+					FILE* dst = fopen(game.tmp_path, "w");
+					if (dst==NULL) {
+						LOG_error("Error extracting file: %s\n\t%s\n", filename, strerror(errno));
+						Game_removeTmp();
+						ZIP_close(zip);
+						return;
+					}
 				
-				if (!extract || extract(zip,dst,compressed_size)) {
-					game.tmp_path[0] = '\0';
-					LOG_error("Error extracting file: %s\n\t%s\n", filename, strerror(errno));
-					return;
+					int failed = ZIP_extractToFile(zip, member, dst);
+					if (fclose(dst)) failed = 1;
+					if (failed) {
+						LOG_error("Error extracting file: %s\n\t%s\n", filename, strerror(errno));
+						Game_removeTmp();
+						ZIP_close(zip);
+						return;
+					}
 				}
-				
-				fclose(dst);
-				
-				break;
 			}
 			
-			fclose(zip);
+			ZIP_close(zip);
 		}
 	}
 		
 	// some cores handle opening files themselves, eg. pcsx_rearmed
 	// if the frontend tries to load a 500MB file itself bad things happen
-	if (!core.need_fullpath) {
+	if (!core.need_fullpath && !game.data) {
 		path = game.tmp_path[0]=='\0'?game.path:game.tmp_path;
-		
-		FILE *file = fopen(path, "r");
-		if (file==NULL) {
-			LOG_error("Error opening game: %s\n\t%s\n", path, strerror(errno));
-			return;
-		}
-	
-		fseek(file, 0, SEEK_END);
-		game.size = ftell(file);
-	
-		rewind(file);
-		game.data = malloc(game.size);
-		if (game.data==NULL) {
-			LOG_error("Couldn't allocate memory for file: %s\n", path);
-			return;
-		}
-	
-		fread(game.data, sizeof(uint8_t), game.size, file);
-	
-		fclose(file);
+		Game_load(path);
+		if (!game.data) return;
 	}
 	
 	// m3u-based?
@@ -362,8 +335,9 @@ static void Game_open(char* path) {
 
 ///////////////////////////////////////
 static void Game_close(void) {
-	if (game.data) free(game.data);
-	if (game.tmp_path[0]) remove(game.tmp_path);
+	if (game.is_mapped) munmap(game.data, game.size);
+	else if (game.data) free(game.data);
+	Game_removeTmp();
 	game.is_open = 0;
 	VIB_setStrength(0); // just in case
 }
@@ -387,6 +361,52 @@ static void Game_changeDisc(char* path) {
 	putFile(CHANGE_DISC_PATH, path); // MinUI still needs to know this to update recents.txt
 }
 
+///////////////////////////////////////
+// background writer, see writer.h
+
+static void logWrite(WriterJob* job, int error) { // on the writer thread
+	if (error) LOG_error("Error writing file: %s (%s)\n", job->path, strerror(error));
+	else LOG_info("wrote %s in %llums\n", job->path, (unsigned long long)job->elapsed / 1000);
+}
+
+///////////////////////////////////////
+// battery and rtc memory are only written when their hash changes
+// and go through the writer so the emulation thread never waits on io
+
+#define SRAM_AUTOSAVE_INTERVAL 30 // seconds
+
+static _Atomic uint64_t sram_hash = 0; // also reset by the writer thread
+static _Atomic uint64_t rtc_hash = 0;
+
+static void Memory_written(WriterJob* job, int error) { // on the writer thread
+	logWrite(job, error);
+	if (!error) return;
+	
+	// forget the hash so the next autosave tries again, unless
+	// the emulation thread has already submitted newer data
+	uint64_t hash = hash64(job->data, job->size);
+	atomic_compare_exchange_strong((_Atomic uint64_t*)job->userdata, &hash, 0);
+}
+static void Memory_write(unsigned id, char* filename, _Atomic uint64_t* last_hash) {
+	size_t size = core.get_memory_size(id);
+	void* data = core.get_memory_data(id);
+	if (!size || !data) return;
+	
+	uint64_t hash = hash64(data, size);
+	if (hash==*last_hash) return; // unchanged
+	
+	WriterJob* job = Writer_acquire(size);
+	if (!job) {
+		LOG_error("Couldn't allocate memory to write: %s\n", filename);
+		return;
+	}
+	memcpy(job->data, data, size);
+	job->done = Memory_written;
+	job->userdata = last_hash;
+	*last_hash = hash; // before submit so a failure can't be overwritten
+	Writer_submit(job, filename);
+}
+
 ///////////////////////////////////////
 static void SRAM_getPath(char* filename) {
 	sprintf(filename, "%s/%s.sav", core.saves_dir, game.name);
@@ -399,16 +419,18 @@ static void SRAM_read(void) {
 	SRAM_getPath(filename);
 	printf("sav path (read): %s\n", filename);
 	
-	FILE *sram_file = fopen(filename, "r");
-	if (!sram_file) return;
-
 	void* sram = core.get_memory_data(RETRO_MEMORY_SAVE_RAM);
-
-	if (!sram || !fread(sram, 1, sram_size, sram_file)) {
-		LOG_error("Error reading SRAM data\n");
+	
+	FILE *sram_file = fopen(filename, "r");
+	if (sram_file) {
+		if (!sram || !fread(sram, 1, sram_size, sram_file)) {
+			LOG_error("Error reading SRAM data\n");
+		}
+		fclose(sram_file);
 	}
-
-	fclose(sram_file);
+	
+	// whatever is there now is what's on disk (or the core's defaults)
+	if (sram) sram_hash = hash64(sram, sram_size);
 }
 static void SRAM_write(void) {
 	size_t sram_size = core.get_memory_size(RETRO_MEMORY_SAVE_RAM);
@@ -416,23 +438,8 @@ static void SRAM_write(void) {
 	
 	char filename[MAX_PATH];
 	SRAM_getPath(filename);
-	printf("sav path (write): %s\n", filename);
-		
-	FILE *sram_file = fopen(filename, "w");
-	if (!sram_file) {
-		LOG_error("Error opening SRAM file: %s\n", strerror(errno));
-		return;
-	}
-
-	void *sram = core.get_memory_data(RETRO_MEMORY_SAVE_RAM);
-
-	if (!sram || sram_size != fwrite(sram, 1, sram_size, sram_file)) {
-		LOG_error("Error writing SRAM data to file\n");
-	}
-
-	fclose(sram_file);
-
-	sync();
+	
+	Memory_write(RETRO_MEMORY_SAVE_RAM, filename, &sram_hash);
 }
 
 ///////////////////////////////////////
@@ -448,16 +455,17 @@ static void RTC_read(void) {
 	RTC_getPath(filename);
 	printf("rtc path (read): %s\n", filename);
 	
-	FILE *rtc_file = fopen(filename, "r");
-	if (!rtc_file) return;
-
 	void* rtc = core.get_memory_data(RETRO_MEMORY_RTC);
-
-	if (!rtc || !fread(rtc, 1, rtc_size, rtc_file)) {
-		LOG_error("Error reading RTC data\n");
+	
+	FILE *rtc_file = fopen(filename, "r");
+	if (rtc_file) {
+		if (!rtc || !fread(rtc, 1, rtc_size, rtc_file)) {
+			LOG_error("Error reading RTC data\n");
+		}
+		fclose(rtc_file);
 	}
-
-	fclose(rtc_file);
+	
+	if (rtc) rtc_hash = hash64(rtc, rtc_size);
 }
 static void RTC_write(void) {
 	size_t rtc_size = core.get_memory_size(RETRO_MEMORY_RTC);
@@ -465,23 +473,166 @@ static void RTC_write(void) {
 	
 	char filename[MAX_PATH];
 	RTC_getPath(filename);
-	printf("rtc path (write) size(%u): %s\n", rtc_size, filename);
-		
-	FILE *rtc_file = fopen(filename, "w");
-	if (!rtc_file) {
-		LOG_error("Error opening RTC file: %s\n", strerror(errno));
-		return;
-	}
+	
+	Memory_write(RETRO_MEMORY_RTC, filename, &rtc_hash);
+}
 
-	void *rtc = core.get_memory_data(RETRO_MEMORY_RTC);
+static void SRAM_autosave(void) { // call once per frame
+	static int frames = 0;
+	if (++frames<core.fps*SRAM_AUTOSAVE_INTERVAL) return;
+	frames = 0;
+	
+	SRAM_write();
+	RTC_write();
+}
 
-	if (!rtc || rtc_size != fwrite(rtc, 1, rtc_size, rtc_file)) {
-		LOG_error("Error writing RTC data to file\n");
-	}
+///////////////////////////////////////
+// rewind
+// every rewind_granularity frames the state is serialized and only
+// the xor against the previous snapshot is kept, run-length encoded
+// since it's mostly zeros. deltas live in a fixed size ring arena so
+// memory use never exceeds the buffer size plus three state buffers
+
+#define REWIND_MAX_ENTRIES 8192
+
+static int rewind_sizes[] = {0,8,16,32,64}; // in MB
+
+typedef struct RewindEntry {
+	uint32_t offset; // in arena
+	uint32_t size; // of delta
+} RewindEntry;
+
+static struct Rewind_Context {
+	uint8_t* arena;
+	size_t capacity;
+	uint8_t* state; // last snapshot, the newest delta gets us from here to the one before it
+	uint8_t* next; // scratch snapshot
+	uint8_t* delta; // scratch encoded delta
+	size_t state_size;
+	int has_state;
+	RewindEntry entries[REWIND_MAX_ENTRIES];
+	int head; // next entry
+	int count;
+	size_t write; // next arena offset
+	int frames; // since last snapshot
+} rewinder;
+
+static void Rewind_reset(void) {
+	rewinder.head = 0;
+	rewinder.count = 0;
+	rewinder.write = 0;
+	rewinder.frames = 0;
+	rewinder.has_state = 0;
+}
+static void Rewind_free(void) {
+	if (rewinder.arena) free(rewinder.arena);
+	if (rewinder.state) free(rewinder.state);
+	if (rewinder.next) free(rewinder.next);
+	if (rewinder.delta) free(rewinder.delta);
+	rewinder.arena = NULL;
+	rewinder.state = NULL;
+	rewinder.next = NULL;
+	rewinder.delta = NULL;
+	rewinder.capacity = 0;
+	rewinder.state_size = 0;
+	Rewind_reset();
+}
+static int Rewind_alloc(size_t state_size) { // returns 0 when ready
+	size_t capacity = (size_t)rewind_sizes[rewind_buffer] * 1024 * 1024;
+	if (rewinder.arena && capacity==rewinder.capacity && state_size==rewinder.state_size) return 0;
+	
+	Rewind_free();
+	if (!capacity) return -1;
+	
+	rewinder.arena = malloc(capacity);
+	rewinder.state = malloc(state_size);
+	rewinder.next = malloc(state_size);
+	rewinder.delta = malloc(DELTA_MAX_SIZE(state_size));
+	if (!rewinder.arena || !rewinder.state || !rewinder.next || !rewinder.delta) {
+		LOG_error("Couldn't allocate memory for rewind\n");
+		Rewind_free();
+		rewind_buffer = 0;
+		return -1;
+	}
+	rewinder.capacity = capacity;
+	rewinder.state_size = state_size;
+	LOG_info("rewind: %iMB buffer for %i byte states\n", rewind_sizes[rewind_buffer], state_size);
+	return 0;
+}
 
-	fclose(rtc_file);
+static uint8_t* Rewind_reserve(size_t size) { // evicts the oldest deltas until size fits
+	size_t space = size ? (size + 7) & ~7 : 8;
+	if (space>rewinder.capacity) return NULL;
+	
+	while (rewinder.count) {
+		int tail = (rewinder.head + REWIND_MAX_ENTRIES - rewinder.count) % REWIND_MAX_ENTRIES;
+		size_t tail_offset = rewinder.entries[tail].offset;
+		if (rewinder.count<REWIND_MAX_ENTRIES) {
+			if (rewinder.write>tail_offset) { // free space is at the end, then at the start
+				if (rewinder.capacity-rewinder.write>=space) break;
+				rewinder.write = 0;
+				continue;
+			}
+			if (rewinder.write<tail_offset && tail_offset-rewinder.write>=space) break;
+		}
+		rewinder.count -= 1; // drop the oldest
+	}
+	if (!rewinder.count) rewinder.write = 0;
+	
+	RewindEntry* entry = &rewinder.entries[rewinder.head];
+	entry->offset = rewinder.write;
+	entry->size = size;
+	rewinder.head = (rewinder.head + 1) % REWIND_MAX_ENTRIES;
+	rewinder.count += 1;
+	rewinder.write += space;
+	return rewinder.arena + entry->offset;
+}
 
-	sync();
+static void Rewind_push(void) {
+	if (!rewind_buffer) {
+		if (rewinder.arena) Rewind_free();
+		return;
+	}
+	if (++rewinder.frames<rewind_granularity) return;
+	rewinder.frames = 0;
+	
+	size_t state_size = core.serialize_size();
+	if (!state_size || Rewind_alloc(state_size)) return;
+	
+	if (!rewinder.has_state) {
+		rewinder.has_state = core.serialize(rewinder.state, state_size);
+		return;
+	}
+	
+	if (!core.serialize(rewinder.next, state_size)) return;
+	size_t size = Delta_encode(rewinder.state, rewinder.next, state_size, rewinder.delta);
+	
+	uint8_t* tmp = rewinder.state;
+	rewinder.state = rewinder.next;
+	rewinder.next = tmp;
+	
+	uint8_t* entry = Rewind_reserve(size);
+	if (!entry) { // delta can't fit the arena, start over from here
+		rewinder.count = 0;
+		return;
+	}
+	memcpy(entry, rewinder.delta, size);
+}
+static int Rewind_step(void) { // returns 1 if the core was rewound
+	if (!rewind_buffer || !rewinder.has_state) return 0;
+	
+	// when we run out we just hold on the oldest snapshot
+	if (rewinder.count) {
+		rewinder.head = (rewinder.head + REWIND_MAX_ENTRIES - 1) % REWIND_MAX_ENTRIES;
+		rewinder.count -= 1;
+		RewindEntry* entry = &rewinder.entries[rewinder.head];
+		Delta_apply(rewinder.state, rewinder.arena + entry->offset, entry->size);
+		rewinder.write = entry->offset;
+	}
+	
+	core.unserialize(rewinder.state, rewinder.state_size);
+	rewinder.frames = 0;
+	return 1;
 }
 
 ///////////////////////////////////////
@@ -490,13 +641,68 @@ static int state_slot = 0;
 static void State_getPath(char* filename) {
 	sprintf(filename, "%s/%s.st%i", core.states_dir, game.name, state_slot);
 }
+
+// compressed state container, legacy states are just the raw
+// core.serialize() data. zlib at its fastest level since that's
+// what we already link against and inflate is cheap
+static void* State_compress(WriterJob* job, size_t* size) { // on the writer thread
+	size_t capacity = STATE_encodeBound(job->size);
+	if (job->encoded_capacity<capacity) {
+		void* encoded = realloc(job->encoded, capacity);
+		if (!encoded) {
+			LOG_error("Couldn't allocate memory to compress state, writing it as is: %s\n", job->path);
+			return NULL;
+		}
+		job->encoded = encoded;
+		job->encoded_capacity = capacity;
+	}
+	
+	*size = STATE_encode(job->data, job->size, core.name, job->encoded);
+	if (!*size) {
+		LOG_error("Error compressing state, writing it as is: %s\n", job->path);
+		return NULL;
+	}
+	return job->encoded;
+}
+static int State_decode(FILE* state_file, StateHeader* header, void** state, size_t* state_size) { // returns 0 on success, state_size is the buffer size in and the decoded size out
+	if (header->version!=STATE_VERSION && header->version!=STATE_VERSION_ZLIB) {
+		LOG_error("Unsupported state version: %i\n", header->version);
+		return -1;
+	}
+	if (strncmp(header->core, core.name, sizeof(header->core)-1)) {
+		LOG_warn("State was saved by %.32s not %s\n", header->core, core.name);
+	}
+	
+	// grow the buffer if this state is larger than the core reports
+	if (header->size>*state_size) {
+		void* tmp = realloc(*state, header->size);
+		if (!tmp) return -1;
+		*state = tmp;
+	}
+	
+	void* compressed = malloc(header->compressed_size);
+	if (!compressed) return -1;
+	int result = -1;
+	if (header->compressed_size==fread(compressed, 1, header->compressed_size, state_file)) {
+		result = STATE_decode(header, compressed, *state);
+		if (result==-2) LOG_error("State checksum mismatch\n");
+	}
+	free(compressed);
+	if (result) return -1;
+	
+	*state_size = header->size;
+	return 0;
+}
 static void State_read(void) { // from picoarch
 	size_t state_size = core.serialize_size();
 	if (!state_size) return;
+	
+	Writer_flush(); // in case this slot is still being written
 
 	int was_ff = fast_forward;
 	fast_forward = 0;
 
+	FILE *state_file = NULL;
 	void *state = calloc(1, state_size);
 	if (!state) {
 		LOG_error("Couldn't allocate memory for state\n");
@@ -506,7 +712,7 @@ static void State_read(void) { // from picoarch
 	char filename[MAX_PATH];
 	State_getPath(filename);
 	
-	FILE *state_file = fopen(filename, "r");
+	state_file = fopen(filename, "r");
 	if (!state_file) {
 		if (state_slot!=8) { // st8 is a default state in MiniUI and may not exist, that's okay
 			LOG_error("Error opening state file: %s (%s)\n", filename, strerror(errno));
@@ -514,17 +720,39 @@ static void State_read(void) { // from picoarch
 		goto error;
 	}
 	
-	// some cores report the wrong serialize size initially for some games, eg. mgba: Wario Land 4
-	// so we allow a size mismatch as long as the actual size fits in the buffer we've allocated
-	if (state_size < fread(state, 1, state_size, state_file)) {
-		LOG_error("Error reading state data from file: %s (%s)\n", filename, strerror(errno));
+	uint64_t then = getMicroseconds();
+	uint8_t raw_header[sizeof(StateHeader)];
+	StateHeader header;
+	int has_header = STATE_readHeader(raw_header, fread(raw_header, 1, sizeof(raw_header), state_file), &header);
+	if (has_header<0) {
+		LOG_error("Corrupt state header in file: %s\n", filename);
 		goto error;
 	}
+	if (has_header==0) {
+		size_t buffer_size = state_size;
+		if (State_decode(state_file, &header, &state, &buffer_size)) {
+			LOG_error("Error reading compressed state from file: %s\n", filename);
+			goto error;
+		}
+		state_size = buffer_size;
+	}
+	else {
+		rewind(state_file);
+		
+		// some cores report the wrong serialize size initially for some games, eg. mgba: Wario Land 4
+		// so we allow a size mismatch as long as the actual size fits in the buffer we've allocated
+		if (state_size < fread(state, 1, state_size, state_file)) {
+			LOG_error("Error reading state data from file: %s (%s)\n", filename, strerror(errno));
+			goto error;
+		}
+	}
+	LOG_info("read state in %llums\n", (unsigned long long)(getMicroseconds() - then) / 1000);
 
 	if (!core.unserialize(state, state_size)) {
 		LOG_error("Error restoring save state: %s (%s)\n", filename, strerror(errno));
 		goto error;
 	}
+	Rewind_reset();
 
 error:
 	if (state) free(state);
@@ -539,37 +767,26 @@ static void State_write(void) { // from picoarch
 	int was_ff = fast_forward;
 	fast_forward = 0;
 
-	void *state = calloc(1, state_size);
-	if (!state) {
+	// serialize here, write and sync on the writer thread
+	WriterJob* job = Writer_acquire(state_size);
+	if (!job) {
 		LOG_error("Couldn't allocate memory for state\n");
 		goto error;
 	}
 
 	char filename[MAX_PATH];
 	State_getPath(filename);
-	
-	FILE *state_file = fopen(filename, "w");
-	if (!state_file) {
-		LOG_error("Error opening state file: %s (%s)\n", filename, strerror(errno));
-		goto error;
-	}
 
-	if (!core.serialize(state, state_size)) {
+	if (!core.serialize(job->data, state_size)) {
 		LOG_error("Error creating save state: %s (%s)\n", filename, strerror(errno));
 		goto error;
 	}
 
-	if (state_size != fwrite(state, 1, state_size, state_file)) {
-		LOG_error("Error writing state data to file: %s (%s)\n", filename, strerror(errno));
-		goto error;
-	}
+	if (compress_states) job->encode = State_compress;
+	job->done = logWrite;
+	Writer_submit(job, filename);
 
 error:
-	if (state) free(state);
-	if (state_file) fclose(state_file);
-
-	sync();
-	
 	fast_forward = was_ff;
 }
 static void State_autosave(void) {
@@ -643,6 +860,77 @@ static char* tearing_labels[] = {
 	"Strict",
 	NULL
 };
+static char* rewind_labels[] = {
+	"Off",
+	"8MB",
+	"16MB",
+	"32MB",
+	"64MB",
+	NULL,
+};
+static char* rewind_granularity_labels[] = {
+	"1",
+	"2",
+	"3",
+	"4",
+	"5",
+	"6",
+	NULL,
+};
+static char* resampler_labels[] = {
+	"Linear",
+	"Cubic",
+	"Sinc",
+	NULL,
+};
+static char* latency_labels[] = {
+	"32ms",
+	"48ms",
+	"64ms",
+	"96ms",
+	"128ms",
+	NULL,
+};
+static int latency_values[] = {32,48,64,96,128};
+static char* runahead_labels[] = {
+	"Off",
+	"1",
+	"2",
+	"3",
+	"4",
+	NULL,
+};
+static char* runahead_instance_labels[] = {
+	"Single",
+	"Second",
+	NULL,
+};
+static char* frameskip_labels[] = {
+	"Off",
+	"Auto",
+	"1",
+	"2",
+	"3",
+	NULL,
+};
+static char* ff_audio_labels[] = {
+	"Off",
+	"Decimate",
+	"Tempo",
+	NULL,
+};
+static char* pipeline_labels[] = {
+	"Off",
+	"1 Frame",
+	"2 Frames",
+	NULL,
+};
+static char* pacing_labels[] = {
+	"Video",
+	"Audio",
+	"Hybrid",
+	NULL,
+};
 static char* max_ff_labels[] = {
 	"None",
 	"2x",
@@ -666,6 +954,19 @@ enum {
 	FE_OPT_THREAD,
 	FE_OPT_DEBUG,
 	FE_OPT_MAXFF,
+	FE_OPT_COMPRESS,
+	FE_OPT_REWIND,
+	FE_OPT_REWIND_GRANULARITY,
+	FE_OPT_RESAMPLER,
+	FE_OPT_LATENCY,
+	FE_OPT_PACING,
+	FE_OPT_RUNAHEAD,
+	FE_OPT_RUNAHEAD_INSTANCE,
+	FE_OPT_FRAMESKIP,
+	FE_OPT_FF_AUDIO,
+	FE_OPT_PIPELINE,
+	FE_OPT_XRGB8888,
+	FE_OPT_DITHER,
 	FE_OPT_COUNT,
 };
 
@@ -678,6 +979,7 @@ enum {
 	SHORTCUT_CYCLE_EFFECT,
 	SHORTCUT_TOGGLE_FF,
 	SHORTCUT_HOLD_FF,
+	SHORTCUT_HOLD_REWIND,
 	SHORTCUT_COUNT,
 };
 
@@ -923,6 +1225,136 @@ static struct Config {
 				.values = max_ff_labels,
 				.labels = max_ff_labels,
 			},
+			[FE_OPT_COMPRESS] = {
+				.key	= "minarch_compress_states",
+				.name	= "Compress States",
+				.desc	= "Compress save states to save space\nand card writes. Uncompressed states\ncan still be loaded either way.",
+				.default_value = 1,
+				.value = 1,
+				.count = 2,
+				.values = onoff_labels,
+				.labels = onoff_labels,
+			},
+			[FE_OPT_REWIND] = {
+				.key	= "minarch_rewind_buffer",
+				.name	= "Rewind Buffer",
+				.desc	= "Memory reserved for rewinding.\nBigger buffers rewind further back.\nBind Hold Rewind in Shortcuts.",
+				.default_value = 0,
+				.value = 0,
+				.count = 5,
+				.values = rewind_labels,
+				.labels = rewind_labels,
+			},
+			[FE_OPT_REWIND_GRANULARITY] = {
+				.key	= "minarch_rewind_granularity",
+				.name	= "Rewind Granularity",
+				.desc	= "Save a rewind step every n frames.\nHigher values rewind further and\nfaster but use less cpu.",
+				.default_value = 0, // 1
+				.value = 0, // 1
+				.count = 6,
+				.values = rewind_granularity_labels,
+				.labels = rewind_granularity_labels,
+			},
+			[FE_OPT_RESAMPLER] = {
+				.key	= "minarch_audio_resampling",
+				.name	= "Audio Resampling",
+				.desc	= "How audio is converted to the\ndevice's sample rate. Sinc sounds\nbest, Linear is cheapest. Unused\nwhen the rates already match.",
+				.default_value = RESAMPLE_SINC,
+				.value = RESAMPLE_SINC,
+				.count = RESAMPLE_COUNT,
+				.values = resampler_labels,
+				.labels = resampler_labels,
+			},
+			[FE_OPT_LATENCY] = {
+				.key	= "minarch_audio_latency",
+				.name	= "Audio Latency",
+				.desc	= "How much audio to keep buffered.\nLower is more responsive, raise\nit if you hear crackling.",
+				.default_value = 2, // 64ms
+				.value = 2, // 64ms
+				.count = 5,
+				.values = latency_labels,
+				.labels = latency_labels,
+			},
+			[FE_OPT_PACING] = {
+				.key	= "minarch_frame_pacing",
+				.name	= "Frame Pacing",
+				.desc	= "Video follows the screen's refresh.\nAudio runs at the core's exact\nspeed. Hybrid picks per core.",
+				.default_value = 2, // hybrid
+				.value = 2, // hybrid
+				.count = 3,
+				.values = pacing_labels,
+				.labels = pacing_labels,
+			},
+			[FE_OPT_RUNAHEAD] = {
+				.key	= "minarch_runahead",
+				.name	= "Run-Ahead",
+				.desc	= "Frames to run ahead to hide the\ngame's own input lag. Costs that\nmany extra frames of cpu.",
+				.default_value = 0,
+				.value = 0,
+				.count = 5,
+				.values = runahead_labels,
+				.labels = runahead_labels,
+			},
+			[FE_OPT_RUNAHEAD_INSTANCE] = {
+				.key	= "minarch_runahead_instance",
+				.name	= "Run-Ahead Instance",
+				.desc	= "Second runs ahead in another copy\nof the core. Uses more memory but\navoids audio glitches in some cores.",
+				.default_value = 0,
+				.value = 0,
+				.count = 2,
+				.values = runahead_instance_labels,
+				.labels = runahead_instance_labels,
+			},
+			[FE_OPT_FRAMESKIP] = {
+				.key	= "minarch_frameskip",
+				.name	= "Frameskip",
+				.desc	= "Skip drawing frames when the core\ncan't keep up. Auto only skips when\nfalling behind, never more than 3.",
+				.default_value = 0,
+				.value = 0,
+				.count = 5,
+				.values = frameskip_labels,
+				.labels = frameskip_labels,
+			},
+			[FE_OPT_FF_AUDIO] = {
+				.key	= "minarch_ff_audio",
+				.name	= "FF Audio",
+				.desc	= "Decimate plays fast forward audio\npitched up. Tempo keeps the pitch\nbut costs more cpu.",
+				.default_value = FF_AUDIO_DECIMATE,
+				.value = FF_AUDIO_DECIMATE,
+				.count = FF_AUDIO_COUNT,
+				.values = ff_audio_labels,
+				.labels = ff_audio_labels,
+			},
+			[FE_OPT_PIPELINE] = {
+				.key	= "minarch_video_pipeline",
+				.name	= "Video Pipeline",
+				.desc	= "Convert frames on another cpu core\nwhen the core is threaded. Each\nframe adds a frame of latency.",
+				.default_value = 0,
+				.value = 0,
+				.count = 3,
+				.values = pipeline_labels,
+				.labels = pipeline_labels,
+			},
+			[FE_OPT_XRGB8888] = {
+				.key	= "minarch_xrgb8888",
+				.name	= "32-bit Cores",
+				.desc	= "Let cores that prefer it render in\n32-bit color, reduced to 16-bit.\nApplies when the game is reopened.",
+				.default_value = 0,
+				.value = 0,
+				.count = 2,
+				.values = onoff_labels,
+				.labels = onoff_labels,
+			},
+			[FE_OPT_DITHER] = {
+				.key	= "minarch_dither",
+				.name	= "Dither",
+				.desc	= "Smooth color banding when 32-bit\ncores are reduced to 16-bit color.",
+				.default_value = 0,
+				.value = 0,
+				.count = 2,
+				.values = onoff_labels,
+				.labels = onoff_labels,
+			},
 			[FE_OPT_COUNT] = {NULL}
 		}
 	},
@@ -942,6 +1374,7 @@ static struct Config {
 		[SHORTCUT_CYCLE_EFFECT]			= {"Cycle Effect",		-1, BTN_ID_NONE, 0},
 		[SHORTCUT_TOGGLE_FF]			= {"Toggle FF",			-1, BTN_ID_NONE, 0},
 		[SHORTCUT_HOLD_FF]				= {"Hold FF",			-1, BTN_ID_NONE, 0},
+		[SHORTCUT_HOLD_REWIND]			= {"Hold Rewind",		-1, BTN_ID_NONE, 0},
 		{NULL}
 	},
 };
@@ -1018,6 +1451,60 @@ static void Config_syncFrontend(char* key, int value) {
 		max_ff_speed = value;
 		i = FE_OPT_MAXFF;
 	}
+	else if (exactMatch(key,config.frontend.options[FE_OPT_COMPRESS].key)) {
+		compress_states = value;
+		i = FE_OPT_COMPRESS;
+	}
+	else if (exactMatch(key,config.frontend.options[FE_OPT_REWIND].key)) {
+		rewind_buffer = value;
+		if (!rewind_buffer) rewinding = 0;
+		i = FE_OPT_REWIND;
+	}
+	else if (exactMatch(key,config.frontend.options[FE_OPT_REWIND_GRANULARITY].key)) {
+		rewind_granularity = value + 1;
+		i = FE_OPT_REWIND_GRANULARITY;
+	}
+	else if (exactMatch(key,config.frontend.options[FE_OPT_RESAMPLER].key)) {
+		SND_setResampler(value);
+		i = FE_OPT_RESAMPLER;
+	}
+	else if (exactMatch(key,config.frontend.options[FE_OPT_LATENCY].key)) {
+		SND_setLatency(latency_values[value]);
+		i = FE_OPT_LATENCY;
+	}
+	else if (exactMatch(key,config.frontend.options[FE_OPT_PACING].key)) {
+		frame_pacing = value;
+		i = FE_OPT_PACING;
+	}
+	else if (exactMatch(key,config.frontend.options[FE_OPT_RUNAHEAD].key)) {
+		runahead_frames = value;
+		runahead.failed = 0; // give it another try
+		i = FE_OPT_RUNAHEAD;
+	}
+	else if (exactMatch(key,config.frontend.options[FE_OPT_RUNAHEAD_INSTANCE].key)) {
+		runahead_instance = value;
+		i = FE_OPT_RUNAHEAD_INSTANCE;
+	}
+	else if (exactMatch(key,config.frontend.options[FE_OPT_FRAMESKIP].key)) {
+		frameskip = value;
+		i = FE_OPT_FRAMESKIP;
+	}
+	else if (exactMatch(key,config.frontend.options[FE_OPT_FF_AUDIO].key)) {
+		ff_audio = value;
+		i = FE_OPT_FF_AUDIO;
+	}
+	else if (exactMatch(key,config.frontend.options[FE_OPT_PIPELINE].key)) {
+		video_pipeline = value;
+		i = FE_OPT_PIPELINE;
+	}
+	else if (exactMatch(key,config.frontend.options[FE_OPT_XRGB8888].key)) {
+		allow_xrgb8888 = value;
+		i = FE_OPT_XRGB8888;
+	}
+	else if (exactMatch(key,config.frontend.options[FE_OPT_DITHER].key)) {
+		dither = value;
+		i = FE_OPT_DITHER;
+	}
 	if (i==-1) return;
 	Option* option = &config.frontend.options[i];
 	option->value = value;
@@ -1119,9 +1606,12 @@ static void Config_readOptionsString(char* cfg) {
 	if (has_custom_controllers && Config_getValue(cfg,"minarch_gamepad_type",value,NULL)) {
 		gamepad_type = strtol(value, NULL, 0);
 		int device = strtol(gamepad_values[gamepad_type], NULL, 0);
-		core.set_controller_port_device(0, device);
+		Core_setControllerDevice(device);
 	}
 	
+	if (Config_getValue(cfg,"minarch_cpu_core",value,NULL)) core_cpu = strtol(value, NULL, 0);
+	if (Config_getValue(cfg,"minarch_cpu_pipeline",value,NULL)) pipeline_cpu = strtol(value, NULL, 0);
+	
 	for (int i=0; config.core.options[i].key; i++) {
 		Option* option = &config.core.options[i];
 		if (!Config_getValue(cfg, option->key, value, &option->lock)) continue;
@@ -1264,6 +1754,8 @@ static void Config_write(int override) {
 	}
 	
 	if (has_custom_controllers) fprintf(file, "%s = %i\n", "minarch_gamepad_type", gamepad_type);
+	if (core_cpu>=0) fprintf(file, "%s = %i\n", "minarch_cpu_core", core_cpu);
+	if (pipeline_cpu>=0) fprintf(file, "%s = %i\n", "minarch_cpu_pipeline", pipeline_cpu);
 	
 	for (int i=0; config.controls[i].name; i++) {
 		ButtonMapping* mapping = &config.controls[i];
@@ -1306,7 +1798,7 @@ static void Config_restore(void) {
 	
 	if (has_custom_controllers) {
 		gamepad_type = 0;
-		core.set_controller_port_device(0, RETRO_DEVICE_JOYPAD);
+		Core_setControllerDevice(RETRO_DEVICE_JOYPAD);
 	}
 
 	for (int i=0; config.controls[i].name; i++) {
@@ -1585,6 +2077,8 @@ static int setFastForward(int enable) {
 static uint32_t buttons = 0; // RETRO_DEVICE_ID_JOYPAD_* buttons
 static int ignore_menu = 0;
 static void input_poll_callback(void) {
+	if (skip_poll) return; // a run ahead frame, keep the input we have
+	
 	PAD_poll();
 
 	int show_setting = 0;
@@ -1630,6 +2124,12 @@ static void input_poll_callback(void) {
 					break;
 				}
 			}
+			else if (i==SHORTCUT_HOLD_REWIND) {
+				if (PAD_justPressed(btn) || PAD_justReleased(btn)) {
+					rewinding = rewind_buffer && PAD_isPressed(btn);
+					if (mapping->mod) ignore_menu = 1;
+				}
+			}
 			else if (i==SHORTCUT_HOLD_FF) {
 				// don't allow turn off fast_forward with a release of the hold button 
 				// if it was initially turned on with the toggle button
@@ -1642,7 +2142,7 @@ static void input_poll_callback(void) {
 				switch (i) {
 					case SHORTCUT_SAVE_STATE: Menu_saveState(); break;
 					case SHORTCUT_LOAD_STATE: Menu_loadState(); break;
-					case SHORTCUT_RESET_GAME: core.reset(); break;
+					case SHORTCUT_RESET_GAME: core.reset(); Rewind_reset(); break;
 					case SHORTCUT_SAVE_QUIT:
 						Menu_saveState();
 						quit = 1;
@@ -1668,12 +2168,7 @@ static void input_poll_callback(void) {
 	
 	if (!ignore_menu && PAD_justReleased(BTN_MENU)) {
 		show_menu = 1;
-		
-		if (thread_video) {
-			pthread_mutex_lock(&core_mx);
-			should_run_core = 0;
-			pthread_mutex_unlock(&core_mx);
-		}
+		if (thread_video) CoreThread_requestPause(); // stop after this frame, the main thread opens the menu
 	}
 	
 	// TODO: figure out how to ignore button when MENU+button is handled first
@@ -1826,11 +2321,9 @@ static bool environment_callback(unsigned cmd, void *data) { // copied from pico
 	case RETRO_ENVIRONMENT_SET_PIXEL_FORMAT: { /* 10 */
 		const enum retro_pixel_format *format = (enum retro_pixel_format *)data;
 
-		if (*format != RETRO_PIXEL_FORMAT_RGB565) { // TODO: pull from platform.h?
-			/* 565 is only supported format */
-			return false;
-			// downsample = 1; // TODO: not ready for primetime yet
-		}
+		if (*format==RETRO_PIXEL_FORMAT_XRGB8888 && allow_xrgb8888) downsample = 1; // converted to 565 before we see it
+		else if (*format != RETRO_PIXEL_FORMAT_RGB565) return false; // TODO: pull from platform.h?
+		else downsample = 0;
 		break;
 	}
 	case RETRO_ENVIRONMENT_SET_INPUT_DESCRIPTORS: { /* 11 */
@@ -1881,12 +2374,15 @@ static bool environment_callback(unsigned cmd, void *data) { // copied from pico
 		bool *out = (bool *)data;
 		if (out) {
 			*out = config.core.changed;
+			if (config.core.changed) runahead.changed = 1; // let the second instance know too
 			config.core.changed = 0;
 		}
 		break;
 	}
 	case RETRO_ENVIRONMENT_SET_FRAME_TIME_CALLBACK: { /* 21 */
-		// LOG_info("%i: RETRO_ENVIRONMENT_SET_FRAME_TIME_CALLBACK\n", cmd);
+		const struct retro_frame_time_callback *cb = (const struct retro_frame_time_callback *)data;
+		if (cb) core.frame_time = *cb;
+		else memset(&core.frame_time, 0, sizeof(core.frame_time));
 		break;
 	}
 	case RETRO_ENVIRONMENT_SET_AUDIO_CALLBACK: { /* 22 */
@@ -1946,7 +2442,11 @@ static bool environment_callback(unsigned cmd, void *data) { // copied from pico
 	
 	// RETRO_ENVIRONMENT_SET_SUPPORT_ACHIEVEMENTS (42 | RETRO_ENVIRONMENT_EXPERIMENTAL)
 	// RETRO_ENVIRONMENT_GET_VFS_INTERFACE (45 | RETRO_ENVIRONMENT_EXPERIMENTAL)
-	// RETRO_ENVIRONMENT_GET_AUDIO_VIDEO_ENABLE (47 | RETRO_ENVIRONMENT_EXPERIMENTAL)
+	case RETRO_ENVIRONMENT_GET_AUDIO_VIDEO_ENABLE: { /* 47 | RETRO_ENVIRONMENT_EXPERIMENTAL */
+		int *out = (int *)data;
+		if (out) *out = (skip_video ? 0 : 1) | (skip_audio || rewinding || (fast_forward && !ff_audio) ? 0 : 2); // so cores can skip rendering and mixing
+		break;
+	}
 	// RETRO_ENVIRONMENT_GET_INPUT_BITMASKS (51 | RETRO_ENVIRONMENT_EXPERIMENTAL)
 	case RETRO_ENVIRONMENT_GET_INPUT_BITMASKS: { /* 51 | RETRO_ENVIRONMENT_EXPERIMENTAL */
 		bool *out = (bool *)data;
@@ -1999,34 +2499,21 @@ static bool environment_callback(unsigned cmd, void *data) { // copied from pico
 		break;
 	}
 	// TODO: RETRO_ENVIRONMENT_GET_MESSAGE_INTERFACE_VERSION 59
-	// TODO: used by mgba, (but only during frameskip?)
-	// case RETRO_ENVIRONMENT_SET_AUDIO_BUFFER_STATUS_CALLBACK: { /* 62 */
-	// 	LOG_info("RETRO_ENVIRONMENT_SET_AUDIO_BUFFER_STATUS_CALLBACK\n");
-	// 	const struct retro_audio_buffer_status_callback *cb = (const struct retro_audio_buffer_status_callback *)data;
-	// 	if (cb) {
-	// 		LOG_info("has audo_buffer_status callback\n");
-	// 		core.audio_buffer_status = cb->callback;
-	// 	} else {
-	// 		LOG_info("no audo_buffer_status callback\n");
-	// 		core.audio_buffer_status = NULL;
-	// 	}
-	// 	break;
-	// }
-	// TODO: used by mgba, (but only during frameskip?)
-	// case RETRO_ENVIRONMENT_SET_MINIMUM_AUDIO_LATENCY: { /* 63 */
-	// 	LOG_info("RETRO_ENVIRONMENT_SET_MINIMUM_AUDIO_LATENCY\n");
-	//
-	// 	const unsigned *latency_ms = (const unsigned *)data;
-	// 	if (latency_ms) {
-	// 		unsigned frames = *latency_ms * core.fps / 1000;
-	// 		if (frames < 30)
-	// 			// audio_buffer_size_override = frames;
-	// 			LOG_info("audio_buffer_size_override = %i (unused?)\n", frames);
-	// 		else
-	// 			LOG_info("Audio buffer change out of range (%d), ignored\n", frames);
-	// 	}
-	// 	break;
-	// }
+	// used by cores with their own frameskip (eg. snes9x, pcsx, mgba)
+	case RETRO_ENVIRONMENT_SET_AUDIO_BUFFER_STATUS_CALLBACK: { /* 62 */
+		const struct retro_audio_buffer_status_callback *cb = (const struct retro_audio_buffer_status_callback *)data;
+		core.audio_buffer_status = cb ? cb->callback : NULL;
+		LOG_info("%s audio_buffer_status callback\n", core.audio_buffer_status ? "has" : "no");
+		break;
+	}
+	case RETRO_ENVIRONMENT_SET_MINIMUM_AUDIO_LATENCY: { /* 63 */
+		const unsigned *latency_ms = (const unsigned *)data;
+		if (latency_ms) {
+			LOG_info("minimum audio latency: %ums\n", *latency_ms);
+			SND_setMinimumLatency(*latency_ms); // takes effect on the next batch
+		}
+		break;
+	}
 
 	// TODO: RETRO_ENVIRONMENT_SET_FASTFORWARDING_OVERRIDE 64
 	case RETRO_ENVIRONMENT_SET_CONTENT_INFO_OVERRIDE: { /* 65 */
@@ -2053,19 +2540,16 @@ static bool environment_callback(unsigned cmd, void *data) { // copied from pico
 		break;
 	}
 	
-	// unused
-	// case RETRO_ENVIRONMENT_SET_FRAME_TIME_CALLBACK: {
-	// 	puts("RETRO_ENVIRONMENT_SET_FRAME_TIME_CALLBACK"); fflush(stdout);
-	// 	break;
-	// }
-	// case RETRO_ENVIRONMENT_GET_THROTTLE_STATE: {
-	// 	puts("RETRO_ENVIRONMENT_GET_THROTTLE_STATE"); fflush(stdout);
-	// 	break;
-	// }
-	// case RETRO_ENVIRONMENT_GET_FASTFORWARDING: {
-	// 	puts("RETRO_ENVIRONMENT_GET_FASTFORWARDING"); fflush(stdout);
-	// 	break;
-	// };
+	case RETRO_ENVIRONMENT_GET_FASTFORWARDING: { /* 49 | RETRO_ENVIRONMENT_EXPERIMENTAL */
+		bool *out = (bool *)data;
+		if (out) *out = fast_forward;
+		break;
+	}
+	case RETRO_ENVIRONMENT_GET_THROTTLE_STATE: { /* 71 | RETRO_ENVIRONMENT_EXPERIMENTAL */
+		struct retro_throttle_state *state = (struct retro_throttle_state *)data;
+		if (state) getThrottleState(state);
+		break;
+	}
 	
 	default:
 		// LOG_debug("Unsupported environment cmd: %u\n", cmd);
@@ -2352,6 +2836,36 @@ static const char* bitmap_font[] = {
 		"     "
 		"     "
 		"     ",
+	['+'] =
+		"     "
+		"     "
+		"  1  "
+		"  1  "
+		"11111"
+		"  1  "
+		"  1  "
+		"     "
+		"     ",
+	['m'] =
+		"     "
+		"     "
+		"11 1 "
+		"1 1 1"
+		"1 1 1"
+		"1 1 1"
+		"1 1 1"
+		"1 1 1"
+		"1 1 1",
+	['s'] =
+		"     "
+		"     "
+		" 111 "
+		"1    "
+		"1    "
+		" 111 "
+		"    1"
+		"    1"
+		"1111 ",
 	};
 static void blitBitmapText(char* text, int ox, int oy, uint16_t* data, int stride, int width, int height) {
 	#define CHAR_WIDTH 5
@@ -2383,6 +2897,138 @@ static void blitBitmapText(char* text, int ox, int oy, uint16_t* data, int strid
 
 ///////////////////////////////
 
+// vsync only gets the speed right for cores that run at (or close
+// enough to) the display's rate. everything else is paced by sleeping
+// until an absolute deadline one core.fps frame after the last, nudged
+// by the audio buffer fill so the sound card's clock stays in charge
+
+enum {
+	PACING_VIDEO,
+	PACING_AUDIO,
+	PACING_HYBRID, // video when core.fps is within PACE_TOLERANCE of the display, audio otherwise
+};
+
+#define PACE_TOLERANCE 0.01 // close enough for audio rate control to absorb
+#define PACE_AUDIO_DELTA 0.005 // max frame time adjustment
+#define PACE_MAX_LAG 4 // frames behind before starting over (eg. after the menu)
+
+static struct Pacer_Context {
+	uint64_t deadline; // ns on CLOCK_MONOTONIC, 0 when not pacing
+	double frame_time; // ns
+	double display_hz; // from the platform, after GFX_init()
+} pacer = {.display_hz=60.0};
+
+static uint64_t Pacer_now(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+static int Pacer_usesClock(void) {
+	if (thread_video) return 1; // nothing else paces the core thread
+	switch (frame_pacing) {
+		case PACING_VIDEO: return 0;
+		case PACING_AUDIO: return 1;
+		default: return fabs(core.fps / pacer.display_hz - 1.0) > PACE_TOLERANCE;
+	}
+}
+static int Pacer_isLate(void) { // a whole frame behind, don't wait on vsync for this one
+	return pacer.deadline && Pacer_now() > pacer.deadline + pacer.frame_time;
+}
+static void Pacer_wait(void) {
+	if (fast_forward || !Pacer_usesClock()) {
+		pacer.deadline = 0; // limitFF() or vsync has it
+		return;
+	}
+	
+	// running ahead of the audio (buffer filling up) stretches frames, behind shrinks them
+	pacer.frame_time = 1000000000.0 / core.fps;
+	pacer.frame_time *= 1.0 + PACE_AUDIO_DELTA * (SND_getFill() - 50) / 50.0;
+	
+	uint64_t now = Pacer_now();
+	if (!pacer.deadline || now > pacer.deadline + PACE_MAX_LAG * pacer.frame_time) pacer.deadline = now;
+	pacer.deadline += pacer.frame_time;
+	if (pacer.deadline<=now) return;
+	
+	struct timespec deadline = {
+		.tv_sec = pacer.deadline / 1000000000,
+		.tv_nsec = pacer.deadline % 1000000000,
+	};
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL)==EINTR);
+}
+static void getThrottleState(struct retro_throttle_state* state) {
+	if (fast_forward) {
+		state->mode = RETRO_THROTTLE_FAST_FORWARD;
+		state->rate = max_ff_speed ? core.fps * (max_ff_speed + 1) : 0; // limitFF(), 0 is unlimited
+	}
+	else if (rewinding) {
+		state->mode = RETRO_THROTTLE_REWINDING;
+		state->rate = core.fps;
+	}
+	else if (Pacer_usesClock()) {
+		state->mode = RETRO_THROTTLE_NONE;
+		state->rate = core.fps;
+	}
+	else {
+		state->mode = RETRO_THROTTLE_VSYNC;
+		state->rate = pacer.display_hz;
+	}
+}
+
+///////////////////////////////
+
+// shared by the threaded video stages
+
+static struct Stages_Context {
+	// us per frame, smoothed, each written by one thread and read by the hud
+	uint64_t core; // Core_run() on the core thread
+	uint64_t convert; // pipeline worker
+	uint64_t present; // blit and flip on the main thread
+} stages;
+
+static void Stages_track(uint64_t* stage, uint64_t then) {
+	*stage = (*stage * 15 + (getMicroseconds() - then)) / 16;
+}
+static void getDeadline(struct timespec* deadline, int ms) { // for sem_timedwait() and pthread_cond_timedwait()
+	clock_gettime(CLOCK_REALTIME, deadline);
+	deadline->tv_nsec += ms * 1000000L;
+	deadline->tv_sec += deadline->tv_nsec / 1000000000L;
+	deadline->tv_nsec %= 1000000000L;
+}
+static void setAffinity(int cpu, char* name) { // from the thread being pinned
+	if (cpu<0) return;
+	if (pinThread(cpu)) LOG_error("setAffinity: unable to pin %s thread to cpu %i\n", name, cpu);
+	else LOG_info("setAffinity: pinned %s thread to cpu %i\n", name, cpu);
+}
+
+///////////////////////////////
+
+// frameskip trades smoothness for speed when a core can't keep up.
+// skipped frames still run (and are heard) but aren't blit or flipped,
+// cores that check GET_AUDIO_VIDEO_ENABLE can skip rendering them too.
+// auto skips while the audio buffer is draining, fixed shows one frame
+// then skips n
+
+enum {
+	FRAMESKIP_OFF,
+	FRAMESKIP_AUTO,
+	// FRAMESKIP_AUTO+n skips n frames after every shown frame
+};
+
+#define FRAMESKIP_THRESHOLD 25 // audio buffer fill (percent) below which auto skips
+#define FRAMESKIP_MAX 3 // consecutive skipped frames, either mode
+
+static int Frameskip_next(void) { // returns 1 if the coming frame shouldn't be shown
+	static int skipped = 0;
+	int skip = 0;
+	if (frameskip==FRAMESKIP_AUTO) skip = SND_getFill()<FRAMESKIP_THRESHOLD;
+	else if (frameskip>FRAMESKIP_AUTO) skip = skipped<frameskip-FRAMESKIP_AUTO;
+	if (fast_forward || rewinding || skipped>=FRAMESKIP_MAX) skip = 0;
+	skipped = skip ? skipped+1 : 0;
+	return skip;
+}
+
+///////////////////////////////
+
 static int cpu_ticks = 0;
 static int fps_ticks = 0;
 static int use_ticks = 0;
@@ -2399,39 +3045,30 @@ static uint32_t sec_start = 0;
 
 // buffer to convert xrgb8888 to rgb565
 static void* buffer = NULL;
+static size_t buffer_size = 0;
 static void buffer_dealloc(void) {
 	if (!buffer) return;
 	free(buffer);
 	buffer = NULL;
+	buffer_size = 0;
 }
 static void buffer_realloc(int w, int h, int p) {
+	size_t size = MAX(w * FIXED_BPP, p) * h;
+	if (size<=buffer_size) return; // keep it, renderer.src may point into it
 	buffer_dealloc();
-	buffer = malloc((w * FIXED_BPP) * h);
+	buffer = malloc(size);
+	if (buffer) buffer_size = size;
 	// LOG_info("buffer_realloc(%i,%i,%i)\n", w,h,p);
 }
-static void buffer_downsample(const void *data, unsigned width, unsigned height, size_t pitch) {
-	// from picoarch! https://git.crowdedwood.com/picoarch/tree/video.c#n51
-	const uint32_t *input = data;
-	uint16_t *output = buffer;
-	size_t extra = pitch / sizeof(uint32_t) - width;
-
-	for (int y = 0; y < height; y++) {
-		for (int x = 0; x < width; x++) {
-			*output =  (*input & 0xF80000) >> 8;
-			*output |= (*input & 0xFC00) >> 5;
-			*output |= (*input & 0xF8) >> 3;
-			input++;
-			output++;
-		}
-
-		input += extra; // TODO: commenting this out fixes geolith when cropped, it appears to be lying about the pitch...
-	}
+static void buffer_downsample(const void *data, unsigned width, unsigned height, size_t pitch, void* dst, size_t dst_pitch) {
+	// TODO: geolith appears to lie about its pitch when cropped, ignoring it (sp=0) used to fix that
+	convert_32to16((void*)data, dst, width, height, pitch, dst_pitch, dither);
 }
 
 static void selectScaler(int src_w, int src_h, int src_p) {
 	LOG_info("selectScaler\n");
 	
-	if (downsample) buffer_realloc(src_w,src_h,src_p);
+	if (downsample && renderer.src_bpp!=4) buffer_realloc(src_w,src_h,src_p); // otherwise the blit converts
 	
 	int src_x,src_y,dst_x,dst_y,dst_w,dst_h,dst_p,scale;
 	double aspect;
@@ -2665,12 +3302,9 @@ static void selectScaler(int src_w, int src_h, int src_p) {
 		screen = GFX_resize(dst_w,dst_h,dst_p);
 	// }
 }
-static void video_refresh_callback_main(const void *data, unsigned width, unsigned height, size_t pitch) {
+static void video_refresh_frame(const void *data, unsigned width, unsigned height, size_t pitch, int convert) {
 	// return;
 	
-	// static int tmp_frameskip = 0;
-	// if ((tmp_frameskip++)%2) return;
-	
 	static uint32_t last_flip_time = 0;
 	
 	// 10 seems to be the sweet spot that allows 2x in NES and SNES and 8x in GB at 60fps
@@ -2679,6 +3313,9 @@ static void video_refresh_callback_main(const void *data, unsigned width, unsign
 	// TODO: 10 was based on rg35xx, probably different results on other supported platforms
 	if (fast_forward && SDL_GetTicks()-last_flip_time<10) return;
 	
+	// eg. a 75fps core on a 60hz display, skip a present rather than fall further behind
+	if (!thread_video && Pacer_isLate()) return;
+	
 	// FFVII menus 
 	// 16: 30/200
 	// 15: 30/180
@@ -2693,15 +3330,24 @@ static void video_refresh_callback_main(const void *data, unsigned width, unsign
 
 	fps_ticks += 1;
 	
-	if (downsample) pitch /= 2; // everything expects 16 but we're downsampling from 32
+	// let the scaler convert as it blits unless the hud or dither needs a 565 copy first
+	int fused = convert && !show_debug && !dither;
+	int bpp = fused ? 4 : FIXED_BPP;
+	if (convert && !fused) pitch /= 2; // everything expects 16 but we're downsampling from 32
 	
 	// if source has changed size (or forced by dst_p==0)
 	// eg. true src + cropped src + fixed dst + cropped dst
-	if (renderer.dst_p==0 || width!=renderer.true_w || height!=renderer.true_h) {
+	if (renderer.dst_p==0 || width!=renderer.true_w || height!=renderer.true_h || bpp!=renderer.src_bpp) {
+		renderer.src_bpp = bpp;
 		selectScaler(width, height, pitch);
 		GFX_clearAll();
 	}
 	
+	if (convert && !fused) {
+		buffer_downsample(data,width,height,pitch*2,buffer,pitch);
+		data = buffer; // so the hud draws on what we present
+	}
+	
 	// debug
 	if (show_debug) {
 		int x = 2 + renderer.src_x;
@@ -2712,24 +3358,31 @@ static void video_refresh_callback_main(const void *data, unsigned width, unsign
 		
 		sprintf(debug_text, "%ix%i %ix", renderer.src_w,renderer.src_h, scale);
 		blitBitmapText(debug_text,x,y,(uint16_t*)data,pitch/2, width,height);
+		
+		if (runahead_frames && !runahead.failed) {
+			sprintf(debug_text, "+%i %.01fms", runahead_frames, runahead.overhead / 1000.0);
+			blitBitmapText(debug_text,x,y+CHAR_HEIGHT+1,(uint16_t*)data,pitch/2, width,height);
+		}
 
 		sprintf(debug_text, "%i,%i %ix%i", renderer.dst_x,renderer.dst_y, renderer.src_w*scale,renderer.src_h*scale);
 		blitBitmapText(debug_text,-x,y,(uint16_t*)data,pitch/2, width,height);
 	
 		sprintf(debug_text, "%.01f/%.01f %i%%", fps_double, cpu_double, (int)use_double);
 		blitBitmapText(debug_text,x,-y,(uint16_t*)data,pitch/2, width,height);
+		
+		sprintf(debug_text, "%i%% %ims", SND_getFill(), SND_getLatency());
+		blitBitmapText(debug_text,x,-y-CHAR_HEIGHT-1,(uint16_t*)data,pitch/2, width,height);
+		
+		if (thread_video) { // core/convert/present
+			sprintf(debug_text, "%.01f/%.01f/%.01fms", stages.core / 1000.0, stages.convert / 1000.0, stages.present / 1000.0);
+			blitBitmapText(debug_text,x,-y-(CHAR_HEIGHT+1)*2,(uint16_t*)data,pitch/2, width,height);
+		}
 	
 		sprintf(debug_text, "%ix%i", renderer.dst_w,renderer.dst_h);
 		blitBitmapText(debug_text,-x,-y,(uint16_t*)data,pitch/2, width,height);
 	}
 	
-	if (downsample) {
-		buffer_downsample(data,width,height,pitch*2);
-		renderer.src = buffer;
-	}
-	else {
-		renderer.src = (void*)data;
-	}
+	renderer.src = (void*)data;
 	renderer.dst = screen->pixels;
 	// LOG_info("video_refresh_callback: %ix%i@%i %ix%i@%i\n",width,height,pitch,screen->w,screen->h,screen->pitch);
 	
@@ -2738,39 +3391,201 @@ static void video_refresh_callback_main(const void *data, unsigned width, unsign
 	if (!thread_video) GFX_flip(screen);
 	last_flip_time = SDL_GetTicks();
 }
-static void video_refresh_callback(const void *data, unsigned width, unsigned height, size_t pitch) {
-	if (!data) return;
+static void video_refresh_callback_main(const void *data, unsigned width, unsigned height, size_t pitch) {
+	video_refresh_frame(data,width,height,pitch,downsample);
+}
+
+///////////////////////////////
+
+// with the pipeline on, a worker sits between the core thread and
+// the main thread. it takes the core's frames from the mailbox and
+// converts them so the main thread only uploads and presents. up to
+// depth converted frames queue for the main thread, each a frame of
+// latency, and the worker stops taking frames while the queue is
+// full so the mailbox drops the stale ones. scaling happens on the
+// gpu at present on this platform so it stays on the main thread
+
+#define PIPELINE_MAX_DEPTH 2
+#define PIPELINE_SLOTS (PIPELINE_MAX_DEPTH + 2) // queued + converting + presenting
+#define PIPELINE_TIMEOUT 100 // ms
+
+static struct Pipeline_Context {
+	pthread_t pt;
+	pthread_mutex_t mx;
+	pthread_cond_t cv;
+	int started;
+	int stop;
+	int depth;
+	MailboxFrame frames[PIPELINE_SLOTS]; // rgb565
+	int queue[PIPELINE_SLOTS]; // converted slots, oldest first
+	int head;
+	int count;
+	int converting; // slot owned by the worker, -1 if none
+	int presenting; // slot owned by the main thread, renderer.src points into it, -1 if none
+} pipeline = {
+	.mx = PTHREAD_MUTEX_INITIALIZER,
+	.cv = PTHREAD_COND_INITIALIZER,
+	.converting = -1,
+	.presenting = -1,
+};
+
+static int Pipeline_isFree(int slot) {
+	if (slot==pipeline.converting || slot==pipeline.presenting) return 0;
+	for (int i=0; i<pipeline.count; i++) {
+		if (pipeline.queue[(pipeline.head + i) % PIPELINE_SLOTS]==slot) return 0;
+	}
+	return 1;
+}
+static int Pipeline_convert(MailboxFrame* dst, MailboxFrame* src) { // returns 0 if dst is unchanged
+	size_t pitch = downsample ? src->width * FIXED_BPP : src->pitch;
+	size_t size = src->height * pitch;
+	if (size>dst->capacity) {
+		void* pixels = realloc(dst->pixels, size);
+		if (!pixels) return 0;
+		dst->pixels = pixels;
+		dst->capacity = size;
+	}
+	
+	if (downsample) buffer_downsample(src->pixels,src->width,src->height,src->pitch,dst->pixels,pitch);
+	else memcpy(dst->pixels, src->pixels, size);
+	
+	dst->width = src->width;
+	dst->height = src->height;
+	dst->pitch = pitch;
+	return 1;
+}
+static void* Pipeline_loop(void *arg) {
+	setAffinity(pipeline_cpu, "pipeline");
 	
-	if (thread_video) {
-		pthread_mutex_lock(&core_mx);
-		
-		if (backbuffer && (backbuffer->w!=width || backbuffer->h!=height || backbuffer->pitch!=pitch)) {
-			free(backbuffer->pixels);
-			SDL_FreeSurface(backbuffer);
-			backbuffer = NULL;
-		}
-		if (!backbuffer) {
-			uint16_t* pixels = malloc(height*pitch);
-			// backbuffer = SDL_CreateRGBSurface(0,width,height,FIXED_DEPTH,RGBA_MASK_565);
-			backbuffer = SDL_CreateRGBSurfaceFrom(pixels, width, height, FIXED_DEPTH, pitch, RGBA_MASK_565);
+	pthread_mutex_lock(&pipeline.mx);
+	while (!pipeline.stop) {
+		if (pipeline.count>=pipeline.depth) { // main thread is behind
+			pthread_cond_wait(&pipeline.cv, &pipeline.mx);
+			continue;
 		}
+		pthread_mutex_unlock(&pipeline.mx);
+		MailboxFrame* src = Mailbox_wait();
+		pthread_mutex_lock(&pipeline.mx);
+		if (!src || pipeline.stop) continue;
 		
-		memcpy(backbuffer->pixels, data, backbuffer->h*backbuffer->pitch);
+		int slot = 0;
+		while (!Pipeline_isFree(slot)) slot += 1; // there's always one, see PIPELINE_SLOTS
+		pipeline.converting = slot;
+		pthread_mutex_unlock(&pipeline.mx);
 		
-		pthread_cond_signal(&core_rq);
-		pthread_mutex_unlock(&core_mx);
+		uint64_t then = getMicroseconds();
+		int converted = Pipeline_convert(&pipeline.frames[slot], src);
+		Stages_track(&stages.convert, then);
+		
+		pthread_mutex_lock(&pipeline.mx);
+		pipeline.converting = -1;
+		if (!converted) { // drop it, the slot still holds an older frame
+			LOG_error("Pipeline_loop: out of memory for a %ux%u frame\n", src->width, src->height);
+			continue;
+		}
+		pipeline.queue[(pipeline.head + pipeline.count) % PIPELINE_SLOTS] = slot;
+		pipeline.count += 1;
+		pthread_cond_broadcast(&pipeline.cv);
+	}
+	pthread_mutex_unlock(&pipeline.mx);
+	return NULL;
+}
+
+static void Pipeline_start(void) { // main thread, takes the mailbox over from it
+	if (pipeline.started) return;
+	
+	pthread_mutex_lock(&pipeline.mx);
+	pipeline.stop = 0;
+	pipeline.depth = MIN(video_pipeline, PIPELINE_MAX_DEPTH);
+	pipeline.head = 0;
+	pipeline.count = 0;
+	pipeline.converting = -1;
+	pthread_mutex_unlock(&pipeline.mx);
+	stages.convert = 0;
+	
+	if (pthread_create(&pipeline.pt, NULL, &Pipeline_loop, NULL)) {
+		LOG_error("Pipeline_start: unable to create thread\n");
+		return;
+	}
+	pipeline.started = 1;
+}
+static void Pipeline_stop(void) { // main thread, hands the mailbox back to it
+	if (!pipeline.started) return;
+	
+	pthread_mutex_lock(&pipeline.mx);
+	pipeline.stop = 1;
+	pthread_cond_broadcast(&pipeline.cv);
+	pthread_mutex_unlock(&pipeline.mx);
+	Mailbox_wake();
+	
+	pthread_join(pipeline.pt, NULL);
+	pipeline.started = 0;
+	stages.convert = 0;
+	// keep the frames, renderer.src may still point into one
+}
+static void Pipeline_sync(void) { // main thread, after thread_video or video_pipeline change
+	if (!thread_video || !video_pipeline) {
+		Pipeline_stop();
+		return;
+	}
+	if (!pipeline.started) {
+		Pipeline_start();
+		return;
 	}
+	pthread_mutex_lock(&pipeline.mx);
+	pipeline.depth = MIN(video_pipeline, PIPELINE_MAX_DEPTH);
+	pthread_cond_broadcast(&pipeline.cv);
+	pthread_mutex_unlock(&pipeline.mx);
+}
+static MailboxFrame* Pipeline_wait(void) { // main thread, returns NULL on timeout
+	pthread_mutex_lock(&pipeline.mx);
+	if (!pipeline.count) {
+		struct timespec deadline;
+		getDeadline(&deadline, PIPELINE_TIMEOUT);
+		while (!pipeline.count) {
+			if (pthread_cond_timedwait(&pipeline.cv, &pipeline.mx, &deadline)) break;
+		}
+	}
+	
+	MailboxFrame* frame = NULL;
+	if (pipeline.count) {
+		pipeline.presenting = pipeline.queue[pipeline.head];
+		pipeline.head = (pipeline.head + 1) % PIPELINE_SLOTS;
+		pipeline.count -= 1;
+		pthread_cond_broadcast(&pipeline.cv); // room for the worker
+		frame = &pipeline.frames[pipeline.presenting];
+	}
+	pthread_mutex_unlock(&pipeline.mx);
+	return frame;
+}
+static void Pipeline_quit(void) {
+	Pipeline_stop();
+	for (int i=0; i<PIPELINE_SLOTS; i++) {
+		free(pipeline.frames[i].pixels);
+		pipeline.frames[i].pixels = NULL;
+		pipeline.frames[i].capacity = 0;
+	}
+	pipeline.presenting = -1;
+}
+
+static void video_refresh_callback(const void *data, unsigned width, unsigned height, size_t pitch) {
+	if (!data || skip_video) return;
+	
+	if (thread_video) Mailbox_post(data,width,height,pitch);
 	else video_refresh_callback_main(data,width,height,pitch);
 }
 ///////////////////////////////
 
-// NOTE: sound must be disabled for fast forward to work...
+// NOTE: fast forward must never wait on the audio device, see SND_batchSamplesFast()
 static void audio_sample_callback(int16_t left, int16_t right) {
-	if (!fast_forward) SND_batchSamples(&(const SND_Frame){left,right}, 1);
+	if (rewinding || skip_audio) return;
+	if (fast_forward) SND_batchSamplesFast(&(const SND_Frame){left,right}, 1, ff_audio);
+	else SND_batchSamples(&(const SND_Frame){left,right}, 1);
 }
 static size_t audio_sample_batch_callback(const int16_t *data, size_t frames) { 
-	if (!fast_forward) return SND_batchSamples((const SND_Frame*)data, frames);
-	else return frames;
+	if (rewinding || skip_audio) return frames;
+	if (fast_forward) return SND_batchSamplesFast((const SND_Frame*)data, frames, ff_audio);
+	else return SND_batchSamples((const SND_Frame*)data, frames);
 	// return frames;
 };
 
@@ -2781,28 +3596,23 @@ void Core_getName(char* in_name, char* out_name) {
 	char* tmp = strrchr(out_name, '_');
 	tmp[0] = '\0';
 }
-void Core_open(const char* core_path, const char* tag_name) {
-	LOG_info("Core_open\n");
-	core.handle = dlopen(core_path, RTLD_LAZY);
-	
-	if (!core.handle) LOG_error("%s\n", dlerror());
-	
-	core.init = dlsym(core.handle, "retro_init");
-	core.deinit = dlsym(core.handle, "retro_deinit");
-	core.get_system_info = dlsym(core.handle, "retro_get_system_info");
-	core.get_system_av_info = dlsym(core.handle, "retro_get_system_av_info");
-	core.set_controller_port_device = dlsym(core.handle, "retro_set_controller_port_device");
-	core.reset = dlsym(core.handle, "retro_reset");
-	core.run = dlsym(core.handle, "retro_run");
-	core.serialize_size = dlsym(core.handle, "retro_serialize_size");
-	core.serialize = dlsym(core.handle, "retro_serialize");
-	core.unserialize = dlsym(core.handle, "retro_unserialize");
-	core.load_game = dlsym(core.handle, "retro_load_game");
-	core.load_game_special = dlsym(core.handle, "retro_load_game_special");
-	core.unload_game = dlsym(core.handle, "retro_unload_game");
-	core.get_region = dlsym(core.handle, "retro_get_region");
-	core.get_memory_data = dlsym(core.handle, "retro_get_memory_data");
-	core.get_memory_size = dlsym(core.handle, "retro_get_memory_size");
+static void Core_bind(struct Core* instance, retro_environment_t environment) { // load symbols from instance->handle
+	instance->init = dlsym(instance->handle, "retro_init");
+	instance->deinit = dlsym(instance->handle, "retro_deinit");
+	instance->get_system_info = dlsym(instance->handle, "retro_get_system_info");
+	instance->get_system_av_info = dlsym(instance->handle, "retro_get_system_av_info");
+	instance->set_controller_port_device = dlsym(instance->handle, "retro_set_controller_port_device");
+	instance->reset = dlsym(instance->handle, "retro_reset");
+	instance->run = dlsym(instance->handle, "retro_run");
+	instance->serialize_size = dlsym(instance->handle, "retro_serialize_size");
+	instance->serialize = dlsym(instance->handle, "retro_serialize");
+	instance->unserialize = dlsym(instance->handle, "retro_unserialize");
+	instance->load_game = dlsym(instance->handle, "retro_load_game");
+	instance->load_game_special = dlsym(instance->handle, "retro_load_game_special");
+	instance->unload_game = dlsym(instance->handle, "retro_unload_game");
+	instance->get_region = dlsym(instance->handle, "retro_get_region");
+	instance->get_memory_data = dlsym(instance->handle, "retro_get_memory_data");
+	instance->get_memory_size = dlsym(instance->handle, "retro_get_memory_size");
 	
 	void (*set_environment_callback)(retro_environment_t);
 	void (*set_video_refresh_callback)(retro_video_refresh_t);
@@ -2811,12 +3621,26 @@ void Core_open(const char* core_path, const char* tag_name) {
 	void (*set_input_poll_callback)(retro_input_poll_t);
 	void (*set_input_state_callback)(retro_input_state_t);
 	
-	set_environment_callback = dlsym(core.handle, "retro_set_environment");
-	set_video_refresh_callback = dlsym(core.handle, "retro_set_video_refresh");
-	set_audio_sample_callback = dlsym(core.handle, "retro_set_audio_sample");
-	set_audio_sample_batch_callback = dlsym(core.handle, "retro_set_audio_sample_batch");
-	set_input_poll_callback = dlsym(core.handle, "retro_set_input_poll");
-	set_input_state_callback = dlsym(core.handle, "retro_set_input_state");
+	set_environment_callback = dlsym(instance->handle, "retro_set_environment");
+	set_video_refresh_callback = dlsym(instance->handle, "retro_set_video_refresh");
+	set_audio_sample_callback = dlsym(instance->handle, "retro_set_audio_sample");
+	set_audio_sample_batch_callback = dlsym(instance->handle, "retro_set_audio_sample_batch");
+	set_input_poll_callback = dlsym(instance->handle, "retro_set_input_poll");
+	set_input_state_callback = dlsym(instance->handle, "retro_set_input_state");
+	
+	set_environment_callback(environment);
+	set_video_refresh_callback(video_refresh_callback);
+	set_audio_sample_callback(audio_sample_callback);
+	set_audio_sample_batch_callback(audio_sample_batch_callback);
+	set_input_poll_callback(input_poll_callback);
+	set_input_state_callback(input_state_callback);
+}
+void Core_open(const char* core_path, const char* tag_name) {
+	LOG_info("Core_open\n");
+	core.handle = dlopen(core_path, RTLD_LAZY);
+	
+	if (!core.handle) LOG_error("%s\n", dlerror());
+	Core_bind(&core, environment_callback);
 	
 	struct retro_system_info info = {};
 	core.get_system_info(&info);
@@ -2838,13 +3662,14 @@ void Core_open(const char* core_path, const char* tag_name) {
 	char cmd[512];
 	sprintf(cmd, "mkdir -p \"%s\"; mkdir -p \"%s\"", core.config_dir, core.states_dir);
 	system(cmd);
-
-	set_environment_callback(environment_callback);
-	set_video_refresh_callback(video_refresh_callback);
-	set_audio_sample_callback(audio_sample_callback);
-	set_audio_sample_batch_callback(audio_sample_batch_callback);
-	set_input_poll_callback(input_poll_callback);
-	set_input_state_callback(input_state_callback);
+	
+	strcpy(runahead.core_path, core_path); // in case we need a second instance later
+}
+static void Core_getGameInfo(struct retro_game_info* game_info) {
+	game_info->path = game.tmp_path[0]?game.tmp_path:(game.zip_path[0]?game.zip_path:game.path);
+	game_info->data = game.data;
+	game_info->size = game.size;
+	game_info->meta = NULL;
 }
 void Core_init(void) {
 	LOG_info("Core_init\n");
@@ -2854,9 +3679,7 @@ void Core_init(void) {
 void Core_load(void) {
 	LOG_info("Core_load\n");
 	struct retro_game_info game_info;
-	game_info.path = game.tmp_path[0]?game.tmp_path:game.path;
-	game_info.data = game.data;
-	game_info.size = game.size;
+	Core_getGameInfo(&game_info);
 	LOG_info("game path: %s (%i)\n", game_info.path, game.size);
 	
 	core.load_game(&game_info);
@@ -2874,12 +3697,18 @@ void Core_load(void) {
 	double a = av_info.geometry.aspect_ratio;
 	if (a<=0) a = (double)av_info.geometry.base_width / av_info.geometry.base_height;
 	core.aspect_ratio = a;
+	core.max_width = av_info.geometry.max_width;
+	core.max_height = av_info.geometry.max_height;
 	
 	LOG_info("aspect_ratio: %f (%ix%i) fps: %f\n", a, av_info.geometry.base_width,av_info.geometry.base_height, core.fps);
 }
 void Core_reset(void) {
 	core.reset();
 }
+void Core_setControllerDevice(unsigned device) {
+	core.set_controller_port_device(0, device);
+	if (runahead.open) runahead.secondary.set_controller_port_device(0, device);
+}
 void Core_unload(void) {
 	SND_quit();
 }
@@ -2898,6 +3727,144 @@ void Core_close(void) {
 
 ///////////////////////////////////////
 
+// run ahead itself is in runahead.c. with a second instance the
+// real frame runs normally on the main core and its state is copied
+// into the second, which runs ahead on its own. costs a load per
+// frame less and cores with side effects in unserialize (eg. audio
+// glitches) stay clean, but doubles the memory. dlopen() won't load
+// the same library twice so the second instance is loaded from a
+// copy in /tmp
+
+static bool RunAhead_environment(unsigned cmd, void *data) {
+	switch (cmd) {
+		// the main instance owns these
+		case RETRO_ENVIRONMENT_SET_INPUT_DESCRIPTORS:
+		case RETRO_ENVIRONMENT_SET_DISK_CONTROL_INTERFACE:
+		case RETRO_ENVIRONMENT_SET_VARIABLES:
+		case RETRO_ENVIRONMENT_SET_CONTROLLER_INFO:
+		case RETRO_ENVIRONMENT_SET_CORE_OPTIONS:
+		case RETRO_ENVIRONMENT_SET_CORE_OPTIONS_INTL:
+		case RETRO_ENVIRONMENT_SET_DISK_CONTROL_EXT_INTERFACE:
+		case RETRO_ENVIRONMENT_SET_VARIABLE:
+		case RETRO_ENVIRONMENT_SET_AUDIO_BUFFER_STATUS_CALLBACK:
+		case RETRO_ENVIRONMENT_SET_MINIMUM_AUDIO_LATENCY:
+		case RETRO_ENVIRONMENT_SET_FRAME_TIME_CALLBACK:
+			return false;
+		case RETRO_ENVIRONMENT_GET_VARIABLE_UPDATE: {
+			bool *out = (bool *)data;
+			if (out) {
+				*out = runahead.changed;
+				runahead.changed = 0;
+			}
+			return true;
+		}
+	}
+	return environment_callback(cmd, data);
+}
+static void RunAhead_close(void) {
+	if (!runahead.open) return;
+	LOG_info("RunAhead_close\n");
+	runahead.secondary.unload_game();
+	runahead.secondary.deinit();
+	dlclose(runahead.secondary.handle);
+	memset(&runahead.secondary, 0, sizeof(runahead.secondary));
+	runahead.open = 0;
+}
+static int RunAhead_open(void) {
+	LOG_info("RunAhead_open\n");
+	
+	char copy_path[MAX_PATH];
+	strcpy(copy_path, "/tmp/minarch-runahead-XXXXXX.so");
+	int fd = mkstemps(copy_path, 3);
+	if (fd==-1) {
+		LOG_error("RunAhead_open: couldn't create %s\n", copy_path);
+		return 0;
+	}
+	
+	int copied = 0;
+	FILE* src = fopen(runahead.core_path, "rb");
+	FILE* dst = fdopen(fd, "wb");
+	if (src && dst) {
+		char chunk[64 * 1024];
+		size_t count;
+		while ((count=fread(chunk, 1, sizeof(chunk), src))>0) {
+			if (fwrite(chunk, 1, count, dst)!=count) break;
+		}
+		copied = !ferror(src) && !ferror(dst);
+	}
+	if (src) fclose(src);
+	if (dst) fclose(dst);
+	else close(fd);
+	
+	if (copied) runahead.secondary.handle = dlopen(copy_path, RTLD_LAZY);
+	unlink(copy_path); // stays mapped until dlclose
+	if (!runahead.secondary.handle) {
+		LOG_error("RunAhead_open: %s\n", copied ? dlerror() : "couldn't copy core");
+		return 0;
+	}
+	
+	Core_bind(&runahead.secondary, RunAhead_environment);
+	runahead.secondary.init();
+	
+	struct retro_game_info game_info;
+	Core_getGameInfo(&game_info);
+	if (!runahead.secondary.load_game(&game_info)) {
+		LOG_error("RunAhead_open: second instance couldn't load the game\n");
+		runahead.secondary.deinit();
+		dlclose(runahead.secondary.handle);
+		memset(&runahead.secondary, 0, sizeof(runahead.secondary));
+		return 0;
+	}
+	
+	int device = has_custom_controllers ? strtol(gamepad_values[gamepad_type], NULL, 0) : RETRO_DEVICE_JOYPAD;
+	runahead.secondary.set_controller_port_device(0, device);
+	runahead.open = 1;
+	return 1;
+}
+static void RunAhead_skip(int video, int audio, int poll) {
+	skip_video = video;
+	skip_audio = audio;
+	skip_poll = poll;
+}
+static int RunAhead_run(void) { // returns 0 if the caller still needs to run the frame
+	if (!runahead_frames || !runahead_instance) RunAhead_close();
+	if (!runahead_frames || runahead.failed || fast_forward) return 0;
+	
+	int skip = skip_video; // frameskip applies to the frame we show
+	
+	if (runahead_instance && !runahead.open && !RunAhead_open()) runahead_instance = 0; // fall back to one instance
+	
+	// the real frame, heard but not seen
+	skip_video = 1;
+	core.run();
+	skip_video = skip;
+	
+	uint64_t then = getMicroseconds();
+	RunAheadCore primary = {core.run, core.serialize_size, core.serialize, core.unserialize};
+	RunAheadCore secondary = {runahead.secondary.run, runahead.secondary.serialize_size, runahead.secondary.serialize, runahead.secondary.unserialize};
+	runahead.ahead.skip = RunAhead_skip;
+	switch (RunAhead_step(&runahead.ahead, &primary, runahead.open ? &secondary : NULL, runahead_frames, skip)) {
+		case RUNAHEAD_NO_STATE:
+			LOG_error("RunAhead_run: %s can't serialize, disabling run ahead\n", core.name);
+			runahead.failed = 1;
+			return 1;
+		case RUNAHEAD_NO_SECONDARY:
+			LOG_error("RunAhead_run: second instance can't unserialize, using one\n");
+			runahead_instance = 0;
+			break;
+	}
+	
+	uint64_t overhead = getMicroseconds() - then;
+	runahead.overhead = (runahead.overhead * 15 + overhead) / 16;
+	return 1;
+}
+static void RunAhead_quit(void) {
+	RunAhead_close();
+	RunAhead_free(&runahead.ahead);
+}
+
+///////////////////////////////////////
+
 #define MENU_ITEM_COUNT 5
 #define MENU_SLOT_COUNT 8
 
@@ -3007,6 +3974,7 @@ void Menu_beforeSleep(void) {
 	SRAM_write();
 	RTC_write();
 	State_autosave();
+	Writer_flush(); // we may never wake up
 	putFile(AUTO_RESUME_PATH, game.path + strlen(SDCARD_PATH));
 	PWR_setCPUSpeed(CPU_SPEED_MENU);
 }
@@ -3257,7 +4225,7 @@ static int OptionControls_optionChanged(MenuList* list, int i) {
 	if (has_custom_controllers) {
 		gamepad_type = item->value;
 		int device = strtol(gamepad_values[item->value], NULL, 0);
-		core.set_controller_port_device(0, device);
+		Core_setControllerDevice(device);
 	}
 	return MENU_CALLBACK_NOP;
 }
@@ -4449,6 +5417,14 @@ static int Menu_options(MenuList* list) {
 	return 0;
 }
 
+static SDL_Surface* Menu_getFrame(void) { // the last frame as 565, caller frees
+	if (renderer.src_bpp!=4) return SDL_CreateRGBSurfaceFrom(renderer.src, renderer.true_w, renderer.true_h, FIXED_DEPTH, renderer.src_p, RGBA_MASK_565);
+	
+	// xrgb8888 the platform was converting as it blit
+	SDL_Surface* frame = SDL_CreateRGBSurface(SDL_SWSURFACE, renderer.true_w, renderer.true_h, FIXED_DEPTH, RGBA_MASK_565);
+	if (frame) buffer_downsample(renderer.src, renderer.true_w, renderer.true_h, renderer.src_p, frame->pixels, frame->pitch);
+	return frame;
+}
 static void Menu_initState(void) {
 	if (exists(menu.slot_path)) menu.slot = getInt(menu.slot_path);
 	if (menu.slot==8) menu.slot = 0;
@@ -4459,6 +5435,8 @@ static void Menu_initState(void) {
 static void Menu_updateState(void) {
 	// LOG_info("Menu_updateState\n");
 
+	Writer_flush(); // so a state that was just saved exists
+
 	int last_slot = state_slot;
 	state_slot = menu.slot;
 
@@ -4487,7 +5465,7 @@ static void Menu_saveState(void) {
 	}
 	
 	SDL_Surface* bitmap = menu.bitmap;
-	if (!bitmap) bitmap = SDL_CreateRGBSurfaceFrom(renderer.src, renderer.true_w, renderer.true_h, FIXED_DEPTH, renderer.src_p, RGBA_MASK_565);
+	if (!bitmap) bitmap = Menu_getFrame();
 	SDL_RWops* out = SDL_RWFromFile(menu.bmp_path, "wb");
 	SDL_SaveBMP_RW(bitmap, out, 1);
 	
@@ -4528,7 +5506,9 @@ static void Menu_loadState(void) {
 
 
 static void Menu_loop(void) {
-	menu.bitmap = SDL_CreateRGBSurfaceFrom(renderer.src, renderer.true_w, renderer.true_h, FIXED_DEPTH, renderer.src_p, RGBA_MASK_565);
+	CoreThread_pause(); // the menu touches core state so wait for the core thread to finish its frame
+	
+	menu.bitmap = Menu_getFrame();
 	// LOG_info("Menu_loop:menu.bitmap %ix%i\n", menu.bitmap->w,menu.bitmap->h);
 	
 	SDL_Surface* backing = SDL_CreateRGBSurface(SDL_SWSURFACE,DEVICE_WIDTH,DEVICE_HEIGHT,FIXED_DEPTH,RGBA_MASK_565); 
@@ -4666,6 +5646,7 @@ static void Menu_loop(void) {
 				case ITEM_OPTS: {
 					if (simple_mode) {
 						core.reset();
+						Rewind_reset();
 						status = STATUS_RESET;
 						show_menu = 0;
 					}
@@ -4854,7 +5835,9 @@ static void Menu_loop(void) {
 		// }
 		GFX_setEffect(screen_effect);
 		GFX_clear(screen);
-		video_refresh_callback(renderer.src, renderer.true_w, renderer.true_h, renderer.src_p);
+		// renderer.src has already been through the core's path, only xrgb8888 left for the blit needs converting again
+		video_refresh_frame(renderer.src, renderer.true_w, renderer.true_h, renderer.src_p, renderer.src_bpp==4);
+		if (thread_video) GFX_flip(screen);
 		
 		setOverclock(overclock); // restore overclock value
 		if (rumble_strength) VIB_setStrength(rumble_strength);
@@ -4862,11 +5845,7 @@ static void Menu_loop(void) {
 		GFX_setVsync(prevent_tearing);
 		if (!HAS_POWER_BUTTON) PWR_disableSleep();
 
-		if (thread_video) {
-			pthread_mutex_lock(&core_mx);
-			should_run_core = 1;
-			pthread_mutex_unlock(&core_mx);
-		}
+		CoreThread_resume();
 	}
 	else if (exists(NOUI_PATH)) PWR_powerOff(); // TODO: won't work with threaded core, only check this once per launch
 	
@@ -4949,25 +5928,154 @@ static void limitFF(void) {
 	last_time = now;
 }
 
-static void* coreThread(void *arg) {
+#define AUDIO_UNDERRUN_THRESHOLD 25 // audio buffer fill (percent) below which an underrun is likely
+#define FRAME_TIME_MAX_GAP 4 // frames, longer deltas are reported as one frame
+
+static void Core_run(void) {
+	if (core.audio_buffer_status) {
+		int active = !rewinding && (!fast_forward || ff_audio);
+		int fill = SND_getFill();
+		int underrun = SND_hadUnderrun() || fill<AUDIO_UNDERRUN_THRESHOLD;
+		core.audio_buffer_status(active, fill, active && underrun);
+	}
+	if (core.frame_time.callback) {
+		// measured, except while fast forwarding (so the core actually
+		// speeds up) and after a pause like the menu
+		static uint64_t last_time = 0;
+		uint64_t now = getMicroseconds();
+		retro_usec_t delta = now - last_time;
+		if (!last_time || fast_forward || delta>core.frame_time.reference*FRAME_TIME_MAX_GAP) delta = core.frame_time.reference;
+		last_time = now;
+		core.frame_time.callback(delta);
+	}
+	
+	skip_video = Frameskip_next();
+	if (rewinding && Rewind_step()) {
+		core.run(); // just to show where we rewound to
+	}
+	else {
+		if (!RunAhead_run()) core.run();
+		Rewind_push();
+	}
+	skip_video = 0;
+	SRAM_autosave();
+}
+
+///////////////////////////////
+
+// the core thread only ever stops between frames. the main thread
+// asks for a state and waits on the condition variable until the
+// core thread acknowledges it at that safe point, so nothing is torn
+// down while the core is inside retro_run()
+
+enum {
+	CORE_THREAD_STOPPED,
+	CORE_THREAD_RUNNING,
+	CORE_THREAD_PAUSED,
+	CORE_THREAD_STOPPING,
+};
+
+static struct CoreThread_Context {
+	pthread_t pt;
+	pthread_mutex_t mx;
+	pthread_cond_t cv;
+	int state; // requested
+	int parked; // core thread is at the safe point and not running frames
+} core_thread = {
+	.mx = PTHREAD_MUTEX_INITIALIZER,
+	.cv = PTHREAD_COND_INITIALIZER,
+	.state = CORE_THREAD_STOPPED,
+	.parked = 1,
+};
+
+static void* CoreThread_loop(void *arg) {
+	setAffinity(core_cpu, "core");
+	
 	// force a vsync immediately before loop
 	// for better frame pacing?
 	GFX_clearAll();
 	GFX_flip(screen);
 	
-	while (!quit) {
-		int run = 0;
-		pthread_mutex_lock(&core_mx);
-		run = should_run_core;
-		pthread_mutex_unlock(&core_mx);
-		
-		if (run) {
-			core.run();
-			limitFF();
-			trackFPS();
+	pthread_mutex_lock(&core_thread.mx);
+	while (core_thread.state!=CORE_THREAD_STOPPING && !quit) {
+		if (core_thread.state==CORE_THREAD_PAUSED) {
+			if (!core_thread.parked) {
+				core_thread.parked = 1;
+				pthread_cond_broadcast(&core_thread.cv);
+			}
+			pthread_cond_wait(&core_thread.cv, &core_thread.mx);
+			continue;
 		}
+		
+		core_thread.parked = 0;
+		pthread_mutex_unlock(&core_thread.mx);
+		
+		uint64_t then = getMicroseconds();
+		Core_run();
+		Stages_track(&stages.core, then);
+		Pacer_wait();
+		limitFF();
+		trackFPS();
+		
+		pthread_mutex_lock(&core_thread.mx);
+	}
+	core_thread.parked = 1;
+	pthread_cond_broadcast(&core_thread.cv);
+	pthread_mutex_unlock(&core_thread.mx);
+	return NULL;
+}
+
+static void CoreThread_start(void) {
+	if (core_thread.state!=CORE_THREAD_STOPPED) return;
+	
+	Mailbox_init(core.max_width * core.max_height * 4); // xrgb8888 at the core's max geometry
+	Pipeline_sync(); // before the first frame is posted
+	core_thread.state = CORE_THREAD_RUNNING;
+	core_thread.parked = 0;
+	if (pthread_create(&core_thread.pt, NULL, &CoreThread_loop, NULL)) {
+		LOG_error("CoreThread_start: unable to create thread\n");
+		core_thread.state = CORE_THREAD_STOPPED;
+		core_thread.parked = 1;
+		thread_video = 0;
+		Pipeline_sync();
+		return;
+	}
+}
+static void CoreThread_requestPause(void) { // from the core thread itself, takes effect after the current frame
+	pthread_mutex_lock(&core_thread.mx);
+	if (core_thread.state==CORE_THREAD_RUNNING) core_thread.state = CORE_THREAD_PAUSED;
+	pthread_mutex_unlock(&core_thread.mx);
+}
+static void CoreThread_pause(void) { // main thread, returns once the core thread is between frames
+	pthread_mutex_lock(&core_thread.mx);
+	if (core_thread.state==CORE_THREAD_RUNNING) core_thread.state = CORE_THREAD_PAUSED;
+	if (core_thread.state==CORE_THREAD_PAUSED) {
+		pthread_cond_broadcast(&core_thread.cv);
+		while (!core_thread.parked) pthread_cond_wait(&core_thread.cv, &core_thread.mx);
+	}
+	pthread_mutex_unlock(&core_thread.mx);
+}
+static void CoreThread_resume(void) {
+	pthread_mutex_lock(&core_thread.mx);
+	if (core_thread.state==CORE_THREAD_PAUSED) {
+		core_thread.state = CORE_THREAD_RUNNING;
+		pthread_cond_broadcast(&core_thread.cv);
+	}
+	pthread_mutex_unlock(&core_thread.mx);
+}
+static void CoreThread_stop(void) { // main thread
+	pthread_mutex_lock(&core_thread.mx);
+	if (core_thread.state==CORE_THREAD_STOPPED) {
+		pthread_mutex_unlock(&core_thread.mx);
+		return;
 	}
-	pthread_exit(NULL);
+	core_thread.state = CORE_THREAD_STOPPING;
+	pthread_cond_broadcast(&core_thread.cv);
+	pthread_mutex_unlock(&core_thread.mx);
+	
+	pthread_join(core_thread.pt, NULL);
+	core_thread.state = CORE_THREAD_STOPPED;
+	Pipeline_stop();
 }
 
 int main(int argc , char* argv[]) {
@@ -4992,6 +6100,7 @@ int main(int argc , char* argv[]) {
 	LOG_info("rom_path: %s\n", rom_path);
 
 	screen = GFX_init(MODE_MENU);
+	pacer.display_hz = GFX_getRefreshRate();
 	PAD_init();
 	DEVICE_WIDTH = screen->w;
 	DEVICE_HEIGHT = screen->h;
@@ -5038,11 +6147,11 @@ int main(int argc , char* argv[]) {
 	State_resume();
 	Menu_initState(); // make ready for state shortcuts
 	
-	if (thread_video) {
-		core_mx = (pthread_mutex_t)PTHREAD_MUTEX_INITIALIZER;
-		core_rq = (pthread_cond_t)PTHREAD_COND_INITIALIZER;
-		pthread_create(&core_pt, NULL, &coreThread, NULL);
+	if (toggle_thread) { // the saved option differs from the default, nothing's running yet
+		toggle_thread = 0;
+		thread_video = !thread_video;
 	}
+	if (thread_video) CoreThread_start();
 	
 	PWR_warn(1);
 	PWR_disableAutosleep();
@@ -5057,24 +6166,27 @@ int main(int argc , char* argv[]) {
 		GFX_startFrame();
 		
 		if (!thread_video) {
-			core.run();
+			Core_run();
+			Pacer_wait();
 			limitFF();
 			trackFPS();
 		}
 
 		if (thread_video && !quit) {
-			pthread_mutex_lock(&core_mx);
-			pthread_cond_wait(&core_rq,&core_mx);
-			
-			if (backbuffer) {
-				video_refresh_callback_main(backbuffer->pixels,backbuffer->w,backbuffer->h,backbuffer->pitch);
+			// pipelined frames were already converted by the worker
+			MailboxFrame* frame = pipeline.started ? Pipeline_wait() : Mailbox_wait();
+			if (frame) {
+				uint64_t then = getMicroseconds();
+				video_refresh_frame(frame->pixels,frame->width,frame->height,frame->pitch, downsample && !pipeline.started);
 				GFX_flip(screen);
+				Stages_track(&stages.present, then);
 			}
-			core_rq = (pthread_cond_t)PTHREAD_COND_INITIALIZER;
-			pthread_mutex_unlock(&core_mx);
 		}
 		
-		if (show_menu) Menu_loop();
+		if (show_menu) {
+			Menu_loop();
+			Pipeline_sync(); // video_pipeline may have changed
+		}
 		
 		if (toggle_thread) {
 			toggle_thread = 0;
@@ -5085,17 +6197,15 @@ int main(int argc , char* argv[]) {
 				thread_video = !thread_video;
 			}
 			// LOG_info("toggling thread from %i to %i\n", thread_video, !thread_video);
-			thread_video = !thread_video;
-			if (thread_video) {
+			if (!thread_video) {
 				// enable
-				core_mx = (pthread_mutex_t)PTHREAD_MUTEX_INITIALIZER;
-				core_rq = (pthread_cond_t)PTHREAD_COND_INITIALIZER;
-				pthread_create(&core_pt, NULL, &coreThread, NULL);
+				thread_video = 1;
+				CoreThread_start();
 			}
 			else {
-				// disable
-				pthread_cancel(core_pt);
-				pthread_join(core_pt,NULL);
+				// disable, the core thread finishes its frame before we take over
+				CoreThread_stop();
+				thread_video = 0;
 				
 				// force a vsync immediately before loop
 				// for better frame pacing?
@@ -5111,10 +6221,16 @@ int main(int argc , char* argv[]) {
 	
 finish:
 
+	CoreThread_stop();
 	Game_close();
 	Core_unload();
 	
 	Core_quit();
+	RunAhead_quit();
+	Pipeline_quit();
+	Mailbox_quit();
+	Writer_quit(); // after Core_quit() writes sram
+	Rewind_free();
 	Core_close();
 	
 	Config_quit();
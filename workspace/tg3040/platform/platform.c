@@ -84,7 +84,7 @@ SDL_Surface* PLAT_initVideo(void) {
 		LOG_info("- %ix%i (%s)\n", mode.w,mode.h, SDL_GetPixelFormatName(mode.format));
 	}
 	SDL_GetCurrentDisplayMode(0, &mode);
-	LOG_info("Current display mode: %ix%i (%s)\n", mode.w,mode.h, SDL_GetPixelFormatName(mode.format));
+	LOG_info("Current display mode: %ix%i (%s) %iHz\n", mode.w,mode.h, SDL_GetPixelFormatName(mode.format), mode.refresh_rate);
 	
 	int w = FIXED_WIDTH;
 	int h = FIXED_HEIGHT;
@@ -122,10 +122,12 @@ static void clearVideo(void) {
 		SDL_RenderClear(vid.renderer);
 		SDL_FillRect(vid.screen, NULL, 0);
 		
-		SDL_LockTexture(vid.texture,NULL,&vid.buffer->pixels,&vid.buffer->pitch);
-		SDL_FillRect(vid.buffer, NULL, 0);
-		SDL_UnlockTexture(vid.texture);
-		SDL_RenderCopy(vid.renderer, vid.texture, NULL, NULL);
+		if (SDL_LockTexture(vid.texture,NULL,&vid.buffer->pixels,&vid.buffer->pitch)==0) {
+			SDL_FillRect(vid.buffer, NULL, 0);
+			SDL_UnlockTexture(vid.texture);
+			SDL_RenderCopy(vid.renderer, vid.texture, NULL, NULL);
+		}
+		else LOG_error("SDL_LockTexture error: %s\n", SDL_GetError());
 		
 		SDL_RenderPresent(vid.renderer);
 	}
@@ -305,11 +307,16 @@ void PLAT_setEffect(int next_type) {
 void PLAT_vsync(int remaining) {
 	if (remaining>0) SDL_Delay(remaining);
 }
+double PLAT_getRefreshRate(void) {
+	SDL_DisplayMode mode;
+	if (SDL_GetCurrentDisplayMode(0, &mode) || !mode.refresh_rate) return 60.0; // driver doesn't know
+	return mode.refresh_rate;
+}
 
 scaler_t PLAT_getScaler(GFX_Renderer* renderer) {
 	// LOG_info("getScaler for scale: %i\n", renderer->scale);
 	effect.next_scale = renderer->scale;
-	return scale1x1_c16;
+	return renderer->src_bpp==4 ? scale1x1_c32to16 : scale1x1_c16; // the gpu does the actual scaling
 }
 
 void PLAT_blitRenderer(GFX_Renderer* renderer) {
@@ -329,7 +336,18 @@ void PLAT_flip(SDL_Surface* IGNORED, int ignored) {
 	}
 	
 	// uint32_t then = SDL_GetTicks();
-	SDL_UpdateTexture(vid.texture,NULL,vid.blit->src,vid.blit->src_p);
+	if (vid.blit->src_bpp==4) { // convert straight into the texture
+		void* pixels;
+		int pitch;
+		if (SDL_LockTexture(vid.texture,NULL,&pixels,&pitch)) {
+			LOG_error("SDL_LockTexture error: %s\n", SDL_GetError());
+			vid.blit = NULL; // drop this frame
+			return;
+		}
+		((scaler_t)vid.blit->blit)(vid.blit->src,pixels,vid.blit->true_w,vid.blit->true_h,vid.blit->src_p,vid.blit->true_w,vid.blit->true_h,pitch);
+		SDL_UnlockTexture(vid.texture);
+	}
+	else SDL_UpdateTexture(vid.texture,NULL,vid.blit->src,vid.blit->src_p);
 	// LOG_info("blit blocked for %ims (%i,%i)\n", SDL_GetTicks()-then,vid.buffer->w,vid.buffer->h);
 	
 	SDL_Texture* target = vid.texture;